@@ -0,0 +1,153 @@
+#include "driver/SegmentPool.h"
+
+#include "ets_sys.h"
+
+static uint8 _storage[SEGMENT_POOL_COUNT][TCP_MAX_PACKET] __attribute__((aligned(4)));
+static Segment _segments[SEGMENT_POOL_COUNT];
+static SegmentQueue _free;
+
+//Segments held per direction, and the minimum each direction is
+//guaranteed however busy the other one is
+static volatile uint8 _used[SEGMENT_DIRECTIONS];
+static uint8 _floor[SEGMENT_DIRECTIONS] = {
+	SEGMENT_FLOOR_UART_RX,
+	SEGMENT_FLOOR_TCP_RX
+};
+
+//Unlocked queue operations, callers hold the UART interrupt mask
+static void __push(SegmentQueue *queue, uint8 seg) {
+	_segments[seg].next = SEGMENT_NONE;
+
+	if(queue->tail == SEGMENT_NONE) {
+		queue->head = seg;
+	}
+	else {
+		_segments[queue->tail].next = seg;
+	}
+	queue->tail = seg;
+	queue->count++;
+}
+
+static uint8 __pop(SegmentQueue *queue) {
+	uint8 seg = queue->head;
+
+	if(seg != SEGMENT_NONE) {
+		queue->head = _segments[seg].next;
+		if(queue->head == SEGMENT_NONE) {
+			queue->tail = SEGMENT_NONE;
+		}
+		queue->count--;
+	}
+
+	return seg;
+}
+
+//Free segments 'dir' may take without eating into the other direction's floor
+static uint8 __available(uint8 dir) {
+	uint8 other = dir ^ 1;
+	uint8 reserved = (_used[other] < _floor[other]) ? (_floor[other] - _used[other]) : 0;
+
+	return (_free.count > reserved) ? (_free.count - reserved) : 0;
+}
+
+void SegmentPool_init() {
+	uint8 i;
+
+	SegmentQueue_init(&_free);
+
+	for(i = 0; i < SEGMENT_POOL_COUNT; ++i) {
+		_segments[i].data = _storage[i];
+		__push(&_free, i);
+	}
+
+	for(i = 0; i < SEGMENT_DIRECTIONS; ++i) {
+		_used[i] = 0;
+	}
+}
+
+uint8 SegmentPool_alloc(uint8 dir) {
+	uint8 seg = SEGMENT_NONE;
+
+	ETS_UART_INTR_DISABLE();
+
+	if(__available(dir) > 0) {
+		seg = __pop(&_free);
+
+		_segments[seg].len = 0;
+		_segments[seg].offset = 0;
+		_segments[seg].dir = dir;
+		_used[dir]++;
+	}
+
+	ETS_UART_INTR_ENABLE();
+
+	return seg;
+}
+
+void SegmentPool_free(uint8 seg) {
+	ETS_UART_INTR_DISABLE();
+
+	_used[_segments[seg].dir]--;
+	__push(&_free, seg);
+
+	ETS_UART_INTR_ENABLE();
+}
+
+void SegmentPool_setFloor(uint8 dir, uint8 floor) {
+	ETS_UART_INTR_DISABLE();
+	_floor[dir] = floor;
+	ETS_UART_INTR_ENABLE();
+}
+
+uint8 SegmentPool_available(uint8 dir) {
+	return __available(dir);
+}
+
+uint8 SegmentPool_guaranteed(uint8 dir) {
+	uint8 used = _used[dir];
+
+	return (used < _floor[dir]) ? (_floor[dir] - used) : 0;
+}
+
+uint8 SegmentPool_getUsed(uint8 dir) {
+	return _used[dir];
+}
+
+Segment* SegmentPool_get(uint8 seg) {
+	return &_segments[seg];
+}
+
+void SegmentQueue_init(SegmentQueue *queue) {
+	queue->head = queue->tail = SEGMENT_NONE;
+	queue->count = 0;
+}
+
+void SegmentQueue_push(SegmentQueue *queue, uint8 seg) {
+	ETS_UART_INTR_DISABLE();
+	__push(queue, seg);
+	ETS_UART_INTR_ENABLE();
+}
+
+uint8 SegmentQueue_pop(SegmentQueue *queue) {
+	ETS_UART_INTR_DISABLE();
+	uint8 seg = __pop(queue);
+	ETS_UART_INTR_ENABLE();
+
+	return seg;
+}
+
+uint8 SegmentQueue_peek(SegmentQueue *queue) {
+	return queue->head;
+}
+
+uint8 SegmentQueue_peekTail(SegmentQueue *queue) {
+	return queue->tail;
+}
+
+void SegmentQueue_freeAll(SegmentQueue *queue) {
+	uint8 seg;
+
+	while((seg = SegmentQueue_pop(queue)) != SEGMENT_NONE) {
+		SegmentPool_free(seg);
+	}
+}
@@ -0,0 +1,70 @@
+#include "driver/TokenBucket.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+
+#define US_PER_SECOND	(1000000)
+
+//'last' only moves by the time the added tokens stand for, so frequent
+//calls at low rates don't lose the fractions
+static void __refill(TokenBucket *bucket) {
+	uint32 now = system_get_time();
+	uint32 elapsed = now - bucket->last;
+	uint32 add;
+
+	if(bucket->tokens >= bucket->burst) {
+		bucket->last = now;
+		return;
+	}
+
+	add = ((uint64)elapsed * bucket->rate) / US_PER_SECOND;
+	if(add == 0) {
+		return;
+	}
+
+	if(add >= bucket->burst - bucket->tokens) {
+		bucket->tokens = bucket->burst;
+		bucket->last = now;
+	}
+	else {
+		bucket->tokens += add;
+		bucket->last += ((uint64)add * US_PER_SECOND) / bucket->rate;
+	}
+}
+
+void ICACHE_FLASH_ATTR TokenBucket_init(TokenBucket *bucket, uint32 rate, uint32 burst) {
+	bucket->rate = rate;
+	bucket->burst = burst;
+	bucket->tokens = burst;
+	bucket->last = system_get_time();
+}
+
+uint32 TokenBucket_available(TokenBucket *bucket) {
+	if(bucket->rate == 0) {
+		return 0xFFFFFFFF;
+	}
+
+	__refill(bucket);
+
+	return bucket->tokens;
+}
+
+void TokenBucket_consume(TokenBucket *bucket, uint32 bytes) {
+	if(bucket->rate == 0) {
+		return;
+	}
+
+	bucket->tokens = (bytes < bucket->tokens) ? (bucket->tokens - bytes) : 0;
+}
+
+uint32 TokenBucket_delay(TokenBucket *bucket, uint32 bytes) {
+	uint32 missing;
+
+	if(TokenBucket_available(bucket) >= bytes) {
+		return 0;
+	}
+
+	//Rounded up, a timer that fires early finds too few tokens again
+	missing = bytes - bucket->tokens;
+	return (((uint64)missing * 1000) + bucket->rate - 1) / bucket->rate;
+}
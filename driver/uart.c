@@ -16,19 +16,53 @@
  */
 #include "ets_sys.h"
 #include "osapi.h"
+#include "user_interface.h"
 #include "driver/uart.h"
-#include "osapi.h"
 #include "driver/uart_register.h"
 #include "mem.h"
 #include "os_type.h"
-#include "driver/RingBuffer.h"
+#include "driver/SegmentPool.h"
+#include "user_trace.h"
+#include "user_isrprofile.h"
+#include "user_stats.h"
+
+#define UART_RX_INT_ENA	(UART_RXFIFO_FULL_INT_ENA | UART_RXFIFO_TOUT_INT_ENA)
+
+//Interrupts that only report garbage while the baud rate is unknown
+#define UART_AUTOBAUD_INT_ENA	(UART_RX_INT_ENA | UART_RXFIFO_OVF_INT_ENA \
+	| UART_FRM_ERR_INT_ENA | UART_PARITY_ERR_INT_ENA)
+#define UART_AUTOBAUD_INT_CLR	(UART_RXFIFO_FULL_INT_CLR | UART_RXFIFO_TOUT_INT_CLR \
+	| UART_RXFIFO_OVF_INT_CLR | UART_FRM_ERR_INT_CLR | UART_PARITY_ERR_INT_CLR)
+
+//Autobaud glitch filter in UART clock cycles
+#define UART_AUTOBAUD_GLITCH	(0x08)
+
+//Segment the RX ISR is currently filling, and closed segments waiting
+//for the TCP layer
+static volatile uint8 _rxSegment;
+static SegmentQueue _rxReady;
+static volatile uint8 _rxStalled;
+static volatile uint32 _intFlags;
+static volatile uint8 _autobaud;		//RX is off while the rate is measured
 
-#define BUFFER_SIZE	2048
+//Flush policy, each delimiter is kept repeated in all four bytes so a
+//whole word can be checked at once
+static uint8 _flushMode;
+static uint32 _delimPattern[UART_MAX_DELIMS];
+static uint8 _delimCount;
 
-//static volatile RingBuffer _rxBuffer;
-static volatile uint8 _rxBuffer[BUFFER_SIZE];
-static volatile uint16 _rxLen;
-static volatile uint32 _intFlags;
+//RX timeout threshold in byte times used in packet mode, and the one
+//the governor asked for, which applies in the other modes
+static uint8 _packetGap;
+static uint8 _rxTimeout;
+
+//Bytes left free at the start of each segment for a frame header
+static uint8 _rxHeadroom;
+
+static DebugHandler _debugHandler;
+
+//Non-zero if any byte of 'v' is zero
+#define HAS_ZERO_BYTE(v)	(((v) - 0x01010101) & ~(v) & 0x80808080)
 
 // UartDev is defined and initialized in rom code.
 extern UartDevice    UartDev;
@@ -81,39 +115,207 @@ uart_config(uint8 uart_no)
     SET_PERI_REG_MASK(UART_INT_ENA(uart_no), UART_RXFIFO_FULL_INT_ENA|UART_RXFIFO_OVF_INT_ENA|UART_RXFIFO_TOUT_INT_ENA|UART_FRM_ERR_INT_ENA|UART_PARITY_ERR_INT_ENA);
 }
 
-uint16 uart_get(uint8 *out, uint16 len) {
-	//uart_rx_intr_disable(UART0);
+//Close the segment being filled and queue it for the TCP layer
+LOCAL void __closeRxSegment() {
+	if(_rxSegment != SEGMENT_NONE) {
+		Segment *seg = SegmentPool_get(_rxSegment);
 
-  uint16 amount = (_rxLen < len) ? _rxLen : len;
+		if(seg->len > seg->offset) {
+			SegmentQueue_push(&_rxReady, _rxSegment);
+			_rxSegment = SEGMENT_NONE;
+		}
+	}
+}
+
+//Stop taking RX interrupts until a segment is freed. Bytes back up in
+//the hardware FIFO (and assert RTS if flow control is enabled).
+LOCAL void __stallRx() {
+	_rxStalled = 1;
+	bridgeStats.rxStalls++;
 
-  memcpy(out, (uint8*)_rxBuffer, amount);
+	_intFlags &= ~UART_RX_INT_ENA;
+	CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_RX_INT_ENA);
+}
 
-	if(amount != _rxLen) {
-		memcpy((uint8*)_rxBuffer, (uint8*)_rxBuffer + amount, _rxLen - amount);
+//Events carry their post time so the tasks can measure dispatch latency
+LOCAL void __post(uint8 prio, os_signal_t sig) {
+	if(!system_os_post(prio, sig, system_get_time())) {
+		bridgeStats.postFailures++;
 	}
-  _rxLen -= amount;
+}
 
-	//uart_rx_intr_enable(UART0);
+//Looks for a delimiter in data[start, end). Segment data is word aligned,
+//bytes up to the next word boundary are checked one at a time so bytes
+//in front of 'start' never match.
+LOCAL uint8 __hasDelim(const uint8 *data, uint16 start, uint16 end) {
+	uint16 i = start;
+	uint8 d;
+
+	for(; (i & 3) && (i < end); ++i) {
+		for(d = 0; d < _delimCount; ++d) {
+			if(data[i] == (uint8)_delimPattern[d]) {
+				return 1;
+			}
+		}
+	}
 
-	return amount;
-/*
-	//Grab the data from the FIFO
+	for(; i + 4 <= end; i += 4) {
+		uint32 word = *(const uint32*)(data + i);
+
+		for(d = 0; d < _delimCount; ++d) {
+			if(HAS_ZERO_BYTE(word ^ _delimPattern[d])) {
+				return 1;
+			}
+		}
+	}
+
+	for(; i < end; ++i) {
+		for(d = 0; d < _delimCount; ++d) {
+			if(data[i] == (uint8)_delimPattern[d]) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+//Move bytes from the RX FIFO straight into pool segments. 'keep' bytes
+//are left behind, the RX timeout only fires with data in the FIFO.
+LOCAL void __fillRxSegments(uint8 keep) {
 	uint8 fifo_len = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_RXFIFO_CNT_S)
 		& UART_RXFIFO_CNT;
-	
+
+	fifo_len = (fifo_len > keep) ? (fifo_len - keep) : 0;
+
+	TRACE_EVENT(TRACE_UART_RX, fifo_len);
+
+	while(fifo_len > 0) {
+		if(_rxSegment == SEGMENT_NONE) {
+			_rxSegment = SegmentPool_alloc(SEGMENT_UART_RX);
+
+			if(_rxSegment == SEGMENT_NONE) {
+				__stallRx();
+				break;
+			}
+
+			SegmentPool_get(_rxSegment)->len = _rxHeadroom;
+			SegmentPool_get(_rxSegment)->offset = _rxHeadroom;
+		}
+
+		Segment *seg = SegmentPool_get(_rxSegment);
+		uint16 start = seg->len;
+		uint16 count = TCP_MAX_PACKET - seg->len;
+		if(count > fifo_len)
+			count = fifo_len;
+
+		uint8 *out = seg->data + seg->len;
+		seg->len += count;
+		fifo_len -= count;
+
+		bridgeStats.uartRxBytes += count;
+		bridgeStats.bytesCopied += count;
+
+		while((count--) > 0) {
+			*(out++) = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
+		}
+
+		if(seg->len == TCP_MAX_PACKET) {
+			__closeRxSegment();
+		}
+		else if((_flushMode == UART_FLUSH_LINE) && __hasDelim(seg->data, start, seg->len)) {
+			__closeRxSegment();
+			bridgeStats.lineFlushes++;
+		}
+	}
+}
+
+//Next filled segment for the TCP layer, or SEGMENT_NONE
+uint8 uart_getSegment() {
+	return SegmentQueue_pop(&_rxReady);
+}
+
+//Hand over the partially filled segment, e.g. when the link is idle
+void uart_flushSegment() {
+	ETS_UART_INTR_DISABLE();
+	__closeRxSegment();
+	ETS_UART_INTR_ENABLE();
+}
+
+uint8 uart_hasPartialSegment() {
+	uint8 seg = _rxSegment;
+
+	return (seg != SEGMENT_NONE)
+		&& (SegmentPool_get(seg)->len > SegmentPool_get(seg)->offset);
+}
+
+void ICACHE_FLASH_ATTR
+uart_setFlushPolicy(uint8 mode, const uint8 *delims) {
 	uint8 i;
 
-	for(i = 0; i < fifo_len; ++i) {
-		//uart_tx_one_char(UART0, READ_PERI_REG(UART_FIFO(UART0)) & 0xFF);
-		//RingBuffer_addByte((RingBuffer*)&_rxBuffer, READ_PERI_REG(UART_FIFO(UART0)) & 0xFF);
-		out[i] = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
+	ETS_UART_INTR_DISABLE();
+
+	_flushMode = mode;
+	SET_PERI_REG_BITS(UART_CONF1(UART0), UART_RX_TOUT_THRHD,
+		(mode == UART_FLUSH_PACKET) ? _packetGap : _rxTimeout, UART_RX_TOUT_THRHD_S);
+	_delimCount = 0;
+
+	for(i = 0; (i < UART_MAX_DELIMS) && (delims[i] != 0); ++i) {
+		_delimPattern[_delimCount++] = delims[i] * 0x01010101;
 	}
 
-	//Re-enable UART RX interrupts
-	SET_PERI_REG_MASK(UART_INT_ENA(UART0), UART_RXFIFO_FULL_INT_ENA | UART_RXFIFO_TOUT_INT_ENA);
+	ETS_UART_INTR_ENABLE();
+}
 
-	return fifo_len;
-*/
+uint8 uart_getFlushMode() {
+	return _flushMode;
+}
+
+void ICACHE_FLASH_ATTR
+uart_setLoopback(uint8 enable) {
+	if(enable) {
+		SET_PERI_REG_MASK(UART_CONF0(UART0), UART_LOOPBACK);
+	}
+	else {
+		CLEAR_PERI_REG_MASK(UART_CONF0(UART0), UART_LOOPBACK);
+	}
+}
+
+void ICACHE_FLASH_ATTR
+uart_setPacketGap(uint16 bits) {
+	uint16 bytes = (bits + 9)/10;
+
+	if(bytes < 1) {
+		bytes = 1;
+	}
+	else if(bytes > UART_RX_TOUT_THRHD) {
+		bytes = UART_RX_TOUT_THRHD;
+	}
+	_packetGap = bytes;
+
+	if(_flushMode == UART_FLUSH_PACKET) {
+		SET_PERI_REG_BITS(UART_CONF1(UART0), UART_RX_TOUT_THRHD, _packetGap, UART_RX_TOUT_THRHD_S);
+	}
+}
+
+void ICACHE_FLASH_ATTR
+uart_setRxHeadroom(uint8 bytes) {
+	ETS_UART_INTR_DISABLE();
+	_rxHeadroom = bytes;
+	ETS_UART_INTR_ENABLE();
+}
+
+//Called when segments are returned to the pool
+void uart_rxResume() {
+	if(_rxStalled && !_autobaud && (SegmentPool_available(SEGMENT_UART_RX) > 0)) {
+		ETS_UART_INTR_DISABLE();
+
+		_rxStalled = 0;
+		_intFlags |= UART_RX_INT_ENA;
+		SET_PERI_REG_MASK(UART_INT_ENA(UART0), UART_RX_INT_ENA);
+
+		ETS_UART_INTR_ENABLE();
+	}
 }
 
 uint16 uart_getFifoLen() {
@@ -123,6 +325,79 @@ uint16 uart_getFifoLen() {
 	return fifo_len;
 }
 
+void ICACHE_FLASH_ATTR
+uart_setRxThresholds(uint8 full, uint8 timeout) {
+	_rxTimeout = timeout;
+
+	//The timeout defines packet boundaries, it isn't the governor's to tune
+	if(_flushMode == UART_FLUSH_PACKET) {
+		timeout = _packetGap;
+	}
+
+	SET_PERI_REG_BITS(UART_CONF1(UART0), UART_RXFIFO_FULL_THRHD, full, UART_RXFIFO_FULL_THRHD_S);
+	SET_PERI_REG_BITS(UART_CONF1(UART0), UART_RX_TOUT_THRHD, timeout, UART_RX_TOUT_THRHD_S);
+}
+
+void ICACHE_FLASH_ATTR
+uart_autobaudStart() {
+	ETS_UART_INTR_DISABLE();
+	_autobaud = 1;
+	CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_AUTOBAUD_INT_ENA);
+
+	//Or the next TX interrupt change would turn RX back on
+	_intFlags &= ~(UART_RX_INT_ENA | UART_RXFIFO_OVF_INT_ENA);
+	ETS_UART_INTR_ENABLE();
+
+	//Enabling again restarts the measurement
+	WRITE_PERI_REG(UART_AUTOBAUD(UART0), 0);
+	WRITE_PERI_REG(UART_AUTOBAUD(UART0),
+		((UART_AUTOBAUD_GLITCH & UART_GLITCH_FILT) << UART_GLITCH_FILT_S) | UART_AUTOBAUD_EN);
+}
+
+uint32 ICACHE_FLASH_ATTR
+uart_autobaudPulse(uint16 edges) {
+	uint32 low, high;
+
+	if(((READ_PERI_REG(UART_PULSE_NUM(UART0)) >> UART_PULSE_NUM_CNT_S) & UART_PULSE_NUM_CNT) < edges) {
+		return 0;
+	}
+
+	low = (READ_PERI_REG(UART_LOWPULSE(UART0)) >> UART_LOWPULSE_MIN_CNT_S) & UART_LOWPULSE_MIN_CNT;
+	high = (READ_PERI_REG(UART_HIGHPULSE(UART0)) >> UART_HIGHPULSE_MIN_CNT_S) & UART_HIGHPULSE_MIN_CNT;
+
+	return (low < high) ? low : high;
+}
+
+void ICACHE_FLASH_ATTR
+uart_autobaudStop(uint32 baud) {
+	WRITE_PERI_REG(UART_AUTOBAUD(UART0), 0);
+
+	if(baud != 0) {
+		UART_SetBaudrate(UART0, baud);
+	}
+
+	ETS_UART_INTR_DISABLE();
+
+	//Everything received so far was sampled at the wrong rate
+	SET_PERI_REG_MASK(UART_CONF0(UART0), UART_RXFIFO_RST);
+	CLEAR_PERI_REG_MASK(UART_CONF0(UART0), UART_RXFIFO_RST);
+	WRITE_PERI_REG(UART_INT_CLR(UART0), UART_AUTOBAUD_INT_CLR);
+
+	//A stalled RX is left to uart_rxResume
+	_autobaud = 0;
+	_intFlags |= _rxStalled ? UART_RXFIFO_OVF_INT_ENA : (UART_RX_INT_ENA | UART_RXFIFO_OVF_INT_ENA);
+	SET_PERI_REG_MASK(UART_INT_ENA(UART0),
+		_rxStalled ? (UART_AUTOBAUD_INT_ENA & ~UART_RX_INT_ENA) : UART_AUTOBAUD_INT_ENA);
+
+	ETS_UART_INTR_ENABLE();
+
+	uart_rxResume();
+}
+
+uint32 uart_getBaudrate() {
+	return UART_CLK_FREQ / (READ_PERI_REG(UART_CLKDIV(UART0)) & UART_CLKDIV_CNT);
+}
+
 uint8 uart_getTxFifoAvail() {
 	uint8 fifo_len = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_TXFIFO_CNT_S)
 		& UART_TXFIFO_CNT;
@@ -197,13 +472,11 @@ uart0_sendStr(const char *str)
 }
 
 void uart_rx_flush() {
-  volatile uint8 byte;
-
   uint8 fifo_len = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_RXFIFO_CNT_S)
 	  & UART_RXFIFO_CNT;
 
 	while((fifo_len--) > 0) {
-	  byte = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
+	  (void)READ_PERI_REG(UART_FIFO(UART0));
 	}
 }
 
@@ -230,6 +503,9 @@ uart0_rx_intr_handler(void *para)
     //uint8 temp,cnt;
     //RcvMsgBuff *pRxBuff = (RcvMsgBuff *)para;
 		uint8 read = 0;
+		uint8 cause = ISR_CAUSE_NONE;
+
+		ISR_PROFILE_ENTER();
     
     	/*ATTENTION:*/
 	/*IN NON-OS VERSION SDK, DO NOT USE "ICACHE_FLASH_ATTR" FUNCTIONS IN THE WHOLE HANDLER PROCESS*/
@@ -242,7 +518,7 @@ uart0_rx_intr_handler(void *para)
 				//Disable this interrupt until we read the data from the fifo
 				//CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_RXFIFO_FULL_INT_ENA | UART_RXFIFO_TOUT_INT_ENA);
 
-        //system_os_post(UART_TASK_PRIORITY, UART_SIG_RECV, 0);
+        //system_os_post(UART_RX_TASK_PRIORITY, UART_SIG_RECV, 0);
 
 				//Clear interrupt flag
 				//WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR);
@@ -251,6 +527,7 @@ uart0_rx_intr_handler(void *para)
 				//_rxLen += count;
 				read = 1;
 				intMask = UART_RXFIFO_FULL_INT_CLR;
+				cause = ISR_CAUSE_RX_FULL;
     }
 		else if(UART_RXFIFO_TOUT_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_TOUT_INT_ST)){
 				//recv = 1;
@@ -259,7 +536,7 @@ uart0_rx_intr_handler(void *para)
 				//Disable this interrupt until we read the data from the fifo
 				//CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_RXFIFO_TOUT_INT_ENA | UART_RXFIFO_FULL_INT_ENA);
 
-        //system_os_post(UART_TASK_PRIORITY, UART_SIG_RECV, 0);
+        //system_os_post(UART_RX_TASK_PRIORITY, UART_SIG_RECV, 0);
 
 				//Clear interrupt flag
 				WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_TOUT_INT_CLR);
@@ -267,52 +544,65 @@ uart0_rx_intr_handler(void *para)
 				//uint16 count = uart_get((uint8*)_rxBuffer + _rxLen, BUFFER_SIZE - _rxLen);
 				//_rxLen += count;
 				read = 1;
-
+				cause = ISR_CAUSE_RX_TOUT;
     }
 		else if(UART_TXFIFO_EMPTY_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_TXFIFO_EMPTY_INT_ST)){
 			CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
       
 			//_intFlags &= ~(UART_TXFIFO_EMPTY_INT_ENA);
 
-			system_os_post(UART_TASK_PRIORITY, UART_SIG_TXTO, 0);
+			__post(UART_TX_TASK_PRIORITY, UART_SIG_TXTO);
       WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_TXFIFO_EMPTY_INT_CLR);
+			cause = ISR_CAUSE_TX_EMPTY;
         
     }
 		else if(UART_RXFIFO_OVF_INT_ST  == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_OVF_INT_ST)){
-        system_os_post(UART_TASK_PRIORITY, UART_SIG_RXOVF, 0);
+        __post(UART_RX_TASK_PRIORITY, UART_SIG_RXOVF);
 				
 				WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_RXFIFO_OVF_INT_CLR);
+				cause = ISR_CAUSE_RX_OVF;
     }
 		else if(UART_FRM_ERR_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_FRM_ERR_INT_ST)) {
-			system_os_post(UART_TASK_PRIORITY, UART_SIG_ERR_FRM, 0);
+			__post(UART_ERR_TASK_PRIORITY, UART_SIG_ERR_FRM);
 
 			WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_FRM_ERR_INT_CLR);
+			cause = ISR_CAUSE_FRM_ERR;
 		}
 		else if(UART_PARITY_ERR_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_PARITY_ERR_INT_ST)) {
-			//system_os_post(UART_TASK_PRIORITY, UART_SIG_ERR_PARITY, 0);
+			//__post(UART_ERR_TASK_PRIORITY, UART_SIG_ERR_PARITY);
 
 			WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_PARITY_ERR_INT_CLR);
+			cause = ISR_CAUSE_PARITY;
 		}
 
 
 	if(read) {
-		//Grab data from FIFO
-		uint8 fifo_len = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_RXFIFO_CNT_S)
-			& UART_RXFIFO_CNT;
-
-		while((fifo_len--) > 0) {
-			//uart_tx_one_char(UART0, READ_PERI_REG(UART_FIFO(UART0)) & 0xFF);
-			//RingBuffer_addByte((RingBuffer*)&_rxBuffer, READ_PERI_REG(UART_FIFO(UART0)) & 0xFF);
-      _rxBuffer[_rxLen++] = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
-		}
+		//Grab data from FIFO, in packet mode the end of a packet has to
+		//show up as a timeout
+		__fillRxSegments(((intMask == UART_RXFIFO_FULL_INT_CLR)
+			&& (_flushMode == UART_FLUSH_PACKET)) ? 1 : 0);
 
 		//Clear int flag
 		WRITE_PERI_REG(UART_INT_CLR(UART0), intMask);
 
+		//The line went idle, don't hold the partial segment back
+		if(intMask == UART_RXFIFO_TOUT_INT_CLR) {
+			if(_flushMode == UART_FLUSH_PACKET) {
+				if(uart_hasPartialSegment()) {
+					bridgeStats.uartPackets++;
+				}
+				__closeRxSegment();
+			}
+			else if(_flushMode == UART_FLUSH_IDLE) {
+				__closeRxSegment();
+			}
+		}
+
     //Post receive message
-    system_os_post(UART_TASK_PRIORITY, UART_SIG_RECV, 0);
+    __post(UART_RX_TASK_PRIORITY, UART_SIG_RECV);
 	}
 
+	ISR_PROFILE_EXIT(cause);
 }
 
 /******************************************************************************
@@ -328,8 +618,14 @@ uart_init(UartBautRate uart0_br, UartBautRate uart1_br)
     /*this is a example to process uart data from task,please change the priority to fit your application task if exists*/
     //system_os_task(uart_recvTask, uart_recvTaskPrio, uart_recvTaskQueue, uart_recvTaskQueueLen);  //demo with a task to process the uart data
     
-		//RingBuffer_init((RingBuffer*)&_rxBuffer);
-    _rxLen = 0;
+    SegmentPool_init();
+    SegmentQueue_init(&_rxReady);
+    _rxSegment = SEGMENT_NONE;
+    _rxStalled = 0;
+    _flushMode = UART_FLUSH_IDLE;
+    _delimCount = 0;
+    _packetGap = UART_RX_TO_LEVEL;
+    _rxTimeout = UART_RX_TO_LEVEL;
 
 		_intFlags = UART_RXFIFO_FULL_INT_ENA|UART_RXFIFO_OVF_INT_ENA|UART_RXFIFO_TOUT_INT_ENA;
 
@@ -380,7 +676,16 @@ STATUS uart0_tx_one_char_no_wait(uint8 TxChar)
     return OK;
 }
 
+void ICACHE_FLASH_ATTR
+uart_setDebugHandler(DebugHandler handler) {
+	_debugHandler = handler;
+}
+
 void uart_debugSend(char *str) {
+	if(_debugHandler != NULL) {
+		_debugHandler(str);
+	}
+
 #ifndef DEBUG
 	return;
 #else
@@ -400,6 +705,8 @@ uint16 uart0_send_nowait(uint8 *buffer, uint16 len) {
 
 		written = avail;
 
+		TRACE_EVENT(TRACE_UART_TX, written);
+
 		while( (avail--) > 0 ) {
 			WRITE_PERI_REG(UART_FIFO(UART0), *(buffer++));
 		}
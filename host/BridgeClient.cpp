@@ -0,0 +1,527 @@
+#include "BridgeClient.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define CONNECT_TIMEOUT_MS	2000
+
+//Frame layout, see include/user_frame.h in the firmware
+#define FRAME_HEADER_LEN	4
+#define FRAME_DATA		0
+#define FRAME_CREDIT	1
+
+//Data frames are kept short enough that a queued message doesn't wait
+//long behind one
+#define MUX_DATA_FRAME	4096
+
+//Oldest messages are dropped past this when the application doesn't
+//pick them up
+#define MUX_MAX_MESSAGES	256
+
+BridgeClient::BridgeClient(const Options &_options)
+	:	options(_options)
+	,	recvRing(_options.recvCapacity)
+	,	sendRing(_options.sendCapacity)
+	,	running(false)
+	,	isConnected(false)
+	,	sock(-1)
+	,	bytesReceived(0)
+	,	bytesSent(0)
+	,	sendCalls(0)
+	,	connects(0)
+	,	disconnects(0)
+	,	pendingSince(std::chrono::steady_clock::time_point::max()) {
+
+	wakePipe[0] = wakePipe[1] = -1;
+
+	resetFrames();
+}
+
+BridgeClient::~BridgeClient() {
+	stop();
+}
+
+void BridgeClient::start() {
+	if(running)
+		return;
+
+	if(pipe(wakePipe) != 0)
+		return;
+
+	fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+	running = true;
+	thread = std::thread(&BridgeClient::ioThread, this);
+}
+
+void BridgeClient::stop() {
+	if(!running)
+		return;
+
+	running = false;
+	wake();
+	thread.join();
+
+	close(wakePipe[0]);
+	close(wakePipe[1]);
+	wakePipe[0] = wakePipe[1] = -1;
+}
+
+bool BridgeClient::connected() const {
+	return isConnected;
+}
+
+size_t BridgeClient::read(void *out, size_t len) {
+	bool wasFull = (recvRing.space() == 0);
+
+	size_t count = recvRing.get(static_cast<uint8_t*>(out), len);
+
+	//The I/O thread stops polling the socket while the ring is full
+	if(wasFull && (count > 0))
+		wake();
+
+	return count;
+}
+
+size_t BridgeClient::write(const void *data, size_t len) {
+	size_t before = sendRing.size();
+
+	size_t count = sendRing.put(static_cast<const uint8_t*>(data), len);
+
+	//Only wake the I/O thread when a new batch starts or a batch fills up,
+	//otherwise let writes coalesce
+	if((before == 0) || ((before < options.coalesceBytes)
+		&& (before + count >= options.coalesceBytes))) {
+		wake();
+	}
+
+	return count;
+}
+
+bool BridgeClient::waitReadable(std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> lock(readMutex);
+
+	return readCond.wait_for(lock, timeout, [this]() {
+		return recvRing.size() > 0;
+	});
+}
+
+bool BridgeClient::flush(std::chrono::milliseconds timeout) {
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	while(sendRing.size() > 0) {
+		if(std::chrono::steady_clock::now() >= deadline)
+			return false;
+
+		wake();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return true;
+}
+
+bool BridgeClient::sendMessage(uint8_t channel, const std::string &payload) {
+	if(!options.mux || (payload.size() > 0xFFFF))
+		return false;
+
+	std::string frame;
+	frame += static_cast<char>(channel);
+	frame += '\0';
+	frame += static_cast<char>(payload.size() >> 8);
+	frame += static_cast<char>(payload.size() & 0xFF);
+	frame += payload;
+
+	{
+		std::lock_guard<std::mutex> lock(messageMutex);
+		outMessages.push_back(frame);
+	}
+
+	wake();
+
+	return true;
+}
+
+bool BridgeClient::receiveMessage(Message &out, std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> lock(messageMutex);
+
+	if(!messageCond.wait_for(lock, timeout, [this]() { return !inMessages.empty(); }))
+		return false;
+
+	out = inMessages.front();
+	inMessages.pop_front();
+
+	return true;
+}
+
+BridgeClient::Stats BridgeClient::stats() const {
+	Stats s;
+
+	s.bytesReceived = bytesReceived;
+	s.bytesSent = bytesSent;
+	s.sendCalls = sendCalls;
+	s.connects = connects;
+	s.disconnects = disconnects;
+
+	return s;
+}
+
+void BridgeClient::wake() {
+	if(wakePipe[1] >= 0) {
+		char c = 0;
+		ssize_t ignored = ::write(wakePipe[1], &c, 1);
+		(void)ignored;
+	}
+}
+
+bool BridgeClient::connectSocket() {
+	struct addrinfo hints = {}, *result = nullptr;
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	std::string port = std::to_string(options.port);
+	if(getaddrinfo(options.host.c_str(), port.c_str(), &hints, &result) != 0)
+		return false;
+
+	sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if(sock < 0) {
+		freeaddrinfo(result);
+		return false;
+	}
+
+	fcntl(sock, F_SETFL, O_NONBLOCK);
+
+	int rc = ::connect(sock, result->ai_addr, result->ai_addrlen);
+	freeaddrinfo(result);
+
+	if((rc != 0) && (errno == EINPROGRESS)) {
+		struct pollfd pfd = {sock, POLLOUT, 0};
+
+		if(poll(&pfd, 1, CONNECT_TIMEOUT_MS) == 1) {
+			int err = 0;
+			socklen_t errLen = sizeof(err);
+			getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errLen);
+			rc = err;
+		}
+	}
+
+	if(rc != 0) {
+		closeSocket();
+		return false;
+	}
+
+	//Batching is done here, so don't let Nagle add another delay
+	int one = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	resetFrames();
+
+	connects++;
+	isConnected = true;
+
+	return true;
+}
+
+void BridgeClient::closeSocket() {
+	if(sock >= 0) {
+		close(sock);
+		sock = -1;
+	}
+
+	if(isConnected) {
+		isConnected = false;
+		disconnects++;
+	}
+}
+
+void BridgeClient::resetFrames() {
+	headerLen = payloadLeft = creditLen = 0;
+	creditLimit = creditUsed = 0;
+
+	messagePayload.clear();
+	sendFrames.clear();
+	sendFramesPos = dataFrameLeft = 0;
+}
+
+//Data payloads go to the receive ring, credit frames raise the limit and
+//in mux mode frames of the other channels are queued as messages.
+//Frames of unknown channels are skipped.
+void BridgeClient::parseFrames(const uint8_t *data, size_t len) {
+	while(len > 0) {
+		if(payloadLeft == 0) {
+			frameHeader[headerLen++] = *data++;
+			len--;
+
+			if(headerLen == FRAME_HEADER_LEN) {
+				payloadLeft = (frameHeader[2] << 8) | frameHeader[3];
+				headerLen = creditLen = 0;
+				messagePayload.clear();
+
+				if(payloadLeft == 0)
+					endMessage();
+			}
+			continue;
+		}
+
+		size_t count = std::min(len, payloadLeft);
+
+		if(frameHeader[0] == FRAME_DATA) {
+			recvRing.put(data, count);
+		}
+		else if(frameHeader[0] == FRAME_CREDIT) {
+			for(size_t i = 0; i < count; ++i) {
+				if(creditLen < sizeof(creditValue))
+					creditValue[creditLen++] = data[i];
+			}
+
+			if((count == payloadLeft) && (creditLen == sizeof(creditValue))) {
+				creditLimit = (uint32_t(creditValue[0]) << 24) | (uint32_t(creditValue[1]) << 16)
+					| (uint32_t(creditValue[2]) << 8) | creditValue[3];
+			}
+		}
+		else if(options.mux) {
+			messagePayload.append(reinterpret_cast<const char*>(data), count);
+		}
+
+		data += count;
+		len -= count;
+		payloadLeft -= count;
+
+		if(payloadLeft == 0)
+			endMessage();
+	}
+}
+
+void BridgeClient::endMessage() {
+	if(!options.mux || (frameHeader[0] == FRAME_DATA) || (frameHeader[0] == FRAME_CREDIT))
+		return;
+
+	std::lock_guard<std::mutex> lock(messageMutex);
+
+	if(inMessages.size() >= MUX_MAX_MESSAGES)
+		inMessages.pop_front();
+
+	inMessages.push_back(Message{frameHeader[0], messagePayload});
+	messageCond.notify_all();
+}
+
+bool BridgeClient::messagesQueued() {
+	std::lock_guard<std::mutex> lock(messageMutex);
+
+	return !outMessages.empty();
+}
+
+//Mux mode send round. Between data frames the queued messages and the
+//header of the next data frame are lined up, the data frame taking what
+//is pending within the credit. Frame bytes and payload leave in one
+//sendmsg() so a header doesn't end up in a TCP segment of its own.
+bool BridgeClient::sendFramed(bool sendData, size_t credit) {
+	if((sendFramesPos == sendFrames.size()) && (dataFrameLeft == 0)) {
+		sendFrames.clear();
+		sendFramesPos = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(messageMutex);
+
+			while(!outMessages.empty()) {
+				sendFrames += outMessages.front();
+				outMessages.pop_front();
+			}
+		}
+
+		size_t len = std::min(std::min(sendRing.size(), credit), size_t(MUX_DATA_FRAME));
+		if(sendData && (len > 0)) {
+			sendFrames += static_cast<char>(FRAME_DATA);
+			sendFrames += '\0';
+			sendFrames += static_cast<char>(len >> 8);
+			sendFrames += static_cast<char>(len & 0xFF);
+
+			dataFrameLeft = len;
+		}
+	}
+
+	struct iovec iov[2];
+	int iovCount = 0;
+
+	if(sendFramesPos < sendFrames.size()) {
+		iov[iovCount].iov_base = &sendFrames[sendFramesPos];
+		iov[iovCount].iov_len = sendFrames.size() - sendFramesPos;
+		iovCount++;
+	}
+
+	if(dataFrameLeft > 0) {
+		size_t len;
+		const uint8_t *region = sendRing.readRegion(len);
+
+		iov[iovCount].iov_base = const_cast<uint8_t*>(region);
+		iov[iovCount].iov_len = std::min(len, dataFrameLeft);
+		iovCount++;
+	}
+
+	if(iovCount == 0)
+		return true;
+
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovCount;
+
+	ssize_t count = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	if(count < 0)
+		return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+
+	size_t framed = std::min(static_cast<size_t>(count), sendFrames.size() - sendFramesPos);
+	size_t payload = static_cast<size_t>(count) - framed;
+
+	sendFramesPos += framed;
+
+	sendRing.commitRead(payload);
+	dataFrameLeft -= payload;
+	bytesSent += payload;
+	creditUsed += static_cast<uint32_t>(payload);
+	sendCalls++;
+
+	return true;
+}
+
+void BridgeClient::ioThread() {
+	auto backoff = options.reconnectMin;
+
+	while(running) {
+		if(!isConnected) {
+			if(connectSocket()) {
+				backoff = options.reconnectMin;
+			}
+			else {
+				struct pollfd pfd = {wakePipe[0], POLLIN, 0};
+				poll(&pfd, 1, static_cast<int>(backoff.count()));
+
+				char drain[64];
+				while(::read(wakePipe[0], drain, sizeof(drain)) > 0);
+
+				backoff = std::min(backoff * 2, options.reconnectMax);
+				continue;
+			}
+		}
+
+		if(!service())
+			closeSocket();
+	}
+
+	closeSocket();
+}
+
+//One poll() round on a connected socket; returns false if the connection died
+bool BridgeClient::service() {
+	static const auto NO_PENDING = std::chrono::steady_clock::time_point::max();
+
+	auto now = std::chrono::steady_clock::now();
+	size_t pending = sendRing.size();
+
+	//Nothing may be sent past the bridge's last credit
+	size_t credit = options.credits ? static_cast<uint32_t>(creditLimit - creditUsed) : SIZE_MAX;
+
+	if(pending == 0)
+		pendingSince = NO_PENDING;
+	else if(pendingSince == NO_PENDING)
+		pendingSince = now;
+
+	//Hold small writes briefly so they leave in one segment
+	bool sendNow = (credit > 0) && ((pending >= options.coalesceBytes)
+		|| ((pending > 0) && (now - pendingSince >= options.coalesceDelay)));
+
+	//Messages go out right away, as does the rest of a started data frame
+	bool framesWaiting = options.mux && ((sendFramesPos < sendFrames.size())
+		|| (dataFrameLeft > 0) || messagesQueued());
+
+	int timeout = -1;
+	if((pending > 0) && !sendNow && (credit > 0)) {
+		auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+			pendingSince + options.coalesceDelay - now);
+		timeout = static_cast<int>(wait.count()) + 1;
+	}
+
+	struct pollfd fds[2];
+	fds[0].fd = sock;
+	fds[0].events = ((recvRing.space() > 0) ? POLLIN : 0) | ((sendNow || framesWaiting) ? POLLOUT : 0);
+	fds[0].revents = 0;
+	fds[1].fd = wakePipe[0];
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+
+	if(poll(fds, 2, timeout) < 0)
+		return (errno == EINTR);
+
+	if(fds[1].revents & POLLIN) {
+		char drain[64];
+		while(::read(wakePipe[0], drain, sizeof(drain)) > 0);
+	}
+
+	if(fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+		return false;
+
+	if((fds[0].revents & POLLIN) && (options.credits || options.mux)) {
+		//Payloads are never larger than what arrived, so limiting the read
+		//to the ring's space keeps every data byte
+		uint8_t raw[4096];
+
+		ssize_t count = recv(sock, raw, std::min(sizeof(raw), recvRing.space()), 0);
+		if(count == 0)
+			return false;
+		if(count < 0)
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+
+		parseFrames(raw, static_cast<size_t>(count));
+		bytesReceived += static_cast<uint64_t>(count);
+
+		std::lock_guard<std::mutex> lock(readMutex);
+		readCond.notify_all();
+	}
+	else if(fds[0].revents & POLLIN) {
+		size_t len;
+		uint8_t *region = recvRing.writeRegion(len);
+
+		ssize_t count = recv(sock, region, len, 0);
+		if(count == 0)
+			return false;
+		if(count < 0)
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+
+		recvRing.commitWrite(static_cast<size_t>(count));
+		bytesReceived += static_cast<uint64_t>(count);
+
+		std::lock_guard<std::mutex> lock(readMutex);
+		readCond.notify_all();
+	}
+
+	if((fds[0].revents & POLLOUT) && options.mux) {
+		return sendFramed(sendNow, credit);
+	}
+	else if(fds[0].revents & POLLOUT) {
+		size_t len;
+		const uint8_t *region = sendRing.readRegion(len);
+
+		ssize_t count = send(sock, region, std::min(len, credit), MSG_NOSIGNAL);
+		if(count < 0)
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+
+		sendRing.commitRead(static_cast<size_t>(count));
+		bytesSent += static_cast<uint64_t>(count);
+		creditUsed += static_cast<uint32_t>(count);
+		sendCalls++;
+	}
+
+	return true;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "SpscRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//Asynchronous client for the CPRE288 WiFi bridge (TCP port 288).
+//
+//A dedicated I/O thread owns the socket. Received bytes are handed to
+//the application through a lock-free ring, so a stalled GUI thread
+//only closes the TCP window instead of losing data. Writes are queued
+//and coalesced into as few send() calls as possible. The connection is
+//re-established automatically with exponential backoff; bytes queued
+//while disconnected are sent once the link is back.
+//
+//read() must only be called from one thread, and write() from one
+//(possibly different) thread. In mux mode, messages on the bridge's
+//other channels can be exchanged from any thread.
+class BridgeClient {
+public:
+	//Default size of both rings
+	static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+	static_assert(SpscRing::isPowerOfTwo(DEFAULT_CAPACITY), "Ring capacity must be a power of two");
+
+	struct Options {
+		std::string host = "192.168.1.1";
+		uint16_t port = 288;
+
+		//Rounded up to a power of two
+		size_t recvCapacity = DEFAULT_CAPACITY;
+		size_t sendCapacity = DEFAULT_CAPACITY;
+
+		std::chrono::milliseconds reconnectMin{100};
+		std::chrono::milliseconds reconnectMax{2000};
+
+		//Writes smaller than this are held for up to coalesceDelay
+		size_t coalesceBytes = 1460;
+		std::chrono::microseconds coalesceDelay{500};
+
+		//The bridge runs with 'credit 1': received data arrives in frames
+		//and sends are held to the credits the bridge grants
+		bool credits = false;
+
+		//The bridge runs with 'mux 1': data is framed both ways and the
+		//control, stats and log channels are available
+		bool mux = false;
+	};
+
+	//Mux mode channels next to the data, see include/user_frame.h in
+	//the firmware
+	enum Channel : uint8_t {
+		CHANNEL_CONTROL = 2,
+		CHANNEL_STATS = 3,
+		CHANNEL_LOG = 4,
+		CHANNEL_CAPTURE = 5
+	};
+
+	struct Message {
+		uint8_t channel;
+		std::string payload;
+	};
+
+	struct Stats {
+		uint64_t bytesReceived;
+		uint64_t bytesSent;
+		uint64_t sendCalls;
+		uint64_t connects;
+		uint64_t disconnects;
+	};
+
+	explicit BridgeClient(const Options &options);
+	~BridgeClient();
+
+	BridgeClient(const BridgeClient&) = delete;
+	BridgeClient& operator=(const BridgeClient&) = delete;
+
+	void start();
+	void stop();
+
+	bool connected() const;
+
+	//Non-blocking, returns number of bytes transferred
+	size_t read(void *out, size_t len);
+	size_t write(const void *data, size_t len);
+
+	//Wait until data is readable; returns false on timeout
+	bool waitReadable(std::chrono::milliseconds timeout);
+
+	//Wait until all queued writes have been handed to the socket
+	bool flush(std::chrono::milliseconds timeout);
+
+	//Mux mode only. Queues a frame for 'channel', sent ahead of any data
+	//that isn't framed yet. Returns false when not in mux mode.
+	bool sendMessage(uint8_t channel, const std::string &payload);
+
+	//Next complete control, stats or log frame from the bridge; returns
+	//false on timeout
+	bool receiveMessage(Message &out, std::chrono::milliseconds timeout);
+
+	Stats stats() const;
+
+private:
+	void ioThread();
+	bool connectSocket();
+	void closeSocket();
+	bool service();
+	void wake();
+	void resetFrames();
+	void parseFrames(const uint8_t *data, size_t len);
+	void endMessage();
+	bool messagesQueued();
+	bool sendFramed(bool sendData, size_t credit);
+
+	Options options;
+
+	SpscRing recvRing, sendRing;
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<bool> isConnected;
+
+	int sock;
+	int wakePipe[2];
+
+	std::mutex readMutex;
+	std::condition_variable readCond;
+
+	std::atomic<uint64_t> bytesReceived, bytesSent, sendCalls, connects, disconnects;
+
+	//Time the oldest unsent byte was queued (I/O thread only)
+	std::chrono::steady_clock::time_point pendingSince;
+
+	//Credit mode state (I/O thread only). The counts are the bridge's
+	//32 bit totals for the connection.
+	uint8_t frameHeader[4], creditValue[4];
+	size_t headerLen, payloadLeft, creditLen;
+	uint32_t creditLimit, creditUsed;
+
+	//Mux mode. Frames from sendMessage wait in outMessages until the I/O
+	//thread moves them to sendFrames, between two data frames.
+	std::mutex messageMutex;
+	std::condition_variable messageCond;
+	std::deque<std::string> outMessages;
+	std::deque<Message> inMessages;
+
+	//I/O thread only: the message being received, frame bytes not yet
+	//sent and the payload the current data frame still owes
+	std::string messagePayload;
+	std::string sendFrames;
+	size_t sendFramesPos, dataFrameLeft;
+};
@@ -0,0 +1,531 @@
+#include "BridgeDiscovery.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define DNS_HEADER_LEN	12
+#define DNS_FLAG_RESPONSE	0x8400	//QR | AA
+
+#define DNS_TYPE_A		1
+#define DNS_TYPE_PTR	12
+#define DNS_TYPE_TXT	16
+#define DNS_TYPE_SRV	33
+#define DNS_TYPE_ANY	255
+
+#define DNS_CLASS_IN	1
+#define DNS_CACHE_FLUSH	0x8000
+
+#define DNS_TTL		120
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Record {
+	std::string name;
+	uint16_t type;
+	const uint8_t *data;
+	size_t offset;		//Of the record data within the message
+	uint16_t len;
+};
+
+bool sameName(const std::string &a, const std::string &b) {
+	return (a.size() == b.size()) && std::equal(a.begin(), a.end(), b.begin(),
+		[](char x, char y) { return std::tolower(x) == std::tolower(y); });
+}
+
+void put16(std::vector<uint8_t> &msg, uint16_t value) {
+	msg.push_back(value >> 8);
+	msg.push_back(value & 0xFF);
+}
+
+void put32(std::vector<uint8_t> &msg, uint32_t value) {
+	put16(msg, value >> 16);
+	put16(msg, value & 0xFFFF);
+}
+
+uint16_t get16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+void putName(std::vector<uint8_t> &msg, const std::string &name) {
+	size_t start = 0;
+
+	while(start < name.size()) {
+		size_t end = name.find('.', start);
+		if(end == std::string::npos)
+			end = name.size();
+
+		msg.push_back(static_cast<uint8_t>(end - start));
+		msg.insert(msg.end(), name.begin() + start, name.begin() + end);
+
+		start = end + 1;
+	}
+
+	msg.push_back(0);
+}
+
+//Reads a possibly compressed name, 'offset' ends up past it
+bool getName(const uint8_t *msg, size_t len, size_t &offset, std::string &name) {
+	size_t pos = offset;
+	bool jumped = false;
+	int jumps = 0;
+
+	name.clear();
+
+	while(pos < len) {
+		uint8_t label = msg[pos];
+
+		if(label == 0) {
+			if(!jumped)
+				offset = pos + 1;
+			return true;
+		}
+
+		if((label & 0xC0) == 0xC0) {
+			if((pos + 1 >= len) || (++jumps > 16))
+				return false;
+
+			if(!jumped)
+				offset = pos + 2;
+			jumped = true;
+
+			pos = ((label & 0x3F) << 8) | msg[pos + 1];
+			continue;
+		}
+
+		if(pos + 1 + label > len)
+			return false;
+
+		if(!name.empty())
+			name += '.';
+		name.append(reinterpret_cast<const char*>(msg + pos + 1), label);
+
+		pos += 1 + label;
+	}
+
+	return false;
+}
+
+//Splits a message into its questions and resource records
+bool parse(const uint8_t *msg, size_t len, bool &response,
+		std::vector<Record> &questions, std::vector<Record> &records) {
+	if(len < DNS_HEADER_LEN)
+		return false;
+
+	response = (get16(msg + 2) & 0x8000) != 0;
+
+	uint16_t qd = get16(msg + 4);
+	uint16_t rr = get16(msg + 6) + get16(msg + 8) + get16(msg + 10);
+
+	size_t offset = DNS_HEADER_LEN;
+
+	for(uint16_t i = 0; i < qd; ++i) {
+		Record q;
+
+		if(!getName(msg, len, offset, q.name) || (offset + 4 > len))
+			return false;
+
+		q.type = get16(msg + offset);
+		q.data = nullptr;
+		q.offset = offset;
+		q.len = 0;
+		offset += 4;
+
+		questions.push_back(q);
+	}
+
+	for(uint16_t i = 0; i < rr; ++i) {
+		Record r;
+
+		if(!getName(msg, len, offset, r.name) || (offset + 10 > len))
+			return false;
+
+		r.type = get16(msg + offset);
+		r.len = get16(msg + offset + 8);
+		offset += 10;
+
+		if(offset + r.len > len)
+			return false;
+
+		r.data = msg + offset;
+		r.offset = offset;
+		offset += r.len;
+
+		records.push_back(r);
+	}
+
+	return true;
+}
+
+int openSocket(const DiscoveryOptions &options) {
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock < 0)
+		return -1;
+
+	int one = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+	setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+
+	sockaddr_in local = {};
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(options.port);
+
+	ip_mreq membership = {};
+	membership.imr_multiaddr.s_addr = inet_addr(options.group.c_str());
+	membership.imr_interface.s_addr = htonl(INADDR_ANY);
+
+	unsigned char ttl = 255, loop = 1;
+
+	if((bind(sock, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0)
+		|| (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0)) {
+		close(sock);
+		return -1;
+	}
+
+	setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+	setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+	return sock;
+}
+
+sockaddr_in groupAddress(const DiscoveryOptions &options) {
+	sockaddr_in group = {};
+	group.sin_family = AF_INET;
+	group.sin_addr.s_addr = inet_addr(options.group.c_str());
+	group.sin_port = htons(options.port);
+
+	return group;
+}
+
+//Waits for one datagram until 'deadline', returns its length or -1
+ssize_t receive(int sock, uint8_t *buffer, size_t size, Clock::time_point deadline,
+		sockaddr_in *from) {
+	auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+	if(remaining.count() <= 0)
+		return -1;
+
+	pollfd pfd = { sock, POLLIN, 0 };
+	if(poll(&pfd, 1, static_cast<int>(remaining.count())) <= 0)
+		return 0;
+
+	socklen_t fromLen = sizeof(*from);
+	return recvfrom(sock, buffer, size, 0, reinterpret_cast<sockaddr*>(from), &fromLen);
+}
+
+//"key=value" lines of a control reply, by default the ones following its "ok"
+void parseFields(const std::string &reply, std::map<std::string, std::string> &fields, size_t pos = 3) {
+	while(pos < reply.size()) {
+		size_t end = reply.find('\n', pos);
+		if(end == std::string::npos)
+			end = reply.size();
+
+		size_t eq = reply.find('=', pos);
+		if((eq != std::string::npos) && (eq < end))
+			fields[reply.substr(pos, eq - pos)] = reply.substr(eq + 1, end - eq - 1);
+
+		pos = end + 1;
+	}
+}
+
+} //namespace
+
+std::vector<BridgeProbe> probeBridges(const ProbeOptions &options) {
+	std::vector<BridgeProbe> found;
+
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock < 0)
+		return found;
+
+	int one = 1;
+	setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+
+	sockaddr_in target = {};
+	target.sin_family = AF_INET;
+	target.sin_addr.s_addr = inet_addr(options.broadcast.c_str());
+	target.sin_port = htons(options.port);
+
+	static const char PROBE[] = "discover\n";
+
+	auto start = Clock::now();
+	sendto(sock, PROBE, sizeof(PROBE) - 1, 0, reinterpret_cast<sockaddr*>(&target), sizeof(target));
+
+	auto deadline = start + options.timeout;
+	uint8_t buffer[1500];
+	sockaddr_in from;
+	ssize_t len;
+
+	while((len = receive(sock, buffer, sizeof(buffer), deadline, &from)) >= 0) {
+		if(len == 0)
+			continue;
+
+		std::string reply(reinterpret_cast<char*>(buffer), len);
+		if(reply.compare(0, 3, "ok\n") != 0)
+			continue;
+
+		BridgeProbe probe;
+		char text[INET_ADDRSTRLEN];
+
+		inet_ntop(AF_INET, &from.sin_addr, text, sizeof(text));
+		probe.address = text;
+		probe.rtt = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+
+		parseFields(reply, probe.fields);
+
+		found.push_back(probe);
+	}
+
+	close(sock);
+
+	return found;
+}
+
+bool controlCommand(const std::string &address, const std::string &command,
+		const ProbeOptions &options, std::string &reply) {
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock < 0)
+		return false;
+
+	sockaddr_in target = {};
+	target.sin_family = AF_INET;
+	target.sin_addr.s_addr = inet_addr(address.c_str());
+	target.sin_port = htons(options.port);
+
+	std::string line = command + "\n";
+	sendto(sock, line.data(), line.size(), 0, reinterpret_cast<sockaddr*>(&target), sizeof(target));
+
+	auto deadline = Clock::now() + options.timeout;
+	uint8_t buffer[1500];
+	sockaddr_in from;
+	ssize_t len;
+	bool ok = false;
+
+	//Skip anything that isn't from the bridge that was asked
+	while((len = receive(sock, buffer, sizeof(buffer), deadline, &from)) >= 0) {
+		if((len == 0) || (from.sin_addr.s_addr != target.sin_addr.s_addr))
+			continue;
+
+		std::string text(reinterpret_cast<char*>(buffer), len);
+		ok = (text.compare(0, 3, "ok\n") == 0);
+		if(ok)
+			reply = text.substr(3);
+
+		break;
+	}
+
+	close(sock);
+
+	return ok;
+}
+
+bool controlCommand(const std::string &address, const std::string &command,
+		const ProbeOptions &options, std::map<std::string, std::string> &fields) {
+	std::string reply;
+
+	if(!controlCommand(address, command, options, reply))
+		return false;
+
+	parseFields(reply, fields, 0);
+
+	return true;
+}
+
+std::vector<BridgeService> discoverBridges(const DiscoveryOptions &options) {
+	std::vector<BridgeService> found;
+
+	int sock = openSocket(options);
+	if(sock < 0)
+		return found;
+
+	std::vector<uint8_t> query;
+	put16(query, 0);	//ID
+	put16(query, 0);	//Standard query
+	put16(query, 1);
+	put16(query, 0);
+	put16(query, 0);
+	put16(query, 0);
+	putName(query, options.service);
+	put16(query, DNS_TYPE_PTR);
+	put16(query, DNS_CLASS_IN);
+
+	sockaddr_in group = groupAddress(options);
+	sendto(sock, query.data(), query.size(), 0, reinterpret_cast<sockaddr*>(&group), sizeof(group));
+
+	//Answers may be split across packets, so join them up at the end
+	std::vector<std::string> instances;
+	std::map<std::string, std::pair<uint16_t, std::string>> srv;
+	std::map<std::string, std::string> addresses;
+
+	auto deadline = Clock::now() + options.timeout;
+	uint8_t buffer[1500];
+	sockaddr_in from;
+	ssize_t len;
+
+	while((len = receive(sock, buffer, sizeof(buffer), deadline, &from)) >= 0) {
+		std::vector<Record> questions, records;
+		bool response;
+
+		if((len == 0) || !parse(buffer, len, response, questions, records) || !response)
+			continue;
+
+		for(const Record &r : records) {
+			std::string name;
+			size_t offset = r.offset;
+
+			if((r.type == DNS_TYPE_PTR) && sameName(r.name, options.service)) {
+				if(getName(buffer, len, offset, name)
+					&& (std::find(instances.begin(), instances.end(), name) == instances.end()))
+					instances.push_back(name);
+			}
+			else if((r.type == DNS_TYPE_SRV) && (r.len > 6)) {
+				offset += 6;
+				if(getName(buffer, len, offset, name))
+					srv[r.name] = std::make_pair(get16(r.data + 4), name);
+			}
+			else if((r.type == DNS_TYPE_A) && (r.len == 4)) {
+				char text[INET_ADDRSTRLEN];
+				inet_ntop(AF_INET, r.data, text, sizeof(text));
+				addresses[r.name] = text;
+			}
+		}
+	}
+
+	close(sock);
+
+	for(const std::string &instance : instances) {
+		BridgeService service;
+
+		service.instance = instance.substr(0, instance.find('.'));
+		service.port = 0;
+
+		auto s = srv.find(instance);
+		if(s != srv.end()) {
+			service.port = s->second.first;
+			service.host = s->second.second;
+
+			auto a = addresses.find(service.host);
+			if(a != addresses.end())
+				service.address = a->second;
+		}
+
+		found.push_back(service);
+	}
+
+	return found;
+}
+
+StandInResponder::StandInResponder(const DiscoveryOptions &_options,
+		const std::string &_instance, const std::string &_address, uint16_t _port)
+	:	options(_options)
+	,	instance(_instance)
+	,	address(_address)
+	,	port(_port)
+	,	sock(-1) {
+}
+
+StandInResponder::~StandInResponder() {
+	if(sock >= 0)
+		close(sock);
+}
+
+bool StandInResponder::open() {
+	sock = openSocket(options);
+
+	return sock >= 0;
+}
+
+int StandInResponder::serve(std::chrono::milliseconds duration) {
+	std::string fullName = instance + "." + options.service;
+	std::string host = instance + ".local";
+
+	//Same records the SDK responder sends: PTR, SRV, TXT and A
+	std::vector<uint8_t> answer;
+	put16(answer, 0);
+	put16(answer, DNS_FLAG_RESPONSE);
+	put16(answer, 0);
+	put16(answer, 4);
+	put16(answer, 0);
+	put16(answer, 0);
+
+	putName(answer, options.service);
+	put16(answer, DNS_TYPE_PTR);
+	put16(answer, DNS_CLASS_IN);
+	put32(answer, DNS_TTL);
+	put16(answer, static_cast<uint16_t>(fullName.size() + 2));
+	putName(answer, fullName);
+
+	putName(answer, fullName);
+	put16(answer, DNS_TYPE_SRV);
+	put16(answer, DNS_CLASS_IN | DNS_CACHE_FLUSH);
+	put32(answer, DNS_TTL);
+	put16(answer, static_cast<uint16_t>(6 + host.size() + 2));
+	put16(answer, 0);	//Priority
+	put16(answer, 0);	//Weight
+	put16(answer, port);
+	putName(answer, host);
+
+	const std::string txt = "proto=raw";
+	putName(answer, fullName);
+	put16(answer, DNS_TYPE_TXT);
+	put16(answer, DNS_CLASS_IN | DNS_CACHE_FLUSH);
+	put32(answer, DNS_TTL);
+	put16(answer, static_cast<uint16_t>(txt.size() + 1));
+	answer.push_back(static_cast<uint8_t>(txt.size()));
+	answer.insert(answer.end(), txt.begin(), txt.end());
+
+	in_addr ip;
+	inet_pton(AF_INET, address.c_str(), &ip);
+	putName(answer, host);
+	put16(answer, DNS_TYPE_A);
+	put16(answer, DNS_CLASS_IN | DNS_CACHE_FLUSH);
+	put32(answer, DNS_TTL);
+	put16(answer, 4);
+	const uint8_t *ipBytes = reinterpret_cast<const uint8_t*>(&ip.s_addr);
+	answer.insert(answer.end(), ipBytes, ipBytes + 4);
+
+	sockaddr_in group = groupAddress(options);
+
+	auto deadline = Clock::now() + duration;
+	uint8_t buffer[1500];
+	sockaddr_in from;
+	ssize_t len;
+	int answered = 0;
+
+	while((len = receive(sock, buffer, sizeof(buffer), deadline, &from)) >= 0) {
+		std::vector<Record> questions, records;
+		bool response;
+
+		if((len == 0) || !parse(buffer, len, response, questions, records) || response)
+			continue;
+
+		bool match = false;
+		for(const Record &q : questions) {
+			if(((q.type == DNS_TYPE_PTR) || (q.type == DNS_TYPE_ANY))
+				&& (sameName(q.name, options.service) || sameName(q.name, fullName)))
+				match = true;
+		}
+
+		if(!match)
+			continue;
+
+		sendto(sock, answer.data(), answer.size(), 0, reinterpret_cast<sockaddr*>(&group), sizeof(group));
+
+		//Legacy unicast queries from other ports are answered directly
+		if(from.sin_port != group.sin_port)
+			sendto(sock, answer.data(), answer.size(), 0, reinterpret_cast<sockaddr*>(&from), sizeof(from));
+
+		answered++;
+	}
+
+	return answered;
+}
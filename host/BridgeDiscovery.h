@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+//Finding bridges without hardcoding 192.168.1.1:288.
+//
+//probeBridges() is the quick path: one broadcast 'discover' on the
+//control port is answered by every bridge in reach, AP or station mode,
+//with its ID, TCP port, build and current load.
+//
+//Bridges joined to a lab network also advertise themselves as
+//cybot-N._cpre288._tcp.local. discoverBridges() sends one PTR query for
+//the service and collects every answer that arrives before the timeout.
+//
+//StandInResponder answers those queries the way the firmware does, so
+//discovery can be exercised on a single machine. Pointing both at a
+//non-standard port keeps them clear of the system's own mDNS daemon.
+
+struct ProbeOptions {
+	std::string broadcast = "255.255.255.255";
+	uint16_t port = 289;
+
+	std::chrono::milliseconds timeout{500};
+};
+
+struct BridgeProbe {
+	std::string address;
+	std::chrono::microseconds rtt;
+
+	//"id", "port", "build", "wifi", "clients", "stations", "governor",
+	//"segments", "uart_rx", "tcp_rx"
+	std::map<std::string, std::string> fields;
+};
+
+std::vector<BridgeProbe> probeBridges(const ProbeOptions &options);
+
+//Sends one control command, e.g. "test echo", to the bridge at 'address'
+//and collects the fields of its reply. Returns false if the bridge
+//answered with an error or not at all.
+bool controlCommand(const std::string &address, const std::string &command,
+	const ProbeOptions &options, std::map<std::string, std::string> &fields);
+
+//Same, but hands back the reply text after "ok\n" as it came, for
+//replies such as 'trace' that repeat keys or aren't key=value at all
+bool controlCommand(const std::string &address, const std::string &command,
+	const ProbeOptions &options, std::string &reply);
+
+struct DiscoveryOptions {
+	std::string group = "224.0.0.251";
+	uint16_t port = 5353;
+	std::string service = "_cpre288._tcp.local";
+
+	std::chrono::milliseconds timeout{2000};
+};
+
+struct BridgeService {
+	std::string instance;	//"cybot-3"
+	std::string host;		//"cybot-3.local"
+	std::string address;	//Dotted IPv4, empty if no A record was seen
+	uint16_t port;
+};
+
+std::vector<BridgeService> discoverBridges(const DiscoveryOptions &options);
+
+class StandInResponder {
+public:
+	StandInResponder(const DiscoveryOptions &options, const std::string &instance,
+		const std::string &address, uint16_t port);
+	~StandInResponder();
+
+	StandInResponder(const StandInResponder&) = delete;
+	StandInResponder& operator=(const StandInResponder&) = delete;
+
+	bool open();
+
+	//Answer queries until the timeout passes, returns the number answered
+	int serve(std::chrono::milliseconds duration);
+
+private:
+	DiscoveryOptions options;
+	std::string instance, address;
+	uint16_t port;
+
+	int sock;
+};
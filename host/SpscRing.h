@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//Lock-free single-producer/single-consumer byte ring.
+//Positions are masked, so the capacity is rounded up to a power of two.
+//One thread may write and one other thread may read without any further
+//synchronization.
+class SpscRing {
+public:
+	explicit SpscRing(size_t capacity)
+		:	buffer(roundUp(capacity))
+		,	mask(buffer.size() - 1)
+		,	head(0)
+		,	tail(0) {
+	}
+
+	static constexpr bool isPowerOfTwo(size_t n) {
+		return (n != 0) && ((n & (n - 1)) == 0);
+	}
+
+	static constexpr size_t roundUp(size_t n) {
+		size_t capacity = 1;
+		while(capacity < n)
+			capacity <<= 1;
+
+		return capacity;
+	}
+
+	size_t capacity() const {
+		return buffer.size();
+	}
+
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	size_t space() const {
+		return buffer.size() - size();
+	}
+
+	//Producer side
+	size_t put(const uint8_t *data, size_t len) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t avail = buffer.size() - (t - head.load(std::memory_order_acquire));
+		if(len > avail)
+			len = avail;
+
+		copyIn(t, data, len);
+		tail.store(t + len, std::memory_order_release);
+
+		return len;
+	}
+
+	//Producer side: contiguous free region for zero-copy fills (e.g. recv())
+	uint8_t* writeRegion(size_t &len) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t avail = buffer.size() - (t - head.load(std::memory_order_acquire));
+		size_t offset = t & mask;
+
+		len = buffer.size() - offset;
+		if(len > avail)
+			len = avail;
+
+		return buffer.data() + offset;
+	}
+
+	void commitWrite(size_t len) {
+		tail.store(tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+	}
+
+	//Consumer side
+	size_t get(uint8_t *out, size_t len) {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t avail = tail.load(std::memory_order_acquire) - h;
+		if(len > avail)
+			len = avail;
+
+		copyOut(h, out, len);
+		head.store(h + len, std::memory_order_release);
+
+		return len;
+	}
+
+	//Consumer side: contiguous filled region for zero-copy drains (e.g. send())
+	const uint8_t* readRegion(size_t &len) const {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t avail = tail.load(std::memory_order_acquire) - h;
+		size_t offset = h & mask;
+
+		len = buffer.size() - offset;
+		if(len > avail)
+			len = avail;
+
+		return buffer.data() + offset;
+	}
+
+	void commitRead(size_t len) {
+		head.store(head.load(std::memory_order_relaxed) + len, std::memory_order_release);
+	}
+
+	//Only safe while neither side is active
+	void clear() {
+		head.store(0);
+		tail.store(0);
+	}
+
+private:
+	void copyIn(size_t pos, const uint8_t *data, size_t len) {
+		size_t offset = pos & mask;
+		size_t first = buffer.size() - offset;
+		if(first > len)
+			first = len;
+
+		std::memcpy(buffer.data() + offset, data, first);
+		std::memcpy(buffer.data(), data + first, len - first);
+	}
+
+	void copyOut(size_t pos, uint8_t *out, size_t len) const {
+		size_t offset = pos & mask;
+		size_t first = buffer.size() - offset;
+		if(first > len)
+			first = len;
+
+		std::memcpy(out, buffer.data() + offset, first);
+		std::memcpy(out + first, buffer.data(), len - first);
+	}
+
+	std::vector<uint8_t> buffer;
+	const size_t mask;
+
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+};
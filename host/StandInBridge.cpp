@@ -0,0 +1,394 @@
+#include "StandInBridge.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//Frame layout, see include/user_frame.h in the firmware
+#define FRAME_HEADER_LEN	4
+#define FRAME_DATA		0
+#define FRAME_CREDIT	1
+#define FRAME_MAX_MESSAGE	128
+
+//The firmware frames at most one TCP segment of UART data at a time
+#define DATA_FRAME_LEN	1460
+
+StandInBridge::StandInBridge(const Options &_options)
+	:	options(_options)
+	,	running(false)
+	,	listenSock(-1)
+	,	clientSock(-1)
+	,	boundPort(0)
+	,	dropRequested(false)
+	,	counters()
+	,	headerLen(0)
+	,	payloadLeft(0)
+	,	recvTotal(0)
+	,	creditLimit(0) {
+
+	wakePipe[0] = wakePipe[1] = -1;
+}
+
+StandInBridge::~StandInBridge() {
+	stop();
+}
+
+bool StandInBridge::start() {
+	if(running)
+		return true;
+
+	listenSock = socket(AF_INET, SOCK_STREAM, 0);
+	if(listenSock < 0)
+		return false;
+
+	int one = 1;
+	setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(options.port);
+
+	socklen_t addrLen = sizeof(addr);
+	if((bind(listenSock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+		|| (listen(listenSock, 1) != 0)
+		|| (getsockname(listenSock, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0)
+		|| (pipe(wakePipe) != 0)) {
+		close(listenSock);
+		listenSock = -1;
+		return false;
+	}
+
+	boundPort = ntohs(addr.sin_port);
+
+	fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+	running = true;
+	thread = std::thread(&StandInBridge::ioThread, this);
+
+	return true;
+}
+
+void StandInBridge::stop() {
+	if(!running)
+		return;
+
+	running = false;
+	wake();
+	thread.join();
+
+	closeClient(false);
+
+	close(listenSock);
+	close(wakePipe[0]);
+	close(wakePipe[1]);
+	listenSock = wakePipe[0] = wakePipe[1] = -1;
+}
+
+uint16_t StandInBridge::port() const {
+	return boundPort;
+}
+
+bool StandInBridge::waitClient(bool connected, std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	return cond.wait_for(lock, timeout, [this, connected]() {
+		return (clientSock >= 0) == connected;
+	});
+}
+
+void StandInBridge::send(const std::string &data) {
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data.data());
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if(!options.credits && !options.mux) {
+			outBuffer += data;
+		}
+		else {
+			for(size_t pos = 0; pos < data.size(); pos += DATA_FRAME_LEN)
+				queueFrame(FRAME_DATA, bytes + pos, std::min(data.size() - pos, size_t(DATA_FRAME_LEN)));
+		}
+	}
+
+	wake();
+}
+
+void StandInBridge::sendMessage(uint8_t channel, const std::string &payload) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		queueFrame(channel, reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+	}
+
+	wake();
+}
+
+void StandInBridge::dropClient() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if(clientSock < 0)
+		return;
+
+	dropRequested = true;
+	wake();
+
+	cond.wait(lock, [this]() { return !dropRequested; });
+}
+
+std::string StandInBridge::receive(size_t len, std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	cond.wait_for(lock, timeout, [this, len]() { return inData.size() >= len; });
+
+	std::string out = inData.substr(0, len);
+	inData.erase(0, out.size());
+
+	return out;
+}
+
+bool StandInBridge::receiveMessage(BridgeClient::Message &out, std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if(!cond.wait_for(lock, timeout, [this]() { return !inMessages.empty(); }))
+		return false;
+
+	out = inMessages.front();
+	inMessages.pop_front();
+
+	return true;
+}
+
+StandInBridge::Stats StandInBridge::stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return counters;
+}
+
+void StandInBridge::wake() {
+	if(wakePipe[1] >= 0) {
+		char c = 0;
+		ssize_t ignored = ::write(wakePipe[1], &c, 1);
+		(void)ignored;
+	}
+}
+
+//Caller holds the mutex
+void StandInBridge::queueFrame(uint8_t channel, const uint8_t *data, size_t len) {
+	outBuffer += static_cast<char>(channel);
+	outBuffer += '\0';
+	outBuffer += static_cast<char>(len >> 8);
+	outBuffer += static_cast<char>(len & 0xFF);
+	outBuffer.append(reinterpret_cast<const char*>(data), len);
+}
+
+void StandInBridge::acceptClient() {
+	int sock = accept(listenSock, nullptr, nullptr);
+	if(sock < 0)
+		return;
+
+	fcntl(sock, F_SETFL, O_NONBLOCK);
+
+	headerLen = payloadLeft = 0;
+	framePayload.clear();
+	recvTotal = 0;
+	creditLimit = 0;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	clientSock = sock;
+	outBuffer.clear();
+	counters.accepts++;
+
+	//The client may not send before its first credits
+	if(options.credits) {
+		creditLimit = options.creditWindow;
+
+		uint8_t credit[4] = {
+			uint8_t(creditLimit >> 24), uint8_t(creditLimit >> 16), uint8_t(creditLimit >> 8), uint8_t(creditLimit)
+		};
+		queueFrame(FRAME_CREDIT, credit, sizeof(credit));
+		counters.creditFrames++;
+	}
+
+	cond.notify_all();
+}
+
+void StandInBridge::closeClient(bool byClient) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if(clientSock < 0)
+		return;
+
+	close(clientSock);
+	clientSock = -1;
+	dropRequested = false;
+
+	if(byClient)
+		counters.clientCloses++;
+
+	cond.notify_all();
+}
+
+//Client data, with new credits once half the window has been used
+void StandInBridge::received(const uint8_t *data, size_t len) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	inData.append(reinterpret_cast<const char*>(data), len);
+	recvTotal += static_cast<uint32_t>(len);
+
+	if(options.credits) {
+		if(static_cast<int32_t>(recvTotal - creditLimit) > 0)
+			counters.creditViolations += recvTotal - creditLimit;
+
+		uint32_t limit = recvTotal + options.creditWindow;
+		if(limit - creditLimit >= options.creditWindow / 2) {
+			uint8_t credit[4] = { uint8_t(limit >> 24), uint8_t(limit >> 16), uint8_t(limit >> 8), uint8_t(limit) };
+
+			queueFrame(FRAME_CREDIT, credit, sizeof(credit));
+			creditLimit = limit;
+			counters.creditFrames++;
+		}
+	}
+
+	cond.notify_all();
+}
+
+//Mux mode, client data goes to received(), other channels to inMessages
+void StandInBridge::parseFrames(const uint8_t *data, size_t len) {
+	while(len > 0) {
+		if(payloadLeft == 0) {
+			frameHeader[headerLen++] = *data++;
+			len--;
+
+			if(headerLen < FRAME_HEADER_LEN)
+				continue;
+
+			headerLen = 0;
+			payloadLeft = (frameHeader[2] << 8) | frameHeader[3];
+			framePayload.clear();
+
+			if((frameHeader[1] != 0) || (frameHeader[0] == FRAME_CREDIT)
+				|| ((frameHeader[0] != FRAME_DATA) && (payloadLeft > FRAME_MAX_MESSAGE))) {
+				std::lock_guard<std::mutex> lock(mutex);
+				counters.badFrames++;
+			}
+		}
+		else {
+			size_t count = std::min(len, payloadLeft);
+
+			if(frameHeader[0] == FRAME_DATA)
+				received(data, count);
+			else
+				framePayload.append(reinterpret_cast<const char*>(data), count);
+
+			data += count;
+			len -= count;
+			payloadLeft -= count;
+		}
+
+		if((payloadLeft == 0) && (headerLen == 0))
+			endFrame();
+	}
+}
+
+void StandInBridge::endFrame() {
+	if(frameHeader[0] == FRAME_DATA)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	inMessages.push_back(BridgeClient::Message{frameHeader[0], framePayload});
+	cond.notify_all();
+}
+
+void StandInBridge::ioThread() {
+	while(running) {
+		if(!service())
+			closeClient(true);
+	}
+}
+
+//One poll() round, returns false if the client went away
+bool StandInBridge::service() {
+	bool sending, drop;
+	int sock;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		sock = clientSock;
+		sending = !outBuffer.empty();
+		drop = dropRequested;
+	}
+
+	if(drop) {
+		closeClient(false);
+		return true;
+	}
+
+	struct pollfd fds[2];
+	fds[0].fd = (sock >= 0) ? sock : listenSock;
+	fds[0].events = POLLIN | ((sending && (sock >= 0)) ? POLLOUT : 0);
+	fds[0].revents = 0;
+	fds[1].fd = wakePipe[0];
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+
+	if(poll(fds, 2, -1) < 0)
+		return (errno == EINTR);
+
+	if(fds[1].revents & POLLIN) {
+		char drain[64];
+		while(::read(wakePipe[0], drain, sizeof(drain)) > 0);
+	}
+
+	if(sock < 0) {
+		if(fds[0].revents & POLLIN)
+			acceptClient();
+		return true;
+	}
+
+	if(fds[0].revents & POLLIN) {
+		uint8_t buffer[4096];
+
+		ssize_t count = recv(sock, buffer, sizeof(buffer), 0);
+		if(count == 0)
+			return false;
+		if(count < 0)
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+
+		//Credit mode alone has the client send raw data
+		if(options.mux)
+			parseFrames(buffer, static_cast<size_t>(count));
+		else
+			received(buffer, static_cast<size_t>(count));
+	}
+	else if(fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+		return false;
+	}
+
+	if(fds[0].revents & POLLOUT) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		ssize_t count = ::send(sock, outBuffer.data(), outBuffer.size(), MSG_NOSIGNAL);
+		if(count < 0)
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+
+		outBuffer.erase(0, static_cast<size_t>(count));
+	}
+
+	return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "BridgeClient.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//Plays the bridge's end of the TCP connection on the loopback interface,
+//so BridgeClient and the tools can be exercised without hardware.
+//
+//It takes one client at a time, like the firmware. In credit mode it
+//frames everything it sends and grants credits as client data arrives,
+//counting any byte that goes past them. In mux mode it also reads the
+//client's frames and exchanges messages on the other channels. Channel
+//numbers and framing follow include/user_frame.h in the firmware.
+class StandInBridge {
+public:
+	struct Options {
+		uint16_t port = 0;		//0: any free port, see port()
+
+		bool credits = false;
+		bool mux = false;
+
+		//Client data the bridge takes ahead of what has arrived
+		uint32_t creditWindow = 2048;
+	};
+
+	struct Stats {
+		uint64_t accepts;
+		uint64_t clientCloses;		//Closed by the client rather than dropClient()
+		uint64_t creditFrames;
+		uint64_t creditViolations;	//Data bytes past the last credit
+		uint64_t badFrames;			//Mux frames with a bad header
+	};
+
+	explicit StandInBridge(const Options &options);
+	~StandInBridge();
+
+	StandInBridge(const StandInBridge&) = delete;
+	StandInBridge& operator=(const StandInBridge&) = delete;
+
+	//Listens on 127.0.0.1, returns false if that fails
+	bool start();
+	void stop();
+
+	uint16_t port() const;
+
+	//Waits until a client is (or no longer is) connected
+	bool waitClient(bool connected, std::chrono::milliseconds timeout);
+
+	//UART data towards the client, framed in credit and mux mode. What is
+	//still queued when the client goes away is dropped.
+	void send(const std::string &data);
+
+	//Mux mode, a frame on one of the other channels
+	void sendMessage(uint8_t channel, const std::string &payload);
+
+	//Closes the client's connection, as switching the bridge off does,
+	//and returns once it is closed
+	void dropClient();
+
+	//Waits until 'len' bytes of client data have arrived and takes them,
+	//returns what there is on timeout
+	std::string receive(size_t len, std::chrono::milliseconds timeout);
+
+	//Next message the client sent on a channel other than data
+	bool receiveMessage(BridgeClient::Message &out, std::chrono::milliseconds timeout);
+
+	Stats stats() const;
+
+private:
+	void ioThread();
+	void acceptClient();
+	void closeClient(bool byClient);
+	bool service();
+	void parseFrames(const uint8_t *data, size_t len);
+	void endFrame();
+	void received(const uint8_t *data, size_t len);
+	void queueFrame(uint8_t channel, const uint8_t *data, size_t len);
+	void wake();
+
+	Options options;
+
+	std::thread thread;
+	std::atomic<bool> running;
+
+	int listenSock, clientSock;
+	int wakePipe[2];
+	uint16_t boundPort;
+
+	mutable std::mutex mutex;
+	std::condition_variable cond;
+
+	//Guarded by mutex
+	std::string outBuffer;
+	std::string inData;
+	std::deque<BridgeClient::Message> inMessages;
+	bool dropRequested;
+	Stats counters;
+
+	//I/O thread only
+	uint8_t frameHeader[4] = {};
+	size_t headerLen, payloadLeft;
+	std::string framePayload;
+	uint32_t recvTotal, creditLimit;
+};
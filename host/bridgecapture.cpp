@@ -0,0 +1,164 @@
+//Download the bridge's flash capture log of UART data.
+//
+//The bridge has to run in mux mode ('set mux 1') with 'capture' set, see
+//include/user_capture.h in the firmware. Every record is printed with
+//its boot number and time, non-printable bytes escaped. -r writes just
+//the UART bytes to a file instead.
+//
+//Usage: bridgecapture [-h host] [-p port] [-c] [-r file]
+
+#include "BridgeClient.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+//Block layout, see include/user_capture.h
+#define CAPTURE_BLOCK_LEN		512
+#define CAPTURE_BLOCK_HEADER	8
+#define CAPTURE_RECORD_HEADER	6
+
+using Clock = std::chrono::steady_clock;
+
+static uint32_t le32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+static uint16_t le16(const uint8_t *p) {
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static void printRecord(unsigned boot, uint32_t ms, const uint8_t *data, size_t len) {
+	std::printf("boot %u %10.3fs %4zu: ", boot, ms / 1000.0, len);
+
+	for(size_t i = 0; i < len; ++i) {
+		if((data[i] >= 0x20) && (data[i] < 0x7F) && (data[i] != '\\'))
+			std::putchar(data[i]);
+		else if(data[i] == '\\')
+			std::printf("\\\\");
+		else
+			std::printf("\\x%02x", data[i]);
+	}
+
+	std::printf("\n");
+}
+
+//Returns the number of records, or -1 if the block is malformed
+static int parseBlock(const uint8_t *block, FILE *raw) {
+	unsigned boot = le16(block + 4);
+	size_t used = le16(block + 6);
+	size_t pos = CAPTURE_BLOCK_HEADER;
+	int records = 0;
+
+	if(used > CAPTURE_BLOCK_LEN - CAPTURE_BLOCK_HEADER)
+		return -1;
+
+	while(pos + CAPTURE_RECORD_HEADER <= CAPTURE_BLOCK_HEADER + used) {
+		uint32_t ms = le32(block + pos);
+		size_t len = le16(block + pos + 4);
+
+		pos += CAPTURE_RECORD_HEADER;
+		if(pos + len > CAPTURE_BLOCK_HEADER + used)
+			return -1;
+
+		if(raw != nullptr)
+			std::fwrite(block + pos, 1, len, raw);
+		else
+			printRecord(boot, ms, block + pos, len);
+
+		pos += len;
+		records++;
+	}
+
+	return records;
+}
+
+int main(int argc, char **argv) {
+	BridgeClient::Options options;
+	const char *rawPath = nullptr;
+
+	options.mux = true;
+
+	int i = 1;
+	for(; i < argc; ++i) {
+		if((std::strcmp(argv[i], "-h") == 0) && (i + 1 < argc))
+			options.host = argv[++i];
+		else if((std::strcmp(argv[i], "-p") == 0) && (i + 1 < argc))
+			options.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+		else if(std::strcmp(argv[i], "-c") == 0)
+			options.credits = true;
+		else if((std::strcmp(argv[i], "-r") == 0) && (i + 1 < argc))
+			rawPath = argv[++i];
+		else
+			break;
+	}
+
+	if(i < argc) {
+		std::fprintf(stderr, "Usage: %s [-h host] [-p port] [-c] [-r file]\n", argv[0]);
+		return 2;
+	}
+
+	FILE *raw = nullptr;
+	if((rawPath != nullptr) && ((raw = std::fopen(rawPath, "wb")) == nullptr)) {
+		std::perror(rawPath);
+		return 1;
+	}
+
+	BridgeClient client(options);
+	client.start();
+
+	auto deadline = Clock::now() + std::chrono::seconds(10);
+	while(!client.connected()) {
+		if(Clock::now() > deadline) {
+			std::fprintf(stderr, "Could not connect to %s:%u\n", options.host.c_str(), options.port);
+			return 1;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	client.sendMessage(BridgeClient::CHANNEL_CAPTURE, "");
+
+	BridgeClient::Message msg;
+	size_t blocks = 0, records = 0, bad = 0;
+	bool done = false;
+
+	while(!done && client.receiveMessage(msg, std::chrono::seconds(5))) {
+		if(msg.channel == BridgeClient::CHANNEL_LOG) {
+			std::fprintf(stderr, "log: %s", msg.payload.c_str());
+			continue;
+		}
+
+		if(msg.channel != BridgeClient::CHANNEL_CAPTURE)
+			continue;
+
+		//An empty frame ends the download
+		done = msg.payload.empty();
+
+		const uint8_t *data = reinterpret_cast<const uint8_t*>(msg.payload.data());
+		for(size_t pos = 0; pos + CAPTURE_BLOCK_LEN <= msg.payload.size(); pos += CAPTURE_BLOCK_LEN) {
+			int count = parseBlock(data + pos, raw);
+
+			blocks++;
+			if(count < 0)
+				bad++;
+			else
+				records += static_cast<size_t>(count);
+		}
+	}
+
+	client.stop();
+
+	if(raw != nullptr)
+		std::fclose(raw);
+
+	std::fprintf(stderr, "%zu blocks, %zu records%s", blocks, records, done ? "" : ", download incomplete");
+	if(bad > 0)
+		std::fprintf(stderr, ", %zu malformed blocks", bad);
+	std::fprintf(stderr, "\n");
+
+	return (done && (bad == 0)) ? 0 : 1;
+}
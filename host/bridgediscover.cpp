@@ -0,0 +1,88 @@
+//Find bridges by broadcast probe or over mDNS, or stand in for one.
+//
+//Usage: bridgediscover [-P port] [-t ms] [-b address] probe
+//       bridgediscover [-P port] [-t ms] browse
+//       bridgediscover [-P port] [-t ms] respond <instance> <address> [tcp port]
+//
+//probe uses the control port (289) and lists every bridge that answers
+//with its ID, client count and load; browse and respond use mDNS (5353).
+//
+//To try mDNS discovery without hardware, run a responder and a browser on
+//the same machine with a private port, e.g.
+//  bridgediscover -P 5354 -t 10000 respond cybot-3 127.0.0.1 &
+//  bridgediscover -P 5354 browse
+
+#include "BridgeDiscovery.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+int main(int argc, char **argv) {
+	DiscoveryOptions options;
+	ProbeOptions probeOptions;
+
+	int i = 1;
+	for(; i < argc; ++i) {
+		if((std::strcmp(argv[i], "-P") == 0) && (i + 1 < argc))
+			options.port = probeOptions.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+		else if((std::strcmp(argv[i], "-t") == 0) && (i + 1 < argc))
+			options.timeout = probeOptions.timeout = std::chrono::milliseconds(std::atoi(argv[++i]));
+		else if((std::strcmp(argv[i], "-b") == 0) && (i + 1 < argc))
+			probeOptions.broadcast = argv[++i];
+		else
+			break;
+	}
+
+	if(i >= argc) {
+		std::fprintf(stderr, "Usage: %s [-P port] [-t ms] [-b address] probe | browse | respond <instance> <address> [tcp port]\n", argv[0]);
+		return 2;
+	}
+
+	std::string mode = argv[i];
+
+	if(mode == "probe") {
+		std::vector<BridgeProbe> bridges = probeBridges(probeOptions);
+
+		for(const BridgeProbe &b : bridges) {
+			std::printf("id %s\t%s:%s\tclients %s\tstations %s\t%s\t%.1fms\n",
+				b.fields.count("id") ? b.fields.at("id").c_str() : "?",
+				b.address.c_str(),
+				b.fields.count("port") ? b.fields.at("port").c_str() : "?",
+				b.fields.count("clients") ? b.fields.at("clients").c_str() : "?",
+				b.fields.count("stations") ? b.fields.at("stations").c_str() : "?",
+				b.fields.count("governor") ? b.fields.at("governor").c_str() : "?",
+				b.rtt.count() / 1000.0);
+		}
+
+		return bridges.empty() ? 1 : 0;
+	}
+	else if(mode == "browse") {
+		std::vector<BridgeService> bridges = discoverBridges(options);
+
+		for(const BridgeService &b : bridges) {
+			std::printf("%s\t%s:%u\t%s\n", b.instance.c_str(),
+				b.address.empty() ? "?" : b.address.c_str(), b.port, b.host.c_str());
+		}
+
+		return bridges.empty() ? 1 : 0;
+	}
+	else if((mode == "respond") && (i + 2 < argc)) {
+		uint16_t port = (i + 3 < argc) ? static_cast<uint16_t>(std::atoi(argv[i + 3])) : 288;
+
+		StandInResponder responder(options, argv[i + 1], argv[i + 2], port);
+		if(!responder.open()) {
+			std::fprintf(stderr, "Could not join %s:%u\n", options.group.c_str(), options.port);
+			return 1;
+		}
+
+		int answered = responder.serve(options.timeout);
+		std::printf("answered %d queries\n", answered);
+
+		return 0;
+	}
+
+	std::fprintf(stderr, "Unknown mode '%s'\n", mode.c_str());
+	return 2;
+}
@@ -0,0 +1,280 @@
+//Echo RTT and throughput measurement against the WiFi bridge.
+//
+//For rtt and throughput the far end must echo what it receives: either
+//the robot running an echo loop, or the bridge itself in its echo or
+//loopback test mode. source and sink measure one direction against the
+//bridge's source and sink modes.
+//
+//-m switches the bridge into that test mode over the control port first,
+//and prints the bridge's own report afterwards, e.g.
+//  bridgeperf -m echo rtt          WiFi and TCP only
+//  bridgeperf -m loopback rtt      ...plus the bridge's UART path
+//  bridgeperf -m source source     Bridge to host
+//  bridgeperf -m sink sink         Host to bridge
+//
+//-c talks to a bridge running in credit mode ('set credit 1'), -x to one
+//in mux mode ('set mux 1'), which also prints the bridge's stats from the
+//stats channel of the same connection.
+//
+//Usage: bridgeperf [-h host] [-p port] [-c] [-x] [-m test mode] rtt [count]
+//       bridgeperf [-h host] [-p port] [-c] [-x] [-m test mode] throughput | source | sink [seconds]
+
+#include "BridgeClient.h"
+#include "BridgeDiscovery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static bool waitConnected(BridgeClient &client) {
+	auto deadline = Clock::now() + std::chrono::seconds(10);
+
+	while(!client.connected()) {
+		if(Clock::now() > deadline)
+			return false;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return true;
+}
+
+static int runRtt(BridgeClient &client, int count) {
+	std::vector<double> samples;
+	uint8_t msg[8], echo[8];
+
+	for(int i = 0; i < count; ++i) {
+		for(size_t j = 0; j < sizeof(msg); ++j)
+			msg[j] = static_cast<uint8_t>('A' + (i + j) % 26);
+
+		auto start = Clock::now();
+		client.write(msg, sizeof(msg));
+
+		size_t got = 0;
+		while(got < sizeof(echo)) {
+			if(!client.waitReadable(std::chrono::milliseconds(1000))) {
+				std::fprintf(stderr, "Timed out waiting for echo %d\n", i);
+				return 1;
+			}
+			got += client.read(echo + got, sizeof(echo) - got);
+		}
+
+		auto us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+		if(std::memcmp(msg, echo, sizeof(msg)) != 0) {
+			std::fprintf(stderr, "Echo mismatch on message %d\n", i);
+			return 1;
+		}
+
+		samples.push_back(us);
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0;
+	for(double s : samples)
+		sum += s;
+
+	std::printf("rtt: n=%d min=%.0fus avg=%.0fus p50=%.0fus p99=%.0fus max=%.0fus\n",
+		count, samples.front(), sum / samples.size(),
+		samples[samples.size() / 2], samples[(samples.size() * 99) / 100],
+		samples.back());
+
+	return 0;
+}
+
+static int runThroughput(BridgeClient &client, int seconds) {
+	std::vector<uint8_t> block(1460);
+	for(size_t i = 0; i < block.size(); ++i)
+		block[i] = static_cast<uint8_t>(i);
+
+	uint8_t sink[4096];
+	uint64_t written = 0, read = 0;
+
+	auto start = Clock::now();
+	auto end = start + std::chrono::seconds(seconds);
+
+	while(Clock::now() < end) {
+		//Keep a bounded amount in flight so the echo path is measured,
+		//not the local send queue
+		if(written - read < 16 * block.size())
+			written += client.write(block.data(), block.size());
+
+		client.waitReadable(std::chrono::milliseconds(1));
+		read += client.read(sink, sizeof(sink));
+	}
+
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	BridgeClient::Stats s = client.stats();
+
+	std::printf("throughput: sent=%llu echoed=%llu in %.2fs -> %.1f kB/s (%llu send calls)\n",
+		static_cast<unsigned long long>(written), static_cast<unsigned long long>(read),
+		elapsed, read / elapsed / 1000.0, static_cast<unsigned long long>(s.sendCalls));
+
+	return 0;
+}
+
+static int runSource(BridgeClient &client, int seconds) {
+	uint8_t buffer[4096];
+	uint64_t read = 0, mismatched = 0;
+
+	auto start = Clock::now();
+	auto end = start + std::chrono::seconds(seconds);
+
+	while(Clock::now() < end) {
+		client.waitReadable(std::chrono::milliseconds(10));
+
+		size_t got = client.read(buffer, sizeof(buffer));
+		for(size_t i = 0; i < got; ++i)
+			mismatched += (buffer[i] != 0x55);
+		read += got;
+	}
+
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::printf("source: received=%llu in %.2fs -> %.1f kB/s (%llu bytes not 0x55)\n",
+		static_cast<unsigned long long>(read), elapsed, read / elapsed / 1000.0,
+		static_cast<unsigned long long>(mismatched));
+
+	return mismatched ? 1 : 0;
+}
+
+static int runSink(BridgeClient &client, int seconds) {
+	std::vector<uint8_t> block(1460, 0x55);
+
+	auto start = Clock::now();
+	auto end = start + std::chrono::seconds(seconds);
+
+	//Writes only fail when the local queue is full, so whatever is
+	//accepted has to drain through the bridge
+	while(Clock::now() < end) {
+		if(client.write(block.data(), block.size()) == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	client.flush(std::chrono::seconds(5));
+
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	BridgeClient::Stats s = client.stats();
+
+	std::printf("sink: sent=%llu in %.2fs -> %.1f kB/s (%llu send calls)\n",
+		static_cast<unsigned long long>(s.bytesSent), elapsed, s.bytesSent / elapsed / 1000.0,
+		static_cast<unsigned long long>(s.sendCalls));
+
+	return 0;
+}
+
+//Asks on the stats channel, log messages arriving meanwhile are printed
+static void printMuxStats(BridgeClient &client) {
+	BridgeClient::Message msg;
+
+	client.sendMessage(BridgeClient::CHANNEL_STATS, "");
+
+	while(client.receiveMessage(msg, std::chrono::milliseconds(1000))) {
+		if(msg.channel == BridgeClient::CHANNEL_LOG) {
+			std::printf("log: %s", msg.payload.c_str());
+			continue;
+		}
+
+		if(msg.channel == BridgeClient::CHANNEL_STATS) {
+			std::replace(msg.payload.begin(), msg.payload.end(), '\n', ' ');
+			std::printf("stats: %s\n", msg.payload.c_str());
+			return;
+		}
+	}
+
+	std::fprintf(stderr, "No stats from the bridge\n");
+}
+
+static bool setTestMode(const std::string &host, const std::string &mode,
+		std::map<std::string, std::string> &report) {
+	ProbeOptions control;
+	control.timeout = std::chrono::milliseconds(1000);
+
+	return controlCommand(host, mode.empty() ? "test" : "test " + mode, control, report);
+}
+
+int main(int argc, char **argv) {
+	BridgeClient::Options options;
+	std::string testMode;
+
+	int i = 1;
+	for(; i < argc; ++i) {
+		if((std::strcmp(argv[i], "-h") == 0) && (i + 1 < argc))
+			options.host = argv[++i];
+		else if((std::strcmp(argv[i], "-p") == 0) && (i + 1 < argc))
+			options.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+		else if((std::strcmp(argv[i], "-m") == 0) && (i + 1 < argc))
+			testMode = argv[++i];
+		else if(std::strcmp(argv[i], "-c") == 0)
+			options.credits = true;
+		else if(std::strcmp(argv[i], "-x") == 0)
+			options.mux = true;
+		else
+			break;
+	}
+
+	if(i >= argc) {
+		std::fprintf(stderr, "Usage: %s [-h host] [-p port] [-c] [-x] [-m test mode] rtt [count] | throughput | source | sink [seconds]\n", argv[0]);
+		return 2;
+	}
+
+	std::map<std::string, std::string> report;
+
+	if(!testMode.empty() && !setTestMode(options.host, testMode, report)) {
+		std::fprintf(stderr, "Bridge at %s did not accept test mode '%s'\n", options.host.c_str(), testMode.c_str());
+		return 1;
+	}
+
+	std::string mode = argv[i];
+	int arg = (i + 1 < argc) ? std::atoi(argv[i + 1]) : 0;
+
+	BridgeClient client(options);
+	client.start();
+
+	if(!waitConnected(client)) {
+		std::fprintf(stderr, "Could not connect to %s:%u\n", options.host.c_str(), options.port);
+		return 1;
+	}
+
+	int rc;
+	if(mode == "rtt")
+		rc = runRtt(client, arg > 0 ? arg : 100);
+	else if(mode == "throughput")
+		rc = runThroughput(client, arg > 0 ? arg : 10);
+	else if(mode == "source")
+		rc = runSource(client, arg > 0 ? arg : 10);
+	else if(mode == "sink")
+		rc = runSink(client, arg > 0 ? arg : 10);
+	else {
+		std::fprintf(stderr, "Unknown mode '%s'\n", mode.c_str());
+		rc = 2;
+	}
+
+	if(options.mux)
+		printMuxStats(client);
+
+	client.stop();
+
+	//The bridge's view of the same run, then back to normal bridging
+	if(!testMode.empty()) {
+		report.clear();
+
+		if(setTestMode(options.host, "", report)) {
+			std::printf("bridge:");
+			for(const auto &field : report)
+				std::printf(" %s=%s", field.first.c_str(), field.second.c_str());
+			std::printf("\n");
+		}
+
+		setTestMode(options.host, "off", report);
+	}
+
+	return rc;
+}
@@ -0,0 +1,110 @@
+//Download the bridge's event trace for test/replay.
+//
+//The firmware has to be built with TRACE defined, see
+//include/user_trace.h. The bridge records every UART and TCP event into a
+//ring; this polls the 'trace' control command for the whole session and
+//writes the events as "<time> <type> <len>" lines, oldest first. Polling
+//often enough keeps the ring from filling up, events recorded while it
+//was full are counted as dropped rather than written.
+//
+//Usage: bridgetrace [-P port] [-t ms] [-d seconds] address [file]
+
+#include "BridgeDiscovery.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+//Pulls "key=value" out of the tail of a 'trace' reply
+static bool counter(const std::string &line, const char *key, unsigned long &value) {
+	size_t keyLen = std::strlen(key);
+
+	if((line.compare(0, keyLen, key) != 0) || (line.size() <= keyLen) || (line[keyLen] != '='))
+		return false;
+
+	value = std::strtoul(line.c_str() + keyLen + 1, nullptr, 10);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	ProbeOptions options;
+	std::chrono::milliseconds interval{100};
+	std::chrono::seconds duration{10};
+
+	int i = 1;
+	for(; i < argc; ++i) {
+		if((std::strcmp(argv[i], "-P") == 0) && (i + 1 < argc))
+			options.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+		else if((std::strcmp(argv[i], "-t") == 0) && (i + 1 < argc))
+			interval = std::chrono::milliseconds(std::atoi(argv[++i]));
+		else if((std::strcmp(argv[i], "-d") == 0) && (i + 1 < argc))
+			duration = std::chrono::seconds(std::atoi(argv[++i]));
+		else
+			break;
+	}
+
+	if((i + 1 != argc) && (i + 2 != argc)) {
+		std::fprintf(stderr, "Usage: %s [-P port] [-t ms] [-d seconds] address [file]\n", argv[0]);
+		return 2;
+	}
+
+	std::string address = argv[i];
+	FILE *out = stdout;
+
+	if((i + 2 == argc) && ((out = std::fopen(argv[i + 1], "w")) == nullptr)) {
+		std::perror(argv[i + 1]);
+		return 1;
+	}
+
+	auto end = Clock::now() + duration;
+	unsigned long events = 0, dropped = 0, left = 0;
+	bool ok = true;
+
+	//Keep going after the end until the ring is empty
+	while(ok && ((Clock::now() < end) || (left > 0))) {
+		std::string reply;
+
+		if(!controlCommand(address, "trace", options, reply)) {
+			std::fprintf(stderr, "No answer to 'trace' from %s, is the firmware built with TRACE?\n",
+				address.c_str());
+			ok = false;
+			break;
+		}
+
+		size_t pos = 0;
+		while(pos < reply.size()) {
+			size_t eol = reply.find('\n', pos);
+			if(eol == std::string::npos)
+				eol = reply.size();
+
+			std::string line = reply.substr(pos, eol - pos);
+			pos = eol + 1;
+
+			if(counter(line, "trace_dropped", dropped) || counter(line, "trace_left", left))
+				continue;
+
+			if(!line.empty()) {
+				std::fprintf(out, "%s\n", line.c_str());
+				events++;
+			}
+		}
+
+		if(left == 0)
+			std::this_thread::sleep_for(interval);
+	}
+
+	if(out != stdout)
+		std::fclose(out);
+
+	std::fprintf(stderr, "%lu events", events);
+	if(dropped > 0)
+		std::fprintf(stderr, ", %lu dropped, poll more often with -t", dropped);
+	std::fprintf(stderr, "\n");
+
+	return (ok && (dropped == 0)) ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+//BridgeClient against StandInBridge: its rings, connect, reconnect,
+//credit and mux framing, and shutdown. Run with 'make test'.
+
+#include "BridgeClient.h"
+#include "StandInBridge.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static const std::chrono::milliseconds TIMEOUT{3000};
+
+static int checks, failures;
+
+#define CHECK(cond)	check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char *expr, int line) {
+	checks++;
+
+	if(!ok) {
+		failures++;
+		std::fprintf(stderr, "test_client.cpp:%d: %s failed\n", line, expr);
+	}
+}
+
+//Distinct bytes, so a dropped or repeated piece shows
+static std::string pattern(size_t len, unsigned seed) {
+	std::string data(len, '\0');
+
+	for(size_t i = 0; i < len; ++i)
+		data[i] = static_cast<char>((i * 31 + seed * 7 + (i >> 8)) & 0xFF);
+
+	return data;
+}
+
+static BridgeClient::Options clientOptions(const StandInBridge &bridge, bool credits, bool mux) {
+	BridgeClient::Options options;
+
+	options.host = "127.0.0.1";
+	options.port = bridge.port();
+	options.reconnectMin = std::chrono::milliseconds(10);
+	options.reconnectMax = std::chrono::milliseconds(50);
+	options.credits = credits;
+	options.mux = mux;
+
+	return options;
+}
+
+static bool waitConnected(BridgeClient &client, bool connected) {
+	auto deadline = Clock::now() + TIMEOUT;
+
+	while(client.connected() != connected) {
+		if(Clock::now() > deadline)
+			return false;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return true;
+}
+
+//connected() may already be back, the count isn't
+static bool waitDisconnects(BridgeClient &client, uint64_t count) {
+	auto deadline = Clock::now() + TIMEOUT;
+
+	while(client.stats().disconnects < count) {
+		if(Clock::now() > deadline)
+			return false;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return true;
+}
+
+static std::string readAll(BridgeClient &client, size_t len) {
+	std::string data;
+	char buffer[4096];
+
+	while(data.size() < len) {
+		if(!client.waitReadable(TIMEOUT))
+			break;
+
+		size_t count = client.read(buffer, sizeof(buffer));
+		data.append(buffer, count);
+	}
+
+	return data;
+}
+
+//Writes everything, waiting while the send ring is full
+static void writeAll(BridgeClient &client, const std::string &data) {
+	size_t pos = 0;
+	auto deadline = Clock::now() + TIMEOUT;
+
+	while((pos < data.size()) && (Clock::now() < deadline)) {
+		pos += client.write(data.data() + pos, data.size() - pos);
+		if(pos < data.size())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+//Odd capacities are rounded up, so masked positions still wrap right
+static void testRing() {
+	SpscRing ring(1000);
+	CHECK(ring.capacity() == 1024);
+
+	std::string data = pattern(700, 9), out(700, '\0');
+	const uint8_t *in = reinterpret_cast<const uint8_t*>(data.data());
+
+	for(int i = 0; i < 5; ++i) {
+		CHECK(ring.put(in, data.size()) == data.size());
+		CHECK(ring.get(reinterpret_cast<uint8_t*>(&out[0]), out.size()) == out.size());
+		CHECK(out == data);
+	}
+
+	CHECK(ring.put(in, data.size()) == data.size());
+	CHECK(ring.space() == 1024 - data.size());
+}
+
+static void testConnect() {
+	StandInBridge bridge(StandInBridge::Options{});
+	CHECK(bridge.start());
+
+	BridgeClient client(clientOptions(bridge, false, false));
+	client.start();
+
+	CHECK(waitConnected(client, true));
+	CHECK(bridge.waitClient(true, TIMEOUT));
+
+	std::string up = pattern(100000, 1);
+	writeAll(client, up);
+	CHECK(client.flush(TIMEOUT));
+	CHECK(bridge.receive(up.size(), TIMEOUT) == up);
+
+	std::string down = pattern(100000, 2);
+	bridge.send(down);
+	CHECK(readAll(client, down.size()) == down);
+
+	BridgeClient::Stats stats = client.stats();
+	CHECK(stats.bytesSent == up.size());
+	CHECK(stats.bytesReceived == down.size());
+	CHECK(stats.connects == 1);
+	CHECK(stats.disconnects == 0);
+
+	//Small writes are coalesced
+	for(int i = 0; i < 10; ++i)
+		client.write("ab", 2);
+	CHECK(client.flush(TIMEOUT));
+	CHECK(bridge.receive(20, TIMEOUT).size() == 20);
+	CHECK(client.stats().sendCalls - stats.sendCalls < 10);
+
+	client.stop();
+	bridge.stop();
+}
+
+static void testReconnect() {
+	StandInBridge bridge(StandInBridge::Options{});
+	CHECK(bridge.start());
+
+	BridgeClient client(clientOptions(bridge, false, false));
+	client.start();
+
+	CHECK(waitConnected(client, true));
+	CHECK(bridge.waitClient(true, TIMEOUT));
+
+	bridge.dropClient();
+	CHECK(waitDisconnects(client, 1));
+
+	//Back on its own, without losing what was written meanwhile
+	std::string up = pattern(5000, 3);
+	writeAll(client, up);
+
+	CHECK(bridge.waitClient(true, TIMEOUT));
+	CHECK(waitConnected(client, true));
+	CHECK(bridge.receive(up.size(), TIMEOUT) == up);
+
+	BridgeClient::Stats stats = client.stats();
+	CHECK(stats.connects == 2);
+	CHECK(stats.disconnects == 1);
+	CHECK(bridge.stats().accepts == 2);
+
+	//And the new connection carries data both ways
+	std::string down = pattern(3000, 4);
+	bridge.send(down);
+	CHECK(readAll(client, down.size()) == down);
+
+	client.stop();
+	bridge.stop();
+}
+
+static void testCredit() {
+	StandInBridge::Options options;
+	options.credits = true;
+	options.creditWindow = 1024;
+
+	StandInBridge bridge(options);
+	CHECK(bridge.start());
+
+	BridgeClient client(clientOptions(bridge, true, false));
+	client.start();
+
+	CHECK(waitConnected(client, true));
+	CHECK(bridge.waitClient(true, TIMEOUT));
+
+	std::string up = pattern(50000, 5);
+	writeAll(client, up);
+	CHECK(bridge.receive(up.size(), TIMEOUT) == up);
+
+	StandInBridge::Stats stats = bridge.stats();
+	CHECK(stats.creditViolations == 0);
+	CHECK(stats.creditFrames > up.size() / options.creditWindow);
+
+	//Data frames come out as plain data, credit frames don't show at all
+	std::string down = pattern(20000, 6);
+	bridge.send(down);
+	CHECK(readAll(client, down.size()) == down);
+
+	//Credits start over on a new connection
+	bridge.dropClient();
+	CHECK(waitDisconnects(client, 1));
+	CHECK(bridge.waitClient(true, TIMEOUT));
+	CHECK(waitConnected(client, true));
+
+	writeAll(client, up);
+	CHECK(bridge.receive(up.size(), TIMEOUT) == up);
+	CHECK(bridge.stats().creditViolations == 0);
+
+	client.stop();
+	bridge.stop();
+}
+
+static void testMux() {
+	StandInBridge::Options options;
+	options.credits = true;
+	options.mux = true;
+
+	StandInBridge bridge(options);
+	CHECK(bridge.start());
+
+	BridgeClient client(clientOptions(bridge, true, true));
+	client.start();
+
+	CHECK(waitConnected(client, true));
+	CHECK(bridge.waitClient(true, TIMEOUT));
+
+	//Messages in both directions, between data
+	std::string up = pattern(30000, 7);
+	writeAll(client, up.substr(0, 10000));
+	CHECK(client.sendMessage(BridgeClient::CHANNEL_CONTROL, "status"));
+	CHECK(client.sendMessage(BridgeClient::CHANNEL_STATS, ""));
+	writeAll(client, up.substr(10000));
+
+	BridgeClient::Message msg;
+	CHECK(bridge.receiveMessage(msg, TIMEOUT));
+	CHECK((msg.channel == BridgeClient::CHANNEL_CONTROL) && (msg.payload == "status"));
+	CHECK(bridge.receiveMessage(msg, TIMEOUT));
+	CHECK((msg.channel == BridgeClient::CHANNEL_STATS) && msg.payload.empty());
+	CHECK(bridge.receive(up.size(), TIMEOUT) == up);
+
+	std::string down = pattern(10000, 8);
+	bridge.send(down.substr(0, 5000));
+	bridge.sendMessage(BridgeClient::CHANNEL_CONTROL, "ok\nstate=idle\n");
+	bridge.sendMessage(BridgeClient::CHANNEL_LOG, "[Bridge] hello\r\n");
+	bridge.sendMessage(BridgeClient::CHANNEL_STATS, "");
+	bridge.send(down.substr(5000));
+
+	CHECK(readAll(client, down.size()) == down);
+	CHECK(client.receiveMessage(msg, TIMEOUT));
+	CHECK((msg.channel == BridgeClient::CHANNEL_CONTROL) && (msg.payload == "ok\nstate=idle\n"));
+	CHECK(client.receiveMessage(msg, TIMEOUT));
+	CHECK((msg.channel == BridgeClient::CHANNEL_LOG) && (msg.payload == "[Bridge] hello\r\n"));
+	CHECK(client.receiveMessage(msg, TIMEOUT));
+	CHECK((msg.channel == BridgeClient::CHANNEL_STATS) && msg.payload.empty());
+	CHECK(!client.receiveMessage(msg, std::chrono::milliseconds(50)));
+
+	StandInBridge::Stats stats = bridge.stats();
+	CHECK(stats.badFrames == 0);
+	CHECK(stats.creditViolations == 0);
+
+	client.stop();
+	bridge.stop();
+}
+
+static void testShutdown() {
+	StandInBridge bridge(StandInBridge::Options{});
+	CHECK(bridge.start());
+
+	//Closes the connection, and the bridge sees it go
+	{
+		BridgeClient client(clientOptions(bridge, false, false));
+		client.start();
+
+		CHECK(waitConnected(client, true));
+		CHECK(bridge.waitClient(true, TIMEOUT));
+
+		client.stop();
+		CHECK(!client.connected());
+		CHECK(client.stats().disconnects == 1);
+	}
+
+	CHECK(bridge.waitClient(false, TIMEOUT));
+	CHECK(bridge.stats().clientCloses == 1);
+
+	//Stopping doesn't wait out the reconnect backoff
+	uint16_t port = bridge.port();
+	bridge.stop();
+
+	BridgeClient::Options options = clientOptions(bridge, false, false);
+	options.port = port;
+	options.reconnectMin = std::chrono::milliseconds(5000);
+	options.reconnectMax = std::chrono::milliseconds(5000);
+
+	BridgeClient client(options);
+	client.start();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	auto start = Clock::now();
+	client.stop();
+	CHECK(Clock::now() - start < std::chrono::milliseconds(1000));
+	CHECK(client.stats().connects == 0);
+
+	//Stopping twice, or a client that never started, is harmless
+	client.stop();
+	BridgeClient idle(options);
+	idle.stop();
+}
+
+int main() {
+	testRing();
+	testConnect();
+	testReconnect();
+	testCredit();
+	testMux();
+	testShutdown();
+
+	std::printf("test_client: %d checks, %d failed\n", checks, failures);
+
+	return (failures == 0) ? 0 : 1;
+}
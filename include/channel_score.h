@@ -0,0 +1,27 @@
+#pragma once
+
+#include "portable.h"
+
+//Channel congestion scoring for SoftAP channel selection.
+//
+//Pure computation with no SDK calls, so recorded scan results can be
+//fed through it on the host, see test/test_channel.c.
+
+#define CHANNEL_COUNT	14
+
+//Only move off the current channel when another one is clearly better
+#define CHANNEL_SWITCH_MARGIN	(40)
+
+typedef struct {
+	uint32 score[CHANNEL_COUNT + 1];	//Indexed by channel number
+} ChannelScores;
+
+void ChannelScore_reset(ChannelScores *scores);
+
+//Account one observed AP on 'channel' with signal 'rssi' (dBm)
+void ChannelScore_add(ChannelScores *scores, uint8 channel, sint8 rssi);
+
+//Least congested of 'candidates'; 'current' is kept unless another
+//candidate beats it by CHANNEL_SWITCH_MARGIN
+uint8 ChannelScore_best(const ChannelScores *scores, const uint8 *candidates,
+	uint8 count, uint8 current);
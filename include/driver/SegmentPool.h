@@ -0,0 +1,66 @@
+#pragma once
+
+#include "os_type.h"
+#include "user_config.h"
+
+//Fixed pool of MSS-sized segments shared between the UART ISR and the
+//TCP layer. Segments are referred to by index and chained into FIFO
+//queues through their 'next' field, so moving one between queues never
+//copies its data. All operations mask the UART interrupt and may be
+//called from the ISR as well as from tasks.
+//
+//Both data directions draw from the same pool. Whichever direction is
+//busy grows into the segments the idle one isn't using, down to a
+//configured floor that is always kept for the other direction.
+
+#define SEGMENT_NONE	(0xFF)
+
+//Data directions, named after the side the data arrives on
+#define SEGMENT_UART_RX	0	//UART->TCP
+#define SEGMENT_TCP_RX	1	//TCP->UART
+#define SEGMENT_DIRECTIONS	2
+
+typedef struct {
+	uint8 *data;
+	uint16 len;
+	uint16 offset;
+	uint8 next;
+	uint8 dir;
+} Segment;
+
+typedef struct {
+	uint8 head, tail;
+	uint8 count;
+} SegmentQueue;
+
+void SegmentPool_init();
+
+uint8 SegmentPool_alloc(uint8 dir);
+
+void SegmentPool_free(uint8 seg);
+
+//Floors default to the profile in user_config.h, both together must stay
+//below SEGMENT_POOL_COUNT
+void SegmentPool_setFloor(uint8 dir, uint8 floor);
+
+uint8 SegmentPool_available(uint8 dir);
+
+//Segments 'dir' can still get however busy the other direction becomes
+uint8 SegmentPool_guaranteed(uint8 dir);
+
+uint8 SegmentPool_getUsed(uint8 dir);
+
+Segment* SegmentPool_get(uint8 seg);
+
+
+void SegmentQueue_init(SegmentQueue *queue);
+
+void SegmentQueue_push(SegmentQueue *queue, uint8 seg);
+
+uint8 SegmentQueue_pop(SegmentQueue *queue);
+
+uint8 SegmentQueue_peek(SegmentQueue *queue);
+
+uint8 SegmentQueue_peekTail(SegmentQueue *queue);
+
+void SegmentQueue_freeAll(SegmentQueue *queue);
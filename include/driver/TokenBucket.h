@@ -0,0 +1,26 @@
+#pragma once
+
+#include "os_type.h"
+
+//Byte rate limiter. Tokens build up at 'rate' bytes per second to at most
+//'burst', so a flow that has been quiet can send a burst right away and
+//is held to the rate after that. A rate of 0 never limits.
+
+typedef struct {
+	uint32 rate;	//Bytes per second, 0: unlimited
+	uint32 burst;
+	uint32 tokens;
+	uint32 last;	//system_get_time() the tokens are counted up to
+} TokenBucket;
+
+//Starts full
+void TokenBucket_init(TokenBucket *bucket, uint32 rate, uint32 burst);
+
+//Bytes that may be sent now, 0xFFFFFFFF when unlimited
+uint32 TokenBucket_available(TokenBucket *bucket);
+
+void TokenBucket_consume(TokenBucket *bucket, uint32 bytes);
+
+//Milliseconds until 'bytes' may be sent, 0 if they may be sent now.
+//'bytes' must not be more than the burst.
+uint32 TokenBucket_delay(TokenBucket *bucket, uint32 bytes);
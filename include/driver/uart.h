@@ -29,11 +29,29 @@
 #define UART_SIG_RXOVF	0x03
 #define UART_SIG_ERR_FRM	0x04
 #define UART_SIG_ERR_PARITY	0x05
-#define UART_TASK_PRIORITY	2
+
+//Separate pipelines so a flood in one direction can't starve the other.
+//PC->robot refills are short and latency sensitive, so they run first;
+//error reports only run when nothing else is pending.
+#define UART_TX_TASK_PRIORITY	2
+#define UART_RX_TASK_PRIORITY	1
+#define UART_ERR_TASK_PRIORITY	0
 
 #define UART_RX_FULL_LEVEL	(100)
 #define UART_RX_TO_LEVEL	(10)
 
+//When a partially filled RX segment is handed to the TCP layer.
+//IDLE: on the RX timeout, or whenever TCP has nothing in flight.
+//LINE: as soon as a delimiter arrives, otherwise at MSS or a deadline
+//that the caller enforces with uart_flushSegment.
+//PACKET: only on the RX timeout, so every gap on the line of at least
+//the packet gap ends one segment. Packets longer than MSS are split.
+#define UART_FLUSH_IDLE		0
+#define UART_FLUSH_LINE		1
+#define UART_FLUSH_PACKET	2
+
+#define UART_MAX_DELIMS		4
+
 //#define DEBUG	1
 
 typedef enum {
@@ -147,10 +165,16 @@ void uart_init(UartBautRate uart0_br, UartBautRate uart1_br);
 void uart0_sendStr(const char *str);
 uint16 uart0_send_nowait(uint8 *buffer, uint16 len);
 void uart_debugSend(char *str);
+
+//Also hands every debug message to 'handler', with or without DEBUG
+typedef void (*DebugHandler)(char *str);
+void uart_setDebugHandler(DebugHandler handler);
+
 void uart_set_txto();
 void uart_clear_txto();
 uint16 uart_getFifoLen();
 uint8 uart_getTxFifoAvail();
+void uart_setRxThresholds(uint8 full, uint8 timeout);
 
 
 ///////////////////////////////////////
@@ -193,7 +217,36 @@ struct UartBuffer*  Uart_Buf_Init();
 void  uart_rx_intr_enable(uint8 uart_no);
 void  uart_rx_intr_disable(uint8 uart_no);
 void uart0_tx_buffer(uint8 *buf, uint16 len);
-uint16 uart_get(uint8 *out, uint16 len);
+uint8 uart_getSegment();
+void uart_flushSegment();
+void uart_rxResume();
+uint8 uart_hasPartialSegment();
+
+//'delims' holds up to UART_MAX_DELIMS bytes, a zero byte ends it early
+void uart_setFlushPolicy(uint8 mode, const uint8 *delims);
+uint8 uart_getFlushMode();
+
+//Idle time in bit times that ends a packet, rounded up to whole 10 bit
+//frames. Overrides the governor's RX timeout while in packet mode.
+void uart_setPacketGap(uint16 bits);
+
+//Start RX segments this many bytes in, a multiple of 4 so the delimiter
+//scan stays word aligned. Takes effect with the next segment.
+void uart_setRxHeadroom(uint8 bytes);
+
+//Internal TX->RX loopback, the TX pin keeps driving the line
+void uart_setLoopback(uint8 enable);
+
+//Baud rate detection, see user_autobaud.h. Start masks RX and its error
+//interrupts and (re)starts the pulse counters. Pulse gives the shortest
+//pulse in UART clock cycles once 'edges' edges were seen, else 0. Stop
+//switches to 'baud' (0: keep the rate), clears the RX FIFO and unmasks.
+void uart_autobaudStart();
+uint32 uart_autobaudPulse(uint16 edges);
+void uart_autobaudStop(uint32 baud);
+
+//Current UART0 rate, from the clock divider
+uint32 uart_getBaudrate();
 void uart_rx_flush();
 
 //==============================================
@@ -0,0 +1,22 @@
+#pragma once
+
+//Types and attributes for modules that make no SDK calls, so they also
+//build natively with a host compiler, e.g. for the tests in test/
+#ifdef __ets__
+
+#include "c_types.h"
+
+#else
+
+#include <stdint.h>
+
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef uint32_t uint32;
+typedef int32_t sint32;
+
+#define ICACHE_FLASH_ATTR
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "os_type.h"
+
+//Baud rate detection on UART0 RX
+//
+//With 'autobaud' set, the UART's pulse width counters watch the robot's
+//first bytes. The shortest low or high pulse is one bit time, which is
+//matched to the nearest standard rate. RX stays off until then, so the
+//garbage received at the wrong rate never reaches a client, and the FIFO
+//is cleared once the rate is set. TX keeps using the configured 'baud'
+//until the lock. Noisy measurements that match no standard rate start
+//over.
+//
+//A window of bytes without a single one bit pulse (0xCC, say) measures
+//half the rate, so the lock takes the fastest rate matched over several
+//windows. A robot that stays quiet leaves the bridge at the fallback
+//rate once the timeout passes.
+
+#define AUTOBAUD_OFF		0
+#define AUTOBAUD_DETECTING	1
+#define AUTOBAUD_LOCKED		2
+#define AUTOBAUD_TIMEOUT	3	//Gave up, running at the fallback rate
+
+//How often the counters are checked while detecting
+#define AUTOBAUD_POLL_MS	(10)
+
+//RX edges to see before trusting the shortest pulse, a few bytes' worth
+#define AUTOBAUD_MIN_EDGES	(20)
+
+//A measured rate within 1/AUTOBAUD_TOLERANCE of a standard rate is taken
+#define AUTOBAUD_TOLERANCE	(16)
+
+//Windows of AUTOBAUD_MIN_EDGES edges that have to match before the lock
+#define AUTOBAUD_WINDOWS	(3)
+
+//Detection gives up after this long (ms)
+#define AUTOBAUD_TIMEOUT_MS	(30000)
+
+//Stop listening to the line until the rate is known, or until the
+//timeout sets 'fallback'
+void autobaud_start(uint32 fallback);
+
+//Give up detecting and keep the current rate
+void autobaud_stop();
+
+uint8 autobaud_getState();
+const char *autobaud_getStateName();
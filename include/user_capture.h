@@ -0,0 +1,74 @@
+#pragma once
+
+#include "os_type.h"
+
+//Capture log of UART RX data in spare flash
+//
+//With 'capture' set, UART data is recorded with timestamps into a ring
+//of flash sectors, either only while no client is connected (data that
+//would otherwise be dropped) or all of it. Data is collected in RAM
+//blocks that are written from the background task, so flash erase and
+//write never hold up the RX path; data arriving while both blocks wait
+//for flash is dropped and counted. The ring wears all sectors evenly and
+//survives a reboot, the newest data overwrites the oldest.
+//
+//A client in mux mode downloads the log by sending an empty frame on
+//FRAME_CAPTURE. The bridge answers with the flash blocks, oldest first,
+//in capture frames and ends with an empty one.
+//
+//Block layout (little endian, CAPTURE_BLOCK_LEN bytes):
+//	uint32 sequence, uint16 boot, uint16 used, then 'used' record bytes
+//Record layout:
+//	uint32 ms since boot, uint16 length, then 'length' bytes of UART data
+//Records don't cross blocks. Data still in RAM when a download starts is
+//not part of it. The ms clock only runs while a block is open, so a quiet
+//spell longer than the 71 minute system_get_time() wrap comes out short
+//by whole wraps.
+
+#define CAPTURE_OFF		0
+#define CAPTURE_IDLE	1	//Only while no client is connected
+#define CAPTURE_ALL		2
+#define CAPTURE_UNKNOWN	0xFF
+
+//Between the end of irom0 (0x6C000 with eagle.app.v6.ld) and the
+//settings sectors
+#define CAPTURE_SECTOR_FIRST	(0x6C)
+#define CAPTURE_SECTOR_COUNT	(14)
+
+#define CAPTURE_BLOCK_HEADER	(8)
+#define CAPTURE_RECORD_HEADER	(6)
+
+//A partly filled block is written after this long
+#define CAPTURE_FLUSH_MS	(1000)
+
+//Posted to the task given to capture_init, which then calls capture_work
+#define CAPTURE_SIG_WORK	0x20
+
+//Finds where the ring left off, a few small reads
+void capture_init(uint8 mode, uint8 taskPriority);
+
+//Not saved, the 'capture' setting is the mode at boot
+void capture_setMode(uint8 mode);
+
+//Whether UART data should be recorded right now
+uint8 capture_active(uint8 connected);
+
+void capture_write(const uint8 *data, uint16 len);
+
+//One flash operation, reposts itself while there is more to do
+void capture_work();
+
+//Erase the whole ring, one sector per capture_work
+void capture_clear();
+
+//Start a download to the mux client, returns 0 if there is none
+uint8 capture_startDump();
+
+//Call on every TCP sent event, keeps the download going
+void capture_pump();
+
+//"capture=<mode>" and counter lines, returns the length written
+uint16 capture_report(char *buffer, uint16 size);
+
+//Mode by name, CAPTURE_UNKNOWN if there is no such mode
+uint8 capture_parse(const char *name);
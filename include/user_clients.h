@@ -0,0 +1,35 @@
+#pragma once
+
+#include "os_type.h"
+
+//Stations associated with the SoftAP, and which one owns the TCP session.
+//The SDK has no per-station RSSI or rate in SoftAP mode. The RSSI comes
+//from the probe requests stations send while they scan, so the report
+//gives its age too. No rate is reported, nothing in the SDK knows it.
+//
+//Idle stations are not pushed off: the SDK refuses to send the
+//deauthentication frame, and only the session's station is acted on.
+
+#define AP_MAX_CONNECTIONS	8
+
+//No probe request seen from the station yet
+#define CLIENT_RSSI_NONE	(0)
+
+void clients_init();
+
+void clients_associated(const uint8 *mac);
+
+//Returns 1 if the station owned the TCP session
+uint8 clients_disassociated(const uint8 *mac);
+
+//A probe request from 'mac' came in at 'rssi' dBm
+void clients_probed(const uint8 *mac, sint8 rssi);
+
+//Ties the session to the station that holds 'addr'
+void clients_sessionStarted(uint32 addr);
+void clients_sessionEnded();
+
+//"station=<mac> <ip> <session|idle> rssi=<dBm> rssi_age=<s>" lines,
+//the last two only once a probe request was seen, returns the length
+//written
+uint16 clients_report(char *buffer, uint16 size);
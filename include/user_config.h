@@ -0,0 +1,76 @@
+#pragma once
+
+//Buffer profiles
+//
+//Every bridge buffer is sized here so the total can be checked against
+//the DRAM that is left for the SDK and lwIP. Select a profile with
+//'make PROFILE=LOW_LATENCY' (or HIGH_THROUGHPUT), the default profile
+//matches the original sizing.
+#define PROFILE_DEFAULT		0
+#define PROFILE_LOW_LATENCY		1
+#define PROFILE_HIGH_THROUGHPUT	2
+
+#ifndef BRIDGE_PROFILE
+#define BRIDGE_PROFILE	PROFILE_DEFAULT
+#endif
+
+#define TCP_MAX_PACKET	(1460)
+
+#if BRIDGE_PROFILE == PROFILE_DEFAULT
+
+#define SEGMENT_POOL_COUNT		(26)
+#define SEGMENT_FLOOR_UART_RX	(4)
+#define SEGMENT_FLOOR_TCP_RX	(6)
+#define TCP_RECV_HOLD_HEADROOM	(5)
+#define UART_TX_BUFFER_SIZE		(128)
+
+#elif BRIDGE_PROFILE == PROFILE_LOW_LATENCY
+
+//Small queues bound the time a byte can wait in the bridge
+#define SEGMENT_POOL_COUNT		(10)
+#define SEGMENT_FLOOR_UART_RX	(2)
+#define SEGMENT_FLOOR_TCP_RX	(3)
+#define TCP_RECV_HOLD_HEADROOM	(2)
+#define UART_TX_BUFFER_SIZE		(128)
+
+#elif BRIDGE_PROFILE == PROFILE_HIGH_THROUGHPUT
+
+//Favor the robot->PC direction, which carries bulk telemetry
+#define SEGMENT_POOL_COUNT		(26)
+#define SEGMENT_FLOOR_UART_RX	(8)
+#define SEGMENT_FLOOR_TCP_RX	(4)
+#define TCP_RECV_HOLD_HEADROOM	(3)
+#define UART_TX_BUFFER_SIZE		(128)
+
+#else
+#error "Unknown BRIDGE_PROFILE"
+#endif
+
+//Data in both directions lives in one pool of MSS-sized segments. The
+//busy direction borrows from the idle one down to the other's floor.
+//TCP receive is held once fewer than TCP_RECV_HOLD_HEADROOM segments
+//remain for it, leaving room for data lwIP has already accepted.
+#define SEGMENT_POOL_SIZE	(SEGMENT_POOL_COUNT*TCP_MAX_PACKET)
+
+//The flash capture log stages data in two RAM blocks of this size
+#define CAPTURE_BLOCK_LEN	(512)
+
+//Statically allocated buffers share DRAM with the heap lwIP uses for pbufs
+#define BRIDGE_BUFFER_BUDGET	(40 * 1024)
+
+#define BRIDGE_BUFFER_TOTAL	(SEGMENT_POOL_SIZE + UART_TX_BUFFER_SIZE + 2*CAPTURE_BLOCK_LEN)
+
+#define IS_POWER_OF_TWO(x)	(((x) != 0) && (((x) & ((x) - 1)) == 0))
+
+_Static_assert(BRIDGE_BUFFER_TOTAL <= BRIDGE_BUFFER_BUDGET,
+	"Bridge buffers exceed the DRAM budget");
+_Static_assert(SEGMENT_POOL_COUNT >= 2 && SEGMENT_POOL_COUNT < 0xFF,
+	"Segment pool needs at least two segments and uint8 indices");
+_Static_assert(SEGMENT_FLOOR_UART_RX + SEGMENT_FLOOR_TCP_RX < SEGMENT_POOL_COUNT,
+	"Direction floors must leave segments to rebalance");
+_Static_assert(TCP_RECV_HOLD_HEADROOM < SEGMENT_FLOOR_TCP_RX,
+	"Receive floor must cover the hold headroom");
+_Static_assert(IS_POWER_OF_TWO(CAPTURE_BLOCK_LEN) && CAPTURE_BLOCK_LEN <= TCP_MAX_PACKET - 4,
+	"Capture blocks must divide a flash sector and fit a frame");
+_Static_assert(UART_TX_BUFFER_SIZE >= 126,
+	"UART TX buffer must hold a full hardware FIFO");
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "os_type.h"
+
+//UDP control channel, one text command per datagram:
+//
+//	get [key]		One key, or all of them
+//	set <key> <value>	Change the RAM copy
+//	save			Write the settings to flash
+//	defaults		Reset the RAM copy to the build defaults
+//	reboot			Restart with the saved settings
+//
+//Other modules add commands with ctrl_addCommand, such as 'discover'
+//(identity and load, meant to be broadcast), 'stations', 'test', 'stats',
+//'apply', 'capture', 'heap', and 'isr' and 'trace' in builds that have
+//them.
+//
+//Every command is answered with a datagram starting "ok" or "error".
+//The same commands can be sent on the control channel of a multiplexed
+//TCP connection, see user_frame.h.
+//
+//'set', 'save', 'defaults', 'reboot' and commands added with
+//CTRL_RESTRICTED change the bridge. A datagram only gets to run them if
+//the access handler allows its sender, otherwise the answer is
+//"error not allowed". The multiplexed control channel always may.
+#define CTRL_PORT	289
+
+#define CTRL_MAX_COMMANDS	12
+
+//'args' is the rest of the command line. Appends "key=value" lines after
+//the "ok" and returns the length written, or CTRL_INVALID to have the
+//command answered with "error invalid" instead.
+typedef uint16 (*CommandHandler)(char *args, char *buffer, uint16 size);
+
+#define CTRL_INVALID	(0xFFFF)
+
+//Command flags
+#define CTRL_OPEN		(0)
+#define CTRL_RESTRICTED	(1)
+
+//'addr' is the sender's IPv4 address in network byte order
+typedef uint8 (*AccessHandler)(uint32 addr);
+
+void ctrl_start(uint16 port);
+
+//Without a handler every sender is allowed
+void ctrl_setAccessHandler(AccessHandler handler);
+
+//Returns 0 when the command table is full
+uint8 ctrl_addCommand(const char *name, CommandHandler handler, uint8 flags);
+
+//Runs one command line (modified in place). 'reply' points to the answer,
+//valid until the next command, and its length is returned.
+uint16 ctrl_execute(char *line, const char **reply);
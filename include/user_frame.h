@@ -0,0 +1,36 @@
+#pragma once
+
+//Framing of the client connection in credit and mux mode
+//
+//Every frame starts with a four byte header:
+//	channel, 0, payload length (big endian, 16 bit)
+//
+//Data frames carry UART data. Credit frames carry a 32 bit big endian
+//count: the total number of bytes the client may have sent on this
+//connection. The first one is sent on connect, the client must not send
+//before it has arrived.
+//
+//In credit mode only the bridge frames, the client sends raw data. In mux
+//mode both sides frame and the other channels can be used too, with
+//credits counting data payload only:
+//	control: a command line as on CTRL_PORT, answered with the same reply
+//	stats: empty asks for a report, a decimal number of ms sets an
+//		interval to push one at (0 stops)
+//	log: debug messages from the bridge
+//	capture: empty asks for the capture log, see user_capture.h
+//Control, stats and log frames from the client are limited to
+//FRAME_MAX_MESSAGE bytes. Frames from the bridge on these channels go
+//ahead of queued data.
+
+#define FRAME_HEADER_LEN	4
+
+#define FRAME_DATA		0
+#define FRAME_CREDIT	1
+#define FRAME_CONTROL	2
+#define FRAME_STATS		3
+#define FRAME_LOG		4
+#define FRAME_CAPTURE	5
+
+#define FRAME_CREDIT_LEN	4
+
+#define FRAME_MAX_MESSAGE	128
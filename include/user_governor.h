@@ -0,0 +1,27 @@
+#pragma once
+
+#include "os_type.h"
+
+#define GOVERNOR_POWERSAVE		0
+#define GOVERNOR_PERFORMANCE	1
+#define GOVERNOR_MODES			2
+
+//Time without traffic or a client before dropping to power saving
+#define GOVERNOR_IDLE_TIME		2000
+
+//UART RX interrupt thresholds per mode: FIFO fill level and idle timeout
+//in byte times. Performance trades more interrupts for lower latency.
+#define GOVERNOR_PERF_RX_FULL	(64)
+#define GOVERNOR_PERF_RX_TO		(2)
+#define GOVERNOR_SAVE_RX_FULL	(UART_RX_FULL_LEVEL)
+#define GOVERNOR_SAVE_RX_TO		(UART_RX_TO_LEVEL)
+
+void governor_init();
+
+//Cheap enough to call on every data path event
+void governor_activity();
+
+uint8 governor_getMode();
+
+//Fold the running interval into bridgeStats before reading it
+void governor_updateStats();
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "os_type.h"
+
+//Free heap watermarks
+//
+//The bridge buffers are static, but lwIP takes its pbufs from the heap:
+//every byte handed to espconn_send and every byte received but not yet
+//delivered lives there until it is acknowledged or read. Free heap is
+//sampled on data path events, and while it is low the TCP layer backs
+//off (see tcp_setMemoryLevel) before espconn runs out.
+
+#define HEAP_OK			0
+#define HEAP_LOW		1	//Shrink the send window, slow send retries
+#define HEAP_CRITICAL	2	//Also hold client data and refuse new clients
+
+//Free bytes below which each level starts
+#define HEAP_LOW_WATER		(8 * 1024)
+#define HEAP_CRITICAL_WATER	(4 * 1024)
+
+//A level is left once free heap is this far above its water mark
+#define HEAP_HYSTERESIS		(1024)
+
+//How often the heap is checked while low, to see it recover without
+//traffic
+#define HEAP_RECHECK_MS		(100)
+
+typedef void (*HeapLevelHandler)(uint8 level, uint32 free);
+
+void heap_init();
+
+//Called on every level change
+void heap_setLevelHandler(HeapLevelHandler handler);
+
+//Cheap enough to call on every data path event, returns the level
+uint8 heap_sample();
+
+uint8 heap_getLevel();
+
+//"ok", "low" or "critical"
+const char *heap_levelName(uint8 level);
+
+//"heap_free=", "heap_min=" and alarm lines, returns the length written
+uint16 heap_report(char *buffer, uint16 size);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "os_type.h"
+
+//Uncomment to time the UART interrupt handler with the CPU cycle counter
+//#define ISR_PROFILE	1
+
+//Interrupt causes, in the order the handler checks them
+#define ISR_CAUSE_RX_FULL	0
+#define ISR_CAUSE_RX_TOUT	1
+#define ISR_CAUSE_TX_EMPTY	2
+#define ISR_CAUSE_RX_OVF	3
+#define ISR_CAUSE_FRM_ERR	4
+#define ISR_CAUSE_PARITY	5
+#define ISR_CAUSE_NONE		6	//No cause the handler knows about
+
+#define ISR_CAUSES			7
+
+//Handler run time histogram, bucket i counts runs shorter than
+//ISR_HISTOGRAM_BASE << i cycles, the last one also everything longer
+#define ISR_HISTOGRAM_BASE		(256)
+#define ISR_HISTOGRAM_BUCKETS	(12)
+
+#ifdef ISR_PROFILE
+
+//ISR_PROFILE_ENTER opens the measurement in the handler's scope,
+//ISR_PROFILE_EXIT has to be reached on every way out
+#define ISR_PROFILE_ENTER()			uint32 _isrStart = isrprofile_enter()
+#define ISR_PROFILE_EXIT(cause)	isrprofile_exit(_isrStart, (cause))
+
+//Both are called from the UART ISR
+uint32 isrprofile_enter();
+void isrprofile_exit(uint32 start, uint8 cause);
+
+void isrprofile_reset();
+
+//Per cause "<cause>=<count> <min> <avg> <max>" lines in cycles and how
+//far past the RX threshold the FIFO was when the handler started. Causes
+//that never fired are left out. Returns the length written.
+uint16 isrprofile_report(char *buffer, uint16 size);
+
+//"hist=" with the bucket counts, shortest first
+uint16 isrprofile_histogram(char *buffer, uint16 size);
+
+#else
+
+#define ISR_PROFILE_ENTER()
+#define ISR_PROFILE_EXIT(cause)	((void)(cause))
+
+#endif
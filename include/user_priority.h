@@ -0,0 +1,32 @@
+#pragma once
+
+#include "os_type.h"
+
+//Priority lane for short urgent messages from the client
+//
+//With an escape byte configured ('prio_esc'), the client tags a message
+//as urgent by sending <esc> <len> followed by len bytes. The message is
+//taken out of the byte stream as it arrives and written to the UART
+//ahead of everything still queued, as soon as the bulk data before it
+//reaches a message boundary. <esc> 0 stands for the escape byte itself
+//in bulk data. Data that lwIP is still holding back behind a closed
+//receive window can't be overtaken.
+
+#define PRIORITY_MAX_LEN	32
+#define PRIORITY_QUEUE_LEN	4
+
+//0 turns the lane off and leaves the stream untouched
+void priority_setEscape(uint8 escape);
+
+//Forget partial and queued messages, for a new connection
+void priority_reset();
+
+//Takes urgent messages out of received data in place, returns the number
+//of bulk bytes left at the start of 'data'
+uint16 priority_filter(uint8 *data, uint16 len);
+
+uint8 priority_pending();
+
+//Copies out the oldest urgent message and returns its length, records
+//how long it waited
+uint8 priority_take(uint8 *buffer);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "os_type.h"
+
+//Runtime settings
+//
+//Everything that used to need a reflash to tune lives in one record that
+//is loaded into RAM once at boot. Two flash sectors hold alternating
+//copies with a sequence number and CRC, a save always goes to the older
+//copy so an interrupted write leaves the previous settings intact.
+//Changes take effect at the next boot, or with the 'apply' command for the
+//UART and rate settings.
+
+//Defaults for a blank or invalid settings sector
+#define BAUD	115200
+#define TCP_PORT	288
+#define AP_PSK	"cpre288psk"
+
+//Just below the SDK system parameters on a 512KB part and clear of
+//irom0 on every flash size
+#define SETTINGS_SECTOR_A	(0x7A)
+#define SETTINGS_SECTOR_B	(0x7B)
+
+#define SETTINGS_MAGIC		(0x53424354)	//"TCBS"
+#define SETTINGS_VERSION	(6)
+
+#define SETTINGS_SSID_LEN	(32)
+#define SETTINGS_PSK_LEN	(64)
+#define SETTINGS_DELIMS_LEN	(4)
+
+//Line flush defaults, used when 'flush' is set to line mode
+#define FLUSH_DELIMS		"\n"
+#define FLUSH_DEADLINE		20
+
+//Packet mode gap in bit times, 3 characters at 8N1
+#define PACKET_GAP_BITS		30
+
+//Rate limits start with this much credit, two full segments
+#define RATE_BURST			(2*TCP_MAX_PACKET)
+
+struct BridgeSettings {
+	char ssid[SETTINGS_SSID_LEN];	//Empty: "cyBOT N" from the DIP switches
+	char psk[SETTINGS_PSK_LEN];
+	char staSsid[SETTINGS_SSID_LEN];	//Join this network instead, empty: AP only
+	char staPsk[SETTINGS_PSK_LEN];		//Empty for an open network
+	uint32 baud;
+	uint16 tcpPort;
+	uint8 channel;			//0: from the DIP switches, scanned if enabled
+	uint8 floorUartRx;		//Segment pool tuning, see user_config.h
+	uint8 floorTcpRx;
+	uint8 recvHeadroom;
+	uint16 flushDeadline;	//ms a partial line may wait in line mode
+	uint8 flushMode;		//UART_FLUSH_IDLE, UART_FLUSH_LINE or UART_FLUSH_PACKET
+	uint8 flushDelims[SETTINGS_DELIMS_LEN];	//Zero padded, set as hex
+	uint8 priorityEscape;	//Starts an urgent message from the client, 0: off
+	uint16 packetGap;		//Bit times ending a packet, 0: PACKET_GAP_BITS
+	uint32 rateUp;			//UART->TCP bytes/s, 0: unlimited
+	uint32 rateDown;		//TCP->UART bytes/s, 0: unlimited
+	uint16 rateBurst;		//Bytes either direction may send at once
+	uint8 creditMode;		//Frame the stream to the client and grant credits
+	uint8 muxMode;			//Frame both ways, with control, stats and log channels
+	uint8 captureMode;		//CAPTURE_OFF, CAPTURE_IDLE or CAPTURE_ALL
+	uint8 autobaud;			//Detect the robot's rate, 'baud' is only the start
+	uint8 reserved[2];
+};
+
+extern struct BridgeSettings settings;
+
+//Load the newest valid copy from flash, or the defaults
+void settings_init();
+
+//Write the RAM copy to flash, returns the new sequence number or 0
+uint32 settings_save();
+
+//Defaults in RAM only, 'save' makes them stick
+void settings_reset();
+
+//Text access by key for the control channel, return 0 on unknown keys
+//or values that are out of range
+uint8 settings_set(const char *key, const char *value);
+uint8 settings_get(const char *key, char *buffer, uint16 size);
+
+//Iterate over the keys, NULL past the last one
+const char* settings_key(uint8 index);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "os_type.h"
+
+//Per task pipeline dispatch statistics, latency is from ISR post to
+//task start in microseconds
+struct PipelineStats {
+	uint32 events;
+	uint32 latencyTotal;
+	uint32 latencyMax;
+};
+
+//Bridge-wide counters. Fields are updated from the UART ISR as well as
+//from tasks and are only ever incremented or overwritten whole.
+struct BridgeStats {
+	//UART->TCP data path
+	uint32 uartRxBytes;		//Bytes drained from the UART RX FIFO
+	uint32 tcpTxBytes;		//Bytes accepted by espconn_send
+	uint32 bytesCopied;		//Every memory-to-memory copy of payload
+	uint32 rxStalls;		//Times the RX ISR stopped on an empty pool
+	uint32 segmentsDropped;	//Segments discarded with no client connected
+	uint32 lineFlushes;		//Partial segments sent on a delimiter
+	uint32 deadlineFlushes;	//Partial segments sent on the flush deadline
+	uint32 uartPackets;		//Packets ended by an RX gap in packet mode
+	uint32 sendRetries;		//espconn_send refusals, mostly out of pbufs
+	uint32 rateLimitedUp;	//Sends held back by the UART->TCP rate limit
+	uint32 rateDelayUp;		//...and the milliseconds they waited
+	uint32 captureBytes;	//UART bytes recorded in the capture log
+	uint32 captureDropped;	//...and those lost to busy or failing flash
+	uint32 captureBlocks;	//Capture blocks written to flash
+
+	//TCP->UART data path
+	uint32 tcpRxBytes;		//Client bytes queued for the UART
+	uint32 tcpRxDropped;	//Client bytes lost to an exhausted pool
+	struct PipelineStats priorityLane;	//Urgent messages, arrival to UART FIFO
+	uint32 priorityDropped;	//Urgent messages too long or over the queue
+	uint32 uartTxBytes;		//Bytes written to the UART TX FIFO
+	uint32 creditFrames;	//Credit updates sent in credit mode
+	uint32 muxFrames;		//Control, stats and log frames sent in mux mode
+	uint32 muxDropped;		//...and those lost to a full queue or pool
+	uint32 rateLimitedDown;	//UART refills cut short by the TCP->UART limit
+	uint32 rateDelayDown;	//...and the milliseconds until the next one
+
+	//Task pipelines
+	struct PipelineStats rxPipeline;
+	struct PipelineStats txPipeline;
+	struct PipelineStats bgPipeline;	//Error reports and switch events
+	uint32 postFailures;	//Events lost to a full task queue
+
+	//Performance governor
+	uint32 governorTransitions;
+	uint32 governorTime[2];	//Milliseconds in power saving / performance
+
+	//Last switch-on, microseconds from the switch edge to...
+	uint32 apStartUs;		//...the AP running
+	uint32 staConnectUs;	//...the first station associating
+	uint32 tcpConnectUs;	//...the first TCP client connecting
+	uint32 staJoinUs;		//...having an IP on the configured network
+	uint32 staFallbacks;	//Station joins given up for the AP
+
+	//SoftAP stations
+	uint32 sessionsDropped;	//TCP sessions closed when their station left
+
+	//Heap shared with lwIP
+	uint32 heapMin;			//Lowest free heap seen
+	uint32 heapAlarms;		//Times free heap fell to a lower level
+	uint32 heapRejected;	//Clients refused while heap was critical
+};
+
+extern volatile struct BridgeStats bridgeStats;
@@ -3,11 +3,73 @@
 #include "os_type.h"
 
 typedef void (*ReceiveHandler)(uint16 len);
+typedef void (*SentHandler)();
+typedef void (*ConnectHandler)(uint8 connected);
+typedef void (*FrameHandler)(uint8 channel, uint8 *data, uint16 len);
 
 void tcp_start(uint16 port);
 void tcp_stop();
 
 void tcp_setRecvHandler(ReceiveHandler handler);
+void tcp_setSentHandler(SentHandler handler);
+void tcp_setConnectHandler(ConnectHandler handler);
 
-void tcp_send(uint8* buffer, uint16 len);
+//Complete control, stats and log frames from the client in mux mode
+void tcp_setFrameHandler(FrameHandler handler);
+
+//Segments kept free for data lwIP has already accepted when receive is held
+void tcp_setRecvHeadroom(uint8 headroom);
+
+//Frame everything sent and grant the client credits instead of holding
+//the receive window, see user_frame.h. Segments handed to
+//tcp_sendSegment then need tcp_getHeadroom() free bytes before 'offset'.
+void tcp_setCreditMode(uint8 enable);
+uint8 tcp_getCreditMode();
+uint8 tcp_getHeadroom();
+
+//Frame both directions and carry the control, stats and log channels
+//next to the data, see user_frame.h. Set before a client connects.
+void tcp_setMuxMode(uint8 enable);
+uint8 tcp_getMuxMode();
+
+//Queues a frame ahead of the data on a non-data channel, returns 0 when
+//not connected in mux mode or out of queue space. 'len' is cut to what
+//fits in a segment.
+uint8 tcp_sendFrame(uint8 channel, const uint8 *data, uint16 len);
+
+//Shape sends to 'rate' bytes/s with bursts of up to 'burst' bytes, which
+//must be at least TCP_MAX_PACKET. A rate of 0 sends as fast as lwIP takes it.
+void tcp_setSendRate(uint32 rate, uint16 burst);
+
+//Back off as free heap runs low, see user_heap.h. Low keeps one send in
+//flight and slows retries, critical also holds client data (or its
+//credits) and refuses new clients.
+void tcp_setMemoryLevel(uint8 level);
+
+void tcp_sendSegment(uint8 seg);
+
+//Like tcp_sendSegment, in a frame for 'channel' when framing
+void tcp_sendChannelSegment(uint8 seg, uint8 channel);
+
+//Segments waiting for espconn, not counting those in flight
+uint8 tcp_getBacklog();
+
+uint8 tcp_isIdle();
+uint8 tcp_isConnected();
+
+//Client address in network byte order, 0 without a client
+uint32 tcp_getRemoteAddr();
+
+//Close the client connection, reported through the connect handler
+void tcp_disconnect();
 uint16 tcp_receive(uint8* buffer, uint16 size);
+
+//Like tcp_receive, but stops after the first byte found in 'delims'
+//(zero padded, 'delimCount' long)
+uint16 tcp_receiveUntil(uint8 *buffer, uint16 size, const uint8 *delims, uint8 delimCount);
+
+//Client bytes waiting for tcp_receive
+uint16 tcp_getReceived();
+
+//Next received segment, the caller owns it. SEGMENT_NONE when empty.
+uint8 tcp_takeSegment();
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "os_type.h"
+
+//Built-in test modes for telling WiFi, bridge and robot problems apart.
+//Each one takes a different leg of the path out of the measurement:
+//
+//	echo		TCP data is sent straight back, the UART is not involved
+//	loopback	UART TX is wired to RX inside the chip, so data makes the
+//				full trip through the FIFOs without the robot
+//	source		The bridge sends a 0x55 pattern as fast as TCP takes it
+//	sink		TCP data is counted and discarded
+//
+//The report has throughput in each direction since the mode was entered
+//and the time from a send to its ACK. Round trips as the client sees
+//them are measured from the host side, see host/bridgeperf.cpp.
+//Modes are not saved and every boot starts with them off.
+
+#define TEST_OFF		0
+#define TEST_ECHO		1
+#define TEST_LOOPBACK	2
+#define TEST_SOURCE		3
+#define TEST_SINK		4
+#define TEST_UNKNOWN	0xFF
+
+void testmode_set(uint8 mode);
+uint8 testmode_get();
+
+//Returns 1 if the mode consumed the received data
+uint8 testmode_recv();
+
+//Call on every TCP sent event, refills the link in source mode
+void testmode_sent();
+
+//"test=<mode>" and measurement lines, returns the length written
+uint16 testmode_report(char *buffer, uint16 size);
+
+//Mode by name, TEST_UNKNOWN if there is no such mode
+uint8 testmode_parse(const char *name);
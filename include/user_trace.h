@@ -0,0 +1,55 @@
+#pragma once
+
+#include "os_type.h"
+#include "user_config.h"
+
+//Uncomment to record bridge traffic traces
+//#define TRACE	1
+
+#define TRACE_DEPTH	(512)
+
+_Static_assert(IS_POWER_OF_TWO(TRACE_DEPTH), "Trace depth must be a power of two");
+
+//Trace event types
+#define TRACE_UART_RX		0x01	//Bytes drained from the UART RX FIFO
+#define TRACE_UART_TX		0x02	//Bytes written to the UART TX FIFO
+#define TRACE_TCP_RECV	0x03	//Client write delivered by espconn
+#define TRACE_TCP_SEND	0x04	//Segment handed to espconn_send
+#define TRACE_TCP_SENT	0x05	//espconn sent callback
+#define TRACE_CONNECT		0x06
+#define TRACE_DISCONNECT	0x07
+#define TRACE_TYPES		8
+
+//One trace record, timestamps are system_get_time() microseconds.
+//Payload bytes are not recorded; a replay regenerates them from the
+//lengths so delivery can be checked byte for byte. The 'trace' command
+//on the control port drains the buffer as "<time> <type> <len>" lines,
+//which host/bridgetrace saves for test/replay.
+struct TraceEvent {
+	uint32 time;
+	uint8 type;
+	uint8 reserved;
+	uint16 len;
+};
+
+#ifdef TRACE
+
+#define TRACE_EVENT(type, len)	trace_record((type), (len))
+
+void trace_init();
+void trace_record(uint8 type, uint16 len);
+uint16 trace_read(struct TraceEvent *out, uint16 count);
+uint32 trace_getDropped();
+
+//Type name as used in the trace file format, e.g. "uart_rx"
+const char *trace_typeName(uint8 type);
+
+//Drains as many events as fit, then "trace_dropped=" and "trace_left=",
+//returns the length written
+uint16 trace_report(char *buffer, uint16 size);
+
+#else
+
+#define TRACE_EVENT(type, len)
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "os_type.h"
+
+//UART packets as UDP datagrams, for robot protocols that rely on packet
+//mode boundaries. The host holding the TCP session subscribes by sending
+//any datagram to the data port from the same address and repeats it as a
+//keepalive; packets then go to it instead of over TCP. Datagrams from
+//anyone else are ignored, and the subscription ends with the session.
+//Datagrams from the host are not forwarded to the UART, commands still
+//use TCP.
+
+//Stop sending to a subscriber that has been quiet this long (ms)
+#define UDP_PEER_TIMEOUT	30000
+
+void udp_start(uint16 port);
+
+uint8 udp_hasPeer();
+
+//Takes ownership of a filled pool segment and frees it once sent
+void udp_sendSegment(uint8 seg);
@@ -0,0 +1,433 @@
+//Replays a recorded session against the firmware and compares latency
+//and throughput with a stored baseline
+//
+//Usage: replay [-u] <trace> <baseline>
+//
+//A trace has one "<time> <type> <len>" line per event, as the 'trace'
+//command hands them out (see include/user_trace.h and host/bridgetrace).
+//uart_rx and tcp_recv are the inputs: the robot's bytes are put on the
+//UART line so they have all arrived by the time the ISR drained them,
+//and the client's writes happen at their recorded times. tcp_send to
+//tcp_sent gaps give the ACK delay. Everything else the bridge did is
+//what is being measured. A trace may also have
+//
+//	set <key> <value>	settings applied before the session
+//	ack_us <us>			ACK delay, instead of the recorded one
+//	# ...				comments
+//
+//Payloads are regenerated from the lengths, and the session is checked
+//to deliver every byte in both directions unchanged and in order. The
+//connection stays up after the last event until both directions have
+//drained. Figures more than REPLAY_TOLERANCE percent worse than the
+//baseline fail; -u writes the new figures to the baseline instead.
+//Traces are replayed in plain mode, 'credit' and 'mux' would add frames.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "user_ctrl.h"
+#include "driver/uart_register.h"
+
+#define REPLAY_TOLERANCE	(10)
+
+//Latencies are allowed this much on top of the tolerance, a few ticks
+#define REPLAY_SLACK_US		(100)
+
+//How long the bridge gets to drain after the last event
+#define REPLAY_DRAIN_US		(5000000)
+
+#define DEFAULT_ACK_US		(3000)
+
+#define MAX_EVENTS		(100000)
+#define MAX_SETTINGS	(16)
+
+//Names from include/user_trace.h
+enum { EV_UART_RX, EV_TCP_RECV, EV_TCP_SEND, EV_TCP_SENT, EV_CONNECT, EV_DISCONNECT, EV_OTHER };
+
+struct Event {
+	uint32 time;
+	uint8 type;
+	uint32 len;
+};
+
+struct Figures {
+	uint32 upAvgUs, upMaxUs, upBps;
+	uint32 downAvgUs, downMaxUs, downBps;
+};
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static struct Event _events[MAX_EVENTS];
+static uint32 _eventCount;
+
+static char _settings[MAX_SETTINGS][128];
+static uint8 _settingCount;
+
+static uint32 _ackUs;
+
+//Payload byte 'i' of one direction
+static uint8 __payload(uint32 i, uint8 direction) {
+	uint32 x = (i + 1) * 2654435761u + direction * 40503u;
+
+	return (x >> 13) ^ (x >> 24);
+}
+
+static uint8 __parseType(const char *name) {
+	static const char *NAMES[] = { "uart_rx", "tcp_recv", "tcp_send", "tcp_sent", "connect", "disconnect" };
+	uint8 i;
+
+	for(i = 0; i < EV_OTHER; ++i) {
+		if(strcmp(name, NAMES[i]) == 0) {
+			return i;
+		}
+	}
+
+	return EV_OTHER;
+}
+
+static int __load(const char *path) {
+	FILE *file = fopen(path, "r");
+	uint32 sendTimes[64], sendFront = 0, sendCount = 0;
+	uint64 ackTotal = 0;
+	uint32 ackCount = 0;
+	char line[256];
+
+	if(file == NULL) {
+		perror(path);
+		return 0;
+	}
+
+	while(fgets(line, sizeof(line), file) != NULL) {
+		struct Event *event = &_events[_eventCount];
+		char name[32];
+
+		if((line[0] == '#') || (line[0] == '\n')) {
+			continue;
+		}
+
+		if(strncmp(line, "set ", 4) == 0) {
+			if(_settingCount < MAX_SETTINGS) {
+				strncpy(_settings[_settingCount++], line, sizeof(_settings[0]) - 1);
+			}
+			continue;
+		}
+
+		if(sscanf(line, "ack_us %u", &_ackUs) == 1) {
+			continue;
+		}
+
+		if(sscanf(line, "%u %31s %u", &event->time, name, &event->len) != 3) {
+			fprintf(stderr, "%s: can't parse '%s'\n", path, line);
+			fclose(file);
+			return 0;
+		}
+
+		event->type = __parseType(name);
+
+		//Pair sends with their ACKs, they complete in order
+		if(event->type == EV_TCP_SEND) {
+			if(sendCount < 64) {
+				sendTimes[(sendFront + sendCount++) % 64] = event->time;
+			}
+		}
+		else if((event->type == EV_TCP_SENT) && (sendCount > 0)) {
+			ackTotal += event->time - sendTimes[sendFront];
+			ackCount++;
+			sendFront = (sendFront + 1) % 64;
+			sendCount--;
+		}
+
+		if((event->type == EV_UART_RX) || (event->type == EV_TCP_RECV)
+			|| (event->type == EV_CONNECT) || (event->type == EV_DISCONNECT)) {
+			if(++_eventCount == MAX_EVENTS) {
+				fprintf(stderr, "%s: too many events\n", path);
+				fclose(file);
+				return 0;
+			}
+		}
+	}
+
+	fclose(file);
+
+	if(_ackUs == 0) {
+		_ackUs = ackCount ? (uint32)(ackTotal / ackCount) : DEFAULT_ACK_US;
+	}
+
+	return 1;
+}
+
+//The ISR drains bytes once they are in the FIFO, so they started
+//arriving a few byte times earlier
+static int __byArrival(const void *a, const void *b) {
+	const struct Event *x = a, *y = b;
+
+	if(x->time != y->time) {
+		return (x->time < y->time) ? -1 : 1;
+	}
+
+	return (x < y) ? -1 : 1;
+}
+
+static void __shiftArrivals(uint32 baud) {
+	uint32 i;
+
+	for(i = 0; i < _eventCount; ++i) {
+		if(_events[i].type == EV_UART_RX) {
+			uint32 early = (uint32)((uint64)_events[i].len * 10 * 1000000 / baud);
+
+			_events[i].time = (_events[i].time > early) ? (_events[i].time - early) : 0;
+		}
+	}
+
+	qsort(_events, _eventCount, sizeof(_events[0]), __byArrival);
+}
+
+//Byte for byte, 'expected' bytes of the direction in 'stream'
+static int __delivered(const char *what, const SimStream *stream, uint32 expected, uint8 direction) {
+	uint32 i;
+
+	if(stream->len != expected) {
+		fprintf(stderr, "%s: %u of %u bytes delivered\n", what, stream->len, expected);
+		return 0;
+	}
+
+	for(i = 0; i < expected; ++i) {
+		if(stream->data[i] != __payload(i, direction)) {
+			fprintf(stderr, "%s: byte %u differs\n", what, i);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+//Latency of every byte from 'from' to 'to', and the rate over the session
+static void __measure(const SimStream *from, const SimStream *to,
+		uint32 *avgUs, uint32 *maxUs, uint32 *bps) {
+	uint64 total = 0;
+	uint32 i, max = 0, span;
+
+	*avgUs = *maxUs = *bps = 0;
+	if(to->len == 0) {
+		return;
+	}
+
+	for(i = 0; i < to->len; ++i) {
+		uint32 latency = to->time[i] - from->time[i];
+
+		total += latency;
+		if(latency > max) {
+			max = latency;
+		}
+	}
+
+	span = to->time[to->len - 1] - from->time[0];
+
+	*avgUs = total / to->len;
+	*maxUs = max;
+	*bps = span ? (uint32)((uint64)to->len * 1000000 / span) : 0;
+}
+
+static int __readBaseline(const char *path, struct Figures *figures) {
+	FILE *file = fopen(path, "r");
+	char line[128];
+	int found = 0;
+
+	if(file == NULL) {
+		perror(path);
+		return 0;
+	}
+
+	while(fgets(line, sizeof(line), file) != NULL) {
+		found += sscanf(line, "up_latency_avg_us %u", &figures->upAvgUs);
+		found += sscanf(line, "up_latency_max_us %u", &figures->upMaxUs);
+		found += sscanf(line, "up_bytes_per_s %u", &figures->upBps);
+		found += sscanf(line, "down_latency_avg_us %u", &figures->downAvgUs);
+		found += sscanf(line, "down_latency_max_us %u", &figures->downMaxUs);
+		found += sscanf(line, "down_bytes_per_s %u", &figures->downBps);
+	}
+
+	fclose(file);
+
+	return found == 6;
+}
+
+static void __writeFigures(FILE *file, const struct Figures *figures) {
+	fprintf(file,
+		"up_latency_avg_us %u\n"
+		"up_latency_max_us %u\n"
+		"up_bytes_per_s %u\n"
+		"down_latency_avg_us %u\n"
+		"down_latency_max_us %u\n"
+		"down_bytes_per_s %u\n",
+		figures->upAvgUs, figures->upMaxUs, figures->upBps,
+		figures->downAvgUs, figures->downMaxUs, figures->downBps);
+}
+
+static int __latencyOk(const char *what, uint32 value, uint32 base) {
+	uint32 limit = base + base * REPLAY_TOLERANCE / 100 + REPLAY_SLACK_US;
+
+	if(value > limit) {
+		fprintf(stderr, "%s: %u us, baseline %u us\n", what, value, base);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int __rateOk(const char *what, uint32 value, uint32 base) {
+	if(value < base - base * REPLAY_TOLERANCE / 100) {
+		fprintf(stderr, "%s: %u bytes/s, baseline %u bytes/s\n", what, value, base);
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	struct Figures figures, baseline;
+	uint32 up = 0, down = 0, baud, i;
+	uint8 connected = 0, sessions = 0, update = 0;
+	const char *tracePath, *baselinePath;
+	uint8 *data = NULL;
+	uint32 dataSize = 0;
+	int ok = 1;
+
+	if((argc > 1) && (strcmp(argv[1], "-u") == 0)) {
+		update = 1;
+		argv++;
+		argc--;
+	}
+
+	if(argc != 3) {
+		fprintf(stderr, "Usage: %s [-u] <trace> <baseline>\n", argv[0]);
+		return 2;
+	}
+	tracePath = argv[1];
+	baselinePath = argv[2];
+
+	if(!__load(tracePath)) {
+		return 2;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = _ackUs;
+
+	for(i = 0; i < _settingCount; ++i) {
+		const char *reply;
+
+		ctrl_execute(_settings[i], &reply);
+		if(strncmp(reply, "ok", 2) != 0) {
+			fprintf(stderr, "%s: %s", tracePath, reply);
+			return 2;
+		}
+	}
+	{
+		char apply[] = "apply";
+		const char *reply;
+
+		ctrl_execute(apply, &reply);
+	}
+
+	baud = UART_CLK_FREQ / (READ_PERI_REG(UART_CLKDIV(0)) & UART_CLKDIV_CNT);
+	__shiftArrivals(baud);
+
+	for(i = 0; i < _eventCount; ++i) {
+		struct Event *event = &_events[i];
+		uint32 j;
+
+		sim_runUntil(event->time);
+
+		if(event->len > dataSize) {
+			dataSize = event->len;
+			data = realloc(data, dataSize);
+		}
+
+		switch(event->type) {
+			case EV_CONNECT:
+				if(++sessions > 1) {
+					fprintf(stderr, "%s: one session per trace\n", tracePath);
+					return 2;
+				}
+				sim_tcpConnect(HOST);
+				connected = 1;
+			break;
+
+			case EV_DISCONNECT:
+				//Checked once everything is delivered
+				i = _eventCount;
+			break;
+
+			case EV_UART_RX:
+				for(j = 0; j < event->len; ++j) {
+					data[j] = __payload(up++, 0);
+				}
+				sim_uartSend(data, event->len);
+			break;
+
+			case EV_TCP_RECV:
+				if(connected) {
+					for(j = 0; j < event->len; ++j) {
+						data[j] = __payload(down++, 1);
+					}
+					sim_tcpWrite(data, event->len);
+				}
+			break;
+		}
+	}
+
+	sim_run(REPLAY_DRAIN_US);
+
+	ok &= __delivered("robot->client", &sim.tcpRx, up, 0);
+	ok &= __delivered("client->robot", &sim.uartTx, down, 1);
+
+	if(sim.uartRxLost > 0) {
+		fprintf(stderr, "robot->client: %u bytes lost in the RX FIFO\n", sim.uartRxLost);
+		ok = 0;
+	}
+
+	if(!ok) {
+		printf("%s: delivery failed\n", tracePath);
+		return 1;
+	}
+
+	__measure(&sim.uartRx, &sim.tcpRx, &figures.upAvgUs, &figures.upMaxUs, &figures.upBps);
+	__measure(&sim.tcpTx, &sim.uartTx, &figures.downAvgUs, &figures.downMaxUs, &figures.downBps);
+
+	if(update) {
+		FILE *file = fopen(baselinePath, "w");
+
+		if(file == NULL) {
+			perror(baselinePath);
+			return 2;
+		}
+
+		__writeFigures(file, &figures);
+		fclose(file);
+
+		printf("%s: baseline written\n", tracePath);
+		__writeFigures(stdout, &figures);
+
+		return 0;
+	}
+
+	if(!__readBaseline(baselinePath, &baseline)) {
+		fprintf(stderr, "%s: no usable baseline, run 'make baseline'\n", baselinePath);
+		return 2;
+	}
+
+	ok &= __latencyOk("robot->client average", figures.upAvgUs, baseline.upAvgUs);
+	ok &= __latencyOk("robot->client worst", figures.upMaxUs, baseline.upMaxUs);
+	ok &= __rateOk("robot->client", figures.upBps, baseline.upBps);
+	ok &= __latencyOk("client->robot average", figures.downAvgUs, baseline.downAvgUs);
+	ok &= __latencyOk("client->robot worst", figures.downMaxUs, baseline.downMaxUs);
+	ok &= __rateOk("client->robot", figures.downBps, baseline.downBps);
+
+	printf("%s: %u bytes up, avg %u max %u us, %u bytes/s; %u bytes down, avg %u max %u us, %u bytes/s%s\n",
+		tracePath, up, figures.upAvgUs, figures.upMaxUs, figures.upBps,
+		down, figures.downAvgUs, figures.downMaxUs, figures.downBps, ok ? "" : " - REGRESSION");
+
+	return ok ? 0 : 1;
+}
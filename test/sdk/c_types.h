@@ -0,0 +1,34 @@
+#pragma once
+
+//Stand-ins for the NONOS SDK headers, just enough for the firmware
+//sources to build and run natively. See test/sim.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef int8_t int8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef int16_t int16;
+typedef uint32_t uint32;
+typedef int32_t sint32;
+typedef int32_t int32;
+typedef uint64_t uint64;
+typedef int64_t sint64;
+
+typedef enum { OK = 0, FAIL, PENDING, BUSY, CANCEL } STATUS;
+
+#define BIT(n)	(1UL << (n))
+
+#define LOCAL	static
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define IRAM_ATTR
+#define STORE_ATTR	__attribute__((aligned(4)))
+
+#define TRUE	true
+#define FALSE	false
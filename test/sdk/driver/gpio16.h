@@ -0,0 +1,3 @@
+#pragma once
+
+//GPIO16 isn't used by the bridge
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "c_types.h"
+
+//Peripheral registers go through the simulator, which models the UART
+//FIFOs and interrupt status behind them
+uint32 sim_readReg(uint32 addr);
+void sim_writeReg(uint32 addr, uint32 value);
+
+#define READ_PERI_REG(addr)			sim_readReg((uint32)(addr))
+#define WRITE_PERI_REG(addr, val)	sim_writeReg((uint32)(addr), (uint32)(val))
+#define CLEAR_PERI_REG_MASK(reg, mask)	WRITE_PERI_REG((reg), (READ_PERI_REG(reg) & (~(mask))))
+#define SET_PERI_REG_MASK(reg, mask)	WRITE_PERI_REG((reg), (READ_PERI_REG(reg) | (mask)))
+#define SET_PERI_REG_BITS(reg, bit_map, value, shift) \
+	(WRITE_PERI_REG((reg), (READ_PERI_REG(reg) & (~((bit_map) << (shift)))) | (((value) & bit_map) << (shift))))
+
+#define UART_CLK_FREQ	(80 * 1000000)
+
+#define PERIPHS_IO_MUX			0x60000800
+#define PERIPHS_IO_MUX_FUNC		0x13
+#define PERIPHS_IO_MUX_FUNC_S	4
+#define PERIPHS_IO_MUX_MTDI_U	0x60000804
+#define PERIPHS_IO_MUX_MTCK_U	0x60000808
+#define PERIPHS_IO_MUX_MTMS_U	0x6000080C
+#define PERIPHS_IO_MUX_MTDO_U	0x60000810
+#define PERIPHS_IO_MUX_U0TXD_U	0x60000818
+#define PERIPHS_IO_MUX_GPIO2_U	0x60000838
+#define PERIPHS_IO_MUX_GPIO4_U	0x6000083C
+#define PERIPHS_IO_MUX_GPIO5_U	0x60000840
+
+#define FUNC_GPIO2		0
+#define FUNC_GPIO4		0
+#define FUNC_GPIO5		0
+#define FUNC_GPIO12		3
+#define FUNC_GPIO13		3
+#define FUNC_GPIO14		3
+#define FUNC_U0TXD		0
+#define FUNC_U0RTS		4
+#define FUNC_U1TXD_BK	2
+
+#define PIN_PULLUP_DIS(pin)			CLEAR_PERI_REG_MASK(pin, BIT(7))
+#define PIN_PULLUP_EN(pin)			SET_PERI_REG_MASK(pin, BIT(7))
+#define PIN_FUNC_SELECT(pin, func)	WRITE_PERI_REG(pin, func)
+
+#define GPIO_OUT_W1TS_ADDRESS		0x04
+#define GPIO_OUT_W1TC_ADDRESS		0x08
+#define GPIO_STATUS_ADDRESS			0x1C
+#define GPIO_STATUS_W1TC_ADDRESS	0x24
+
+#define ETS_GPIO_INUM	4
+#define ETS_UART_INUM	5
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "c_types.h"
+#include "eagle_soc.h"
+
+typedef uint32_t ETSSignal;
+typedef uint32_t ETSParam;
+
+typedef struct ETSEventTag {
+	ETSSignal sig;
+	ETSParam par;
+} ETSEvent;
+
+typedef void (*ETSTask)(ETSEvent *e);
+typedef void ETSTimerFunc(void *timer_arg);
+
+typedef struct _ETSTIMER_ {
+	struct _ETSTIMER_ *timer_next;
+	uint32_t timer_expire;
+	uint32_t timer_period;
+	ETSTimerFunc *timer_func;
+	void *timer_arg;
+} ETSTimer;
+
+void ets_isr_attach(int intr, void *handler, void *arg);
+void ets_isr_mask(unsigned intr);
+void ets_isr_unmask(unsigned intr);
+void ets_intr_lock(void);
+void ets_intr_unlock(void);
+void uart_div_modify(uint8 uart_no, uint32 div);
+
+#define ETS_INTR_LOCK()		ets_intr_lock()
+#define ETS_INTR_UNLOCK()	ets_intr_unlock()
+
+#define ETS_UART_INTR_ATTACH(func, arg)	ets_isr_attach(ETS_UART_INUM, (func), (void *)(arg))
+#define ETS_UART_INTR_ENABLE()			ets_isr_unmask(1 << ETS_UART_INUM)
+#define ETS_UART_INTR_DISABLE()			ets_isr_mask(1 << ETS_UART_INUM)
+#define ETS_GPIO_INTR_ATTACH(func, arg)	ets_isr_attach(ETS_GPIO_INUM, (func), (void *)(arg))
+#define ETS_GPIO_INTR_ENABLE()			ets_isr_unmask(1 << ETS_GPIO_INUM)
+#define ETS_GPIO_INTR_DISABLE()			ets_isr_mask(1 << ETS_GPIO_INUM)
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "c_types.h"
+#include "eagle_soc.h"
+
+#define GPIO_ID_PIN0	0
+#define GPIO_ID_PIN(n)	(GPIO_ID_PIN0 + (n))
+
+#define BIT0	1
+
+typedef enum {
+	GPIO_PIN_INTR_DISABLE = 0,
+	GPIO_PIN_INTR_POSEDGE = 1,
+	GPIO_PIN_INTR_NEGEDGE = 2,
+	GPIO_PIN_INTR_ANYEDGE = 3,
+	GPIO_PIN_INTR_LOLEVEL = 4,
+	GPIO_PIN_INTR_HILEVEL = 5
+} GPIO_INT_TYPE;
+
+#define GPIO_REG_READ(reg)			READ_PERI_REG(0x60000300 + (reg))
+#define GPIO_REG_WRITE(reg, val)	WRITE_PERI_REG(0x60000300 + (reg), val)
+
+#define GPIO_OUTPUT_SET(gpio_no, bit_value) \
+	gpio_output_set((bit_value) << gpio_no, ((~(bit_value)) & 0x01) << gpio_no, 1 << gpio_no, 0)
+#define GPIO_DIS_OUTPUT(gpio_no)	gpio_output_set(0, 0, 0, 1 << gpio_no)
+#define GPIO_INPUT_GET(gpio_no)		((gpio_input_get() >> gpio_no) & BIT0)
+
+void gpio_init(void);
+void gpio_output_set(uint32 set_mask, uint32 clear_mask, uint32 enable_mask, uint32 disable_mask);
+uint32 gpio_input_get(void);
+void gpio_pin_intr_state_set(uint32 i, GPIO_INT_TYPE intr_state);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "c_types.h"
+
+struct ip_addr {
+	uint32 addr;
+};
+
+typedef struct ip_addr ip_addr_t;
+
+struct ip_info {
+	struct ip_addr ip;
+	struct ip_addr netmask;
+	struct ip_addr gw;
+};
+
+uint32 ipaddr_addr(const char *cp);
+
+#define ip4_addr1_16(ipaddr)	((uint16)(((uint8*)(ipaddr))[0]))
+#define ip4_addr2_16(ipaddr)	((uint16)(((uint8*)(ipaddr))[1]))
+#define ip4_addr3_16(ipaddr)	((uint16)(((uint8*)(ipaddr))[2]))
+#define ip4_addr4_16(ipaddr)	((uint16)(((uint8*)(ipaddr))[3]))
+#define IP2STR(ipaddr)	ip4_addr1_16(ipaddr), ip4_addr2_16(ipaddr), ip4_addr3_16(ipaddr), ip4_addr4_16(ipaddr)
+#define IPSTR	"%d.%d.%d.%d"
+
+#define MAC2STR(a)	(a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+#define MACSTR		"%02x:%02x:%02x:%02x:%02x:%02x"
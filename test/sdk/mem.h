@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+
+void *pvPortMalloc(size_t size, const char *file, int line);
+void *pvPortZalloc(size_t size, const char *file, int line);
+void vPortFree(void *ptr, const char *file, int line);
+
+#define os_malloc(s)	pvPortMalloc(s, __FILE__, __LINE__)
+#define os_zalloc(s)	pvPortZalloc(s, __FILE__, __LINE__)
+#define os_free(s)		vPortFree(s, __FILE__, __LINE__)
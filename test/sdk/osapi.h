@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string.h>
+#include "os_type.h"
+#include "user_config.h"
+
+void ets_timer_arm_new(os_timer_t *timer, uint32 time, bool repeat, bool isMs);
+void ets_timer_disarm(os_timer_t *timer);
+void ets_timer_setfn(os_timer_t *timer, os_timer_func_t *func, void *arg);
+int ets_sprintf(char *str, const char *format, ...) __attribute__((format(printf, 2, 3)));
+int os_printf_plus(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void ets_delay_us(uint32 us);
+unsigned long os_random(void);
+
+#define os_bzero(s, n)	memset(s, 0, n)
+#define os_delay_us		ets_delay_us
+#define os_memcmp		memcmp
+#define os_memcpy		memcpy
+#define os_memmove		memmove
+#define os_memset		memset
+#define os_strcat		strcat
+#define os_strchr		strchr
+#define os_strcmp		strcmp
+#define os_strcpy		strcpy
+#define os_strlen		strlen
+#define os_strncmp		strncmp
+#define os_strncpy		strncpy
+#define os_strstr		strstr
+#define os_sprintf		ets_sprintf
+#define os_printf		os_printf_plus
+
+#define os_timer_arm(timer, ms, repeat)		ets_timer_arm_new(timer, ms, repeat, 1)
+#define os_timer_arm_us(timer, us, repeat)	ets_timer_arm_new(timer, us, repeat, 0)
+#define os_timer_disarm		ets_timer_disarm
+#define os_timer_setfn		ets_timer_setfn
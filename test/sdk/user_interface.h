@@ -0,0 +1,191 @@
+#pragma once
+
+#include "c_types.h"
+#include "ip_addr.h"
+#include "os_type.h"
+#include "spi_flash.h"
+
+#define NULL_MODE		0
+#define STATION_MODE	1
+#define SOFTAP_MODE		2
+#define STATIONAP_MODE	3
+
+#define STATION_IF	0
+#define SOFTAP_IF	1
+
+#define SYS_CPU_80MHZ	80
+#define SYS_CPU_160MHZ	160
+
+typedef enum _auth_mode {
+	AUTH_OPEN = 0,
+	AUTH_WEP,
+	AUTH_WPA_PSK,
+	AUTH_WPA2_PSK,
+	AUTH_WPA_WPA2_PSK,
+	AUTH_MAX
+} AUTH_MODE;
+
+enum sleep_type {
+	NONE_SLEEP_T = 0,
+	LIGHT_SLEEP_T,
+	MODEM_SLEEP_T
+};
+
+struct softap_config {
+	uint8 ssid[32];
+	uint8 password[64];
+	uint8 ssid_len;
+	uint8 channel;
+	AUTH_MODE authmode;
+	uint8 ssid_hidden;
+	uint8 max_connection;
+	uint16 beacon_interval;
+};
+
+struct station_config {
+	uint8 ssid[32];
+	uint8 password[64];
+	uint8 bssid_set;
+	uint8 bssid[6];
+};
+
+struct station_info {
+	struct {
+		struct station_info *stqe_next;
+	} next;
+	uint8 bssid[6];
+	struct ip_addr ip;
+};
+
+struct dhcps_lease {
+	bool enable;
+	struct ip_addr start_ip;
+	struct ip_addr end_ip;
+};
+
+struct bss_info {
+	struct {
+		struct bss_info *stqe_next;
+	} next;
+	uint8 bssid[6];
+	uint8 ssid[32];
+	uint8 ssid_len;
+	uint8 channel;
+	sint8 rssi;
+	AUTH_MODE authmode;
+	uint8 is_hidden;
+	sint16 freq_offset;
+};
+
+#define STAILQ_NEXT(elm, field)	((elm)->field.stqe_next)
+
+typedef void (*scan_done_cb_t)(void *arg, STATUS status);
+
+struct scan_config {
+	uint8 *ssid;
+	uint8 *bssid;
+	uint8 channel;
+	uint8 show_hidden;
+};
+
+enum {
+	EVENT_STAMODE_CONNECTED = 0,
+	EVENT_STAMODE_DISCONNECTED,
+	EVENT_STAMODE_AUTHMODE_CHANGE,
+	EVENT_STAMODE_GOT_IP,
+	EVENT_STAMODE_DHCP_TIMEOUT,
+	EVENT_SOFTAPMODE_STACONNECTED,
+	EVENT_SOFTAPMODE_STADISCONNECTED,
+	EVENT_SOFTAPMODE_PROBEREQRECVED,
+	EVENT_MAX
+};
+
+typedef struct {
+	uint8 ssid[32];
+	uint8 ssid_len;
+	uint8 bssid[6];
+	uint8 channel;
+} Event_StaMode_Connected_t;
+
+typedef struct {
+	uint8 ssid[32];
+	uint8 ssid_len;
+	uint8 bssid[6];
+	uint8 reason;
+} Event_StaMode_Disconnected_t;
+
+typedef struct {
+	struct ip_addr ip;
+	struct ip_addr mask;
+	struct ip_addr gw;
+} Event_StaMode_Got_IP_t;
+
+typedef struct {
+	uint8 mac[6];
+	uint8 aid;
+} Event_SoftAPMode_StaConnected_t;
+
+typedef struct {
+	uint8 mac[6];
+	uint8 aid;
+} Event_SoftAPMode_StaDisconnected_t;
+
+typedef struct {
+	int rssi;
+	uint8 mac[6];
+} Event_SoftAPMode_ProbeReqRecved_t;
+
+typedef union {
+	Event_StaMode_Connected_t connected;
+	Event_StaMode_Disconnected_t disconnected;
+	Event_StaMode_Got_IP_t got_ip;
+	Event_SoftAPMode_StaConnected_t sta_connected;
+	Event_SoftAPMode_StaDisconnected_t sta_disconnected;
+	Event_SoftAPMode_ProbeReqRecved_t ap_probereqrecved;
+} Event_Info_u;
+
+typedef struct _esp_event {
+	uint32 event;
+	Event_Info_u event_info;
+} System_Event_t;
+
+typedef void (*wifi_event_handler_cb_t)(System_Event_t *event);
+
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen);
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par);
+uint32 system_get_time(void);
+uint32 system_get_free_heap_size(void);
+void system_set_os_print(uint8 onoff);
+bool system_update_cpu_freq(uint8 freq);
+uint8 system_get_cpu_freq(void);
+uint32 system_get_chip_id(void);
+const char *system_get_sdk_version(void);
+void system_restart(void);
+
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb);
+bool wifi_set_opmode(uint8 opmode);
+bool wifi_set_opmode_current(uint8 opmode);
+uint8 wifi_get_opmode(void);
+uint8 wifi_get_opmode_default(void);
+bool wifi_softap_set_config(struct softap_config *config);
+bool wifi_softap_set_config_current(struct softap_config *config);
+bool wifi_softap_get_config(struct softap_config *config);
+bool wifi_softap_dhcps_start(void);
+bool wifi_softap_dhcps_stop(void);
+bool wifi_softap_set_dhcps_lease(struct dhcps_lease *please);
+struct station_info *wifi_softap_get_station_info(void);
+void wifi_softap_free_station_info(void);
+uint8 wifi_softap_get_station_num(void);
+bool wifi_set_ip_info(uint8 if_index, struct ip_info *info);
+bool wifi_get_ip_info(uint8 if_index, struct ip_info *info);
+bool wifi_get_macaddr(uint8 if_index, uint8 *macaddr);
+bool wifi_set_sleep_type(enum sleep_type type);
+bool wifi_station_scan(struct scan_config *config, scan_done_cb_t cb);
+bool wifi_station_set_config_current(struct station_config *config);
+bool wifi_station_connect(void);
+bool wifi_station_disconnect(void);
+bool wifi_station_set_auto_connect(uint8 set);
+bool wifi_station_set_reconnect_policy(bool set);
+bool wifi_station_dhcpc_start(void);
+bool wifi_station_set_hostname(char *name);
+sint8 wifi_station_get_rssi(void);
@@ -0,0 +1,1196 @@
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "mem.h"
+#include "gpio.h"
+#include "spi_flash.h"
+#include "driver/uart.h"
+#include "driver/uart_register.h"
+#include "user_ctrl.h"
+
+#define REG_BASE		(0x60000000)
+#define REG_COUNT		(0x800)
+
+#define GPIO_BASE		(0x60000300)
+#define SWITCH_PIN		(5)
+
+#define MAX_TIMERS		(32)
+#define MAX_TASKS		(3)
+#define MAX_UDP			(4)
+#define MAX_STATIONS	(8)
+#define MAX_INFLIGHT	(64)
+
+//Rough limits of the SDK's own buffering
+#define TCP_WINDOW		(5840)
+
+struct Sim sim;
+uint8 simFlash[SIM_FLASH_SIZE];
+
+//Defined in ROM on the chip
+UartDevice UartDev = {
+	.data_bits = EIGHT_BITS,
+	.stop_bits = ONE_STOP_BIT,
+	.parity = NONE_BITS
+};
+
+extern void user_init();
+
+static uint32 _regs[REG_COUNT];
+
+static void (*_isr[16])(void*);
+static void *_isrArg[16];
+static uint32 _masked;
+
+//UART0 model
+static struct {
+	uint8 rx[SIM_FIFO_LEN];
+	uint8 rxFront, rxCount;
+	uint8 tx[SIM_FIFO_LEN];
+	uint8 txFront, txCount;
+	uint32 raw;
+
+	SimStream line;			//Sent by the robot, not in the FIFO yet
+	uint32 lineFront;
+	uint64 rxClock, txClock;	//UART clock cycles owed to each direction
+	uint32 idleBytes;		//Byte times since the last RX byte
+	uint8 toutFired;
+} _uart;
+
+static os_timer_t *_timers[MAX_TIMERS];
+static uint8 _timerCount;
+
+static struct {
+	os_task_t task;
+	os_event_t *queue;
+	uint8 len, front, count;
+} _tasks[MAX_TASKS];
+
+static uint8 _switchIntr;
+
+static wifi_event_handler_cb_t _wifiHandler;
+static scan_done_cb_t _scanDone;
+
+//Stations associated with the SoftAP, sim.stations of them
+static struct station_info _stations[MAX_STATIONS];
+
+//TCP: the listening server and the one client connection
+static struct espconn *_server;
+static struct espconn _client;
+static esp_tcp _clientTcp;
+static uint8 _inConnect, _closePending;
+static uint16 _clientPort = 50000;
+static struct {
+	uint16 len;
+	uint32 ackTime;
+} _inflight[MAX_INFLIGHT];
+static uint8 _inflightFront;
+static uint32 _inflightBytes;
+static uint32 _tcpDelivered;	//Bytes of sim.tcpTx handed to the recv callback
+
+static struct espconn *_udp[MAX_UDP];
+static remot_info _udpRemote;
+
+static uint32 _checks, _failures;
+
+static void __step();
+static void __uartLevels();
+static void __uartTick();
+static void __deliverTcp();
+
+void sim_streamAppend(SimStream *stream, const uint8 *data, uint32 len) {
+	if(stream->len + len > stream->size) {
+		stream->size = (stream->len + len) * 2 + 4096;
+		stream->data = realloc(stream->data, stream->size);
+		stream->time = realloc(stream->time, stream->size * sizeof(uint32));
+	}
+
+	memcpy(stream->data + stream->len, data, len);
+	while(len-- > 0) {
+		stream->time[stream->len++] = sim.time;
+	}
+}
+
+void sim_boot() {
+	memset(_regs, 0, sizeof(_regs));
+	memset(simFlash, 0xFF, sizeof(simFlash));
+
+	sim.freeHeap = 40 * 1024;
+	sim.gpioIn = 0xFFFFFFFF;
+	sim.tcpWindow = TCP_WINDOW;
+
+	user_init();
+	sim_runTasks();
+}
+
+void sim_run(uint32 us) {
+	sim_runUntil(sim.time + us);
+}
+
+void sim_runUntil(uint32 time) {
+	while((int32)(time - sim.time) > 0) {
+		sim.time += SIM_TICK_US;
+		__step();
+	}
+}
+
+static void __dispatchUart() {
+	uint8 guard;
+
+	for(guard = 0; guard < 16; ++guard) {
+		__uartLevels();
+
+		if((_masked & (1 << ETS_UART_INUM)) || (_isr[ETS_UART_INUM] == NULL)
+			|| !(_uart.raw & _regs[(UART_INT_ENA(0) - REG_BASE)/4])) {
+			break;
+		}
+
+		_isr[ETS_UART_INUM](_isrArg[ETS_UART_INUM]);
+	}
+}
+
+static void __fireTimers() {
+	uint8 i, fired;
+
+	do {
+		os_timer_t *due = NULL;
+		uint8 dueIndex = 0;
+
+		for(i = 0; i < _timerCount; ++i) {
+			if(((int32)(sim.time - _timers[i]->timer_expire) >= 0)
+				&& ((due == NULL) || ((int32)(_timers[i]->timer_expire - due->timer_expire) < 0))) {
+				due = _timers[i];
+				dueIndex = i;
+			}
+		}
+
+		fired = (due != NULL);
+		if(fired) {
+			if(due->timer_period) {
+				due->timer_expire += due->timer_period;
+			}
+			else {
+				_timers[dueIndex] = _timers[--_timerCount];
+			}
+
+			due->timer_func(due->timer_arg);
+		}
+	} while(fired);
+}
+
+void __step() {
+	__uartTick();
+	__dispatchUart();
+	__fireTimers();
+
+	if(_closePending) {
+		_closePending = 0;
+		sim_tcpClose();
+	}
+
+	while(sim.tcpInflight && sim.tcpAckDelay
+		&& ((int32)(sim.time - _inflight[_inflightFront].ackTime) >= 0)) {
+		sim_tcpAck();
+	}
+
+	__deliverTcp();
+	sim_runTasks();
+}
+
+void sim_runTasks() {
+	int8 prio;
+
+	for(prio = MAX_TASKS - 1; prio >= 0; --prio) {
+		if(_tasks[prio].count > 0) {
+			os_event_t event = _tasks[prio].queue[_tasks[prio].front];
+
+			_tasks[prio].front = (_tasks[prio].front + 1) % _tasks[prio].len;
+			_tasks[prio].count--;
+
+			_tasks[prio].task(&event);
+
+			//Start over at the top, the task may have posted more
+			prio = MAX_TASKS;
+		}
+	}
+}
+
+//UART0
+
+static uint32 __byteClocks(uint32 baud) {
+	uint32 div = _regs[(UART_CLKDIV(0) - REG_BASE)/4] & UART_CLKDIV_CNT;
+
+	if(baud != 0) {
+		div = UART_CLK_FREQ / baud;
+	}
+
+	return 10 * (div ? div : 1);
+}
+
+static uint8 __baudMatches() {
+	uint32 div = _regs[(UART_CLKDIV(0) - REG_BASE)/4] & UART_CLKDIV_CNT;
+	uint32 robotDiv;
+
+	if(sim.robotBaud == 0) {
+		return 1;
+	}
+
+	robotDiv = UART_CLK_FREQ / sim.robotBaud;
+
+	//A byte survives a few percent of mismatch
+	return (div * 100 >= robotDiv * 97) && (div * 100 <= robotDiv * 103);
+}
+
+static void __rxPush(uint8 byte) {
+	if(_uart.rxCount == SIM_FIFO_LEN) {
+		sim.uartRxLost++;
+		_uart.raw |= UART_RXFIFO_OVF_INT_RAW;
+		return;
+	}
+
+	_uart.rx[(_uart.rxFront + _uart.rxCount++) % SIM_FIFO_LEN] = byte;
+	sim_streamAppend(&sim.uartRx, &byte, 1);
+
+	_uart.idleBytes = 0;
+	_uart.toutFired = 0;
+}
+
+void __uartTick() {
+	uint32 conf0 = _regs[(UART_CONF0(0) - REG_BASE)/4];
+	uint32 conf1 = _regs[(UART_CONF1(0) - REG_BASE)/4];
+	uint32 rxClocks = __byteClocks(sim.robotBaud);
+	uint32 txClocks = __byteClocks(0);
+
+	//The robot's bytes, whether anyone listens or not
+	if(_uart.lineFront < _uart.line.len) {
+		_uart.rxClock += SIM_TICK_US * (UART_CLK_FREQ / 1000000);
+
+		while((_uart.rxClock >= rxClocks) && (_uart.lineFront < _uart.line.len)) {
+			uint8 byte = _uart.line.data[_uart.lineFront++];
+
+			_uart.rxClock -= rxClocks;
+
+			if(conf0 & UART_LOOPBACK) {
+				continue;
+			}
+
+			if(!__baudMatches()) {
+				sim.uartFrameErrors++;
+				_uart.raw |= UART_FRM_ERR_INT_RAW;
+				byte ^= 0x5A;
+			}
+
+			__rxPush(byte);
+		}
+	}
+	else {
+		_uart.rxClock += SIM_TICK_US * (UART_CLK_FREQ / 1000000);
+
+		//Idle time counts in byte times
+		while(_uart.rxClock >= rxClocks) {
+			_uart.rxClock -= rxClocks;
+			_uart.idleBytes++;
+		}
+	}
+
+	if(_uart.txCount > 0) {
+		_uart.txClock += SIM_TICK_US * (UART_CLK_FREQ / 1000000);
+
+		while((_uart.txClock >= txClocks) && (_uart.txCount > 0)) {
+			uint8 byte = _uart.tx[_uart.txFront];
+
+			_uart.txFront = (_uart.txFront + 1) % SIM_FIFO_LEN;
+			_uart.txCount--;
+			_uart.txClock -= txClocks;
+
+			if(conf0 & UART_LOOPBACK) {
+				__rxPush(byte);
+			}
+			else {
+				sim_streamAppend(&sim.uartTx, &byte, 1);
+			}
+		}
+	}
+	else {
+		_uart.txClock = 0;
+	}
+
+	if((conf1 & UART_RX_TOUT_EN) && (_uart.rxCount > 0) && !_uart.toutFired
+		&& (_uart.idleBytes >= ((conf1 >> UART_RX_TOUT_THRHD_S) & UART_RX_TOUT_THRHD))) {
+		_uart.toutFired = 1;
+		_uart.raw |= UART_RXFIFO_TOUT_INT_RAW;
+	}
+}
+
+//Full and TX empty follow the FIFO levels
+void __uartLevels() {
+	uint32 conf1 = _regs[(UART_CONF1(0) - REG_BASE)/4];
+	uint32 full = (conf1 >> UART_RXFIFO_FULL_THRHD_S) & UART_RXFIFO_FULL_THRHD;
+	uint32 empty = (conf1 >> UART_TXFIFO_EMPTY_THRHD_S) & UART_TXFIFO_EMPTY_THRHD;
+
+	if((full > 0) && (_uart.rxCount >= full)) {
+		_uart.raw |= UART_RXFIFO_FULL_INT_RAW;
+	}
+	else {
+		_uart.raw &= ~UART_RXFIFO_FULL_INT_RAW;
+	}
+
+	if(_uart.txCount < empty) {
+		_uart.raw |= UART_TXFIFO_EMPTY_INT_RAW;
+	}
+	else {
+		_uart.raw &= ~UART_TXFIFO_EMPTY_INT_RAW;
+	}
+}
+
+void sim_uartSend(const uint8 *data, uint32 len) {
+	sim_streamAppend(&_uart.line, data, len);
+}
+
+void sim_uartPulses(uint16 edges, uint32 lowPulse, uint32 highPulse) {
+	uint32 *num = &_regs[(UART_PULSE_NUM(0) - REG_BASE)/4];
+	uint32 *low = &_regs[(UART_LOWPULSE(0) - REG_BASE)/4];
+	uint32 *high = &_regs[(UART_HIGHPULSE(0) - REG_BASE)/4];
+
+	if(!(_regs[(UART_AUTOBAUD(0) - REG_BASE)/4] & UART_AUTOBAUD_EN)) {
+		return;
+	}
+
+	*num = (*num + edges) & UART_PULSE_NUM_CNT;
+	if(lowPulse < *low) {
+		*low = lowPulse;
+	}
+	if(highPulse < *high) {
+		*high = highPulse;
+	}
+}
+
+uint32 sim_readReg(uint32 addr) {
+	if((addr < REG_BASE) || (addr >= REG_BASE + REG_COUNT*4)) {
+		fprintf(stderr, "read of unknown register %08x\n", addr);
+		abort();
+	}
+
+	if(addr == UART_FIFO(0)) {
+		uint8 byte = 0;
+
+		if(_uart.rxCount > 0) {
+			byte = _uart.rx[_uart.rxFront];
+			_uart.rxFront = (_uart.rxFront + 1) % SIM_FIFO_LEN;
+			_uart.rxCount--;
+		}
+
+		return byte;
+	}
+	else if(addr == UART_INT_RAW(0)) {
+		__uartLevels();
+		return _uart.raw;
+	}
+	else if(addr == UART_INT_ST(0)) {
+		__uartLevels();
+		return _uart.raw & _regs[(UART_INT_ENA(0) - REG_BASE)/4];
+	}
+	else if(addr == UART_STATUS(0)) {
+		return (_uart.rxCount << UART_RXFIFO_CNT_S) | (_uart.txCount << UART_TXFIFO_CNT_S);
+	}
+
+	return _regs[(addr - REG_BASE)/4];
+}
+
+void sim_writeReg(uint32 addr, uint32 value) {
+	if((addr < REG_BASE) || (addr >= REG_BASE + REG_COUNT*4)) {
+		fprintf(stderr, "write to unknown register %08x\n", addr);
+		abort();
+	}
+
+	if(addr == UART_FIFO(0)) {
+		if(_uart.txCount < SIM_FIFO_LEN) {
+			_uart.tx[(_uart.txFront + _uart.txCount++) % SIM_FIFO_LEN] = value;
+		}
+		return;
+	}
+	else if(addr == UART_INT_CLR(0)) {
+		_uart.raw &= ~value;
+		return;
+	}
+	else if((addr == UART_INT_RAW(0)) || (addr == UART_INT_ST(0)) || (addr == UART_STATUS(0))) {
+		return;
+	}
+	else if(addr == UART_CONF0(0)) {
+		if(value & UART_RXFIFO_RST) {
+			_uart.rxCount = 0;
+		}
+		if(value & UART_TXFIFO_RST) {
+			_uart.txCount = 0;
+		}
+	}
+	else if(addr == UART_AUTOBAUD(0)) {
+		//Enabling starts the counters over
+		if((value & UART_AUTOBAUD_EN) && !(_regs[(addr - REG_BASE)/4] & UART_AUTOBAUD_EN)) {
+			_regs[(UART_PULSE_NUM(0) - REG_BASE)/4] = 0;
+			_regs[(UART_LOWPULSE(0) - REG_BASE)/4] = UART_LOWPULSE_MIN_CNT;
+			_regs[(UART_HIGHPULSE(0) - REG_BASE)/4] = UART_HIGHPULSE_MIN_CNT;
+		}
+	}
+	else if(addr == GPIO_BASE + GPIO_STATUS_W1TC_ADDRESS) {
+		_regs[(GPIO_BASE + GPIO_STATUS_ADDRESS - REG_BASE)/4] &= ~value;
+		return;
+	}
+
+	_regs[(addr - REG_BASE)/4] = value;
+}
+
+void uart_div_modify(uint8 uart_no, uint32 div) {
+	_regs[(UART_CLKDIV(uart_no) - REG_BASE)/4] = div;
+}
+
+//Interrupts
+
+void ets_isr_attach(int intr, void *handler, void *arg) {
+	_isr[intr] = handler;
+	_isrArg[intr] = arg;
+}
+
+void ets_isr_mask(unsigned intr) {
+	_masked |= intr;
+}
+
+void ets_isr_unmask(unsigned intr) {
+	_masked &= ~intr;
+}
+
+void ets_intr_lock(void) {
+}
+
+void ets_intr_unlock(void) {
+}
+
+//Timers
+
+uint8 sim_timersArmed() {
+	return _timerCount;
+}
+
+void ets_timer_setfn(os_timer_t *timer, os_timer_func_t *func, void *arg) {
+	timer->timer_func = func;
+	timer->timer_arg = arg;
+}
+
+void ets_timer_disarm(os_timer_t *timer) {
+	uint8 i;
+
+	for(i = 0; i < _timerCount; ++i) {
+		if(_timers[i] == timer) {
+			_timers[i] = _timers[--_timerCount];
+			return;
+		}
+	}
+}
+
+void ets_timer_arm_new(os_timer_t *timer, uint32 time, bool repeat, bool isMs) {
+	uint32 us = isMs ? time * 1000 : time;
+
+	//Arming again restarts it
+	ets_timer_disarm(timer);
+
+	if(_timerCount == MAX_TIMERS) {
+		fprintf(stderr, "too many timers\n");
+		abort();
+	}
+
+	timer->timer_expire = sim.time + us;
+	timer->timer_period = repeat ? us : 0;
+	_timers[_timerCount++] = timer;
+}
+
+//Tasks
+
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen) {
+	if(prio >= MAX_TASKS) {
+		return false;
+	}
+
+	_tasks[prio].task = task;
+	_tasks[prio].queue = queue;
+	_tasks[prio].len = qlen;
+	_tasks[prio].front = _tasks[prio].count = 0;
+
+	return true;
+}
+
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par) {
+	uint8 slot;
+
+	if((prio >= MAX_TASKS) || (_tasks[prio].count >= _tasks[prio].len)) {
+		sim.postFailures++;
+		return false;
+	}
+
+	slot = (_tasks[prio].front + _tasks[prio].count++) % _tasks[prio].len;
+	_tasks[prio].queue[slot].sig = sig;
+	_tasks[prio].queue[slot].par = par;
+
+	return true;
+}
+
+//System
+
+uint32 system_get_time(void) {
+	return sim.time;
+}
+
+uint32 system_get_free_heap_size(void) {
+	return sim.freeHeap;
+}
+
+void system_set_os_print(uint8 onoff) {
+}
+
+static uint8 _cpuFreq = SYS_CPU_80MHZ;
+
+bool system_update_cpu_freq(uint8 freq) {
+	_cpuFreq = freq;
+	return true;
+}
+
+uint8 system_get_cpu_freq(void) {
+	return _cpuFreq;
+}
+
+uint32 system_get_chip_id(void) {
+	return 0x288;
+}
+
+const char* system_get_sdk_version(void) {
+	return "sim";
+}
+
+void system_restart(void) {
+	sim.restarts++;
+}
+
+int ets_sprintf(char *str, const char *format, ...) {
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsprintf(str, format, args);
+	va_end(args);
+
+	return len;
+}
+
+int os_printf_plus(const char *format, ...) {
+	return 0;
+}
+
+void ets_delay_us(uint32 us) {
+}
+
+unsigned long os_random(void) {
+	static uint32 state = 288;
+
+	state = state * 1103515245 + 12345;
+	return state >> 8;
+}
+
+void* pvPortMalloc(size_t size, const char *file, int line) {
+	return malloc(size);
+}
+
+void* pvPortZalloc(size_t size, const char *file, int line) {
+	return calloc(1, size);
+}
+
+void vPortFree(void *ptr, const char *file, int line) {
+	free(ptr);
+}
+
+//Flash, NOR semantics: writes only clear bits
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) {
+	if((sec + 1) * SPI_FLASH_SEC_SIZE > SIM_FLASH_SIZE) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	memset(simFlash + sec * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE);
+	sim.flashErases++;
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size) {
+	uint32 i;
+
+	if((des_addr + size > SIM_FLASH_SIZE) || (des_addr & 3) || (size & 3)) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	for(i = 0; i < size; ++i) {
+		simFlash[des_addr + i] &= ((uint8*)src_addr)[i];
+	}
+	sim.flashWrites++;
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size) {
+	if((src_addr + size > SIM_FLASH_SIZE) || (src_addr & 3)) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	memcpy(des_addr, simFlash + src_addr, size);
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+//GPIO
+
+void gpio_init(void) {
+}
+
+void gpio_output_set(uint32 set_mask, uint32 clear_mask, uint32 enable_mask, uint32 disable_mask) {
+}
+
+uint32 gpio_input_get(void) {
+	return sim.gpioIn;
+}
+
+void gpio_pin_intr_state_set(uint32 i, GPIO_INT_TYPE intr_state) {
+	if(i == SWITCH_PIN) {
+		_switchIntr = intr_state;
+	}
+}
+
+void sim_setSwitch(uint8 on) {
+	uint32 in = on ? (sim.gpioIn & ~(1 << SWITCH_PIN)) : (sim.gpioIn | (1 << SWITCH_PIN));
+
+	if(in == sim.gpioIn) {
+		return;
+	}
+	sim.gpioIn = in;
+
+	if((_switchIntr != GPIO_PIN_INTR_DISABLE) && !(_masked & (1 << ETS_GPIO_INUM))
+		&& (_isr[ETS_GPIO_INUM] != NULL)) {
+		_regs[(GPIO_BASE + GPIO_STATUS_ADDRESS - REG_BASE)/4] |= 1 << SWITCH_PIN;
+		_isr[ETS_GPIO_INUM](_isrArg[ETS_GPIO_INUM]);
+	}
+}
+
+//WiFi
+
+uint32 ipaddr_addr(const char *cp) {
+	uint32 a, b, c, d;
+
+	if(sscanf(cp, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
+		return 0xFFFFFFFF;
+	}
+
+	return a | (b << 8) | (c << 16) | (d << 24);
+}
+
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb) {
+	_wifiHandler = cb;
+}
+
+void sim_wifiEvent(System_Event_t *event) {
+	if(_wifiHandler != NULL) {
+		_wifiHandler(event);
+	}
+}
+
+void sim_stationJoins(const uint8 *mac, const uint8 *ip) {
+	System_Event_t event;
+
+	memcpy(_stations[sim.stations].bssid, mac, 6);
+	memcpy(&_stations[sim.stations].ip.addr, ip, 4);
+	sim.stations++;
+
+	memset(&event, 0, sizeof(event));
+	event.event = EVENT_SOFTAPMODE_STACONNECTED;
+	memcpy(event.event_info.sta_connected.mac, mac, 6);
+	event.event_info.sta_connected.aid = sim.stations;
+	sim_wifiEvent(&event);
+}
+
+void sim_stationLeaves(const uint8 *mac) {
+	System_Event_t event;
+	uint8 i;
+
+	for(i = 0; i < sim.stations; ++i) {
+		if(memcmp(_stations[i].bssid, mac, 6) == 0) {
+			memmove(&_stations[i], &_stations[i + 1],
+				(sim.stations - i - 1) * sizeof(_stations[0]));
+			sim.stations--;
+			break;
+		}
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.event = EVENT_SOFTAPMODE_STADISCONNECTED;
+	memcpy(event.event_info.sta_disconnected.mac, mac, 6);
+	sim_wifiEvent(&event);
+}
+
+void sim_stationProbes(const uint8 *mac, sint8 rssi) {
+	System_Event_t event;
+
+	memset(&event, 0, sizeof(event));
+	event.event = EVENT_SOFTAPMODE_PROBEREQRECVED;
+	event.event_info.ap_probereqrecved.rssi = rssi;
+	memcpy(event.event_info.ap_probereqrecved.mac, mac, 6);
+	sim_wifiEvent(&event);
+}
+
+bool wifi_station_scan(struct scan_config *config, scan_done_cb_t cb) {
+	_scanDone = cb;
+	return true;
+}
+
+void sim_scanDone(struct bss_info *bss) {
+	scan_done_cb_t done = _scanDone;
+
+	_scanDone = NULL;
+	if(done != NULL) {
+		done(bss, OK);
+	}
+}
+
+bool wifi_set_opmode(uint8 opmode) {
+	return true;
+}
+
+bool wifi_set_opmode_current(uint8 opmode) {
+	sim.wifiMode = opmode;
+	return true;
+}
+
+uint8 wifi_get_opmode(void) {
+	return sim.wifiMode;
+}
+
+uint8 wifi_get_opmode_default(void) {
+	return NULL_MODE;
+}
+
+bool wifi_softap_set_config(struct softap_config *config) {
+	return true;
+}
+
+bool wifi_softap_set_config_current(struct softap_config *config) {
+	return true;
+}
+
+bool wifi_softap_get_config(struct softap_config *config) {
+	memset(config, 0, sizeof(*config));
+	return true;
+}
+
+bool wifi_softap_dhcps_start(void) {
+	return true;
+}
+
+bool wifi_softap_dhcps_stop(void) {
+	return true;
+}
+
+bool wifi_softap_set_dhcps_lease(struct dhcps_lease *please) {
+	return true;
+}
+
+struct station_info* wifi_softap_get_station_info(void) {
+	uint8 i;
+
+	if(sim.stations == 0) {
+		return NULL;
+	}
+
+	for(i = 0; i + 1 < sim.stations; ++i) {
+		_stations[i].next.stqe_next = &_stations[i + 1];
+	}
+	_stations[i].next.stqe_next = NULL;
+
+	return &_stations[0];
+}
+
+void wifi_softap_free_station_info(void) {
+}
+
+uint8 wifi_softap_get_station_num(void) {
+	return sim.stations;
+}
+
+bool wifi_set_ip_info(uint8 if_index, struct ip_info *info) {
+	return true;
+}
+
+bool wifi_get_ip_info(uint8 if_index, struct ip_info *info) {
+	memset(info, 0, sizeof(*info));
+	return true;
+}
+
+bool wifi_get_macaddr(uint8 if_index, uint8 *macaddr) {
+	memset(macaddr, 0, 6);
+	return true;
+}
+
+bool wifi_set_sleep_type(enum sleep_type type) {
+	return true;
+}
+
+bool wifi_station_set_config_current(struct station_config *config) {
+	return true;
+}
+
+bool wifi_station_connect(void) {
+	return true;
+}
+
+bool wifi_station_disconnect(void) {
+	return true;
+}
+
+bool wifi_station_set_auto_connect(uint8 set) {
+	return true;
+}
+
+bool wifi_station_set_reconnect_policy(bool set) {
+	return true;
+}
+
+bool wifi_station_dhcpc_start(void) {
+	return true;
+}
+
+bool wifi_station_set_hostname(char *name) {
+	return true;
+}
+
+sint8 wifi_station_get_rssi(void) {
+	return -60;
+}
+
+//espconn
+
+sint8 espconn_accept(struct espconn *espconn) {
+	_server = espconn;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_create(struct espconn *espconn) {
+	uint8 i;
+
+	for(i = 0; i < MAX_UDP; ++i) {
+		if((_udp[i] == NULL) || (_udp[i] == espconn)) {
+			_udp[i] = espconn;
+			return ESPCONN_OK;
+		}
+	}
+
+	return ESPCONN_MAXNUM;
+}
+
+sint8 espconn_delete(struct espconn *espconn) {
+	return ESPCONN_OK;
+}
+
+//Like the SDK, the disconnect callback comes later
+sint8 espconn_disconnect(struct espconn *espconn) {
+	if((espconn != &_client) || !sim.tcpConnected) {
+		return ESPCONN_ARG;
+	}
+
+	if(_inConnect) {
+		sim.tcpBadDisconnects++;
+	}
+
+	sim.tcpDisconnects++;
+	_closePending = 1;
+
+	return ESPCONN_OK;
+}
+
+sint8 espconn_abort(struct espconn *espconn) {
+	return espconn_disconnect(espconn);
+}
+
+sint8 espconn_send(struct espconn *espconn, uint8 *psent, uint16 length) {
+	if(espconn->type == ESPCONN_UDP) {
+		sim.udpSent.localPort = espconn->proto.udp->local_port;
+		memcpy(sim.udpSent.remoteIp, espconn->proto.udp->remote_ip, 4);
+		sim.udpSent.remotePort = espconn->proto.udp->remote_port;
+		sim.udpSent.len = (length < sizeof(sim.udpSent.data)) ? length : sizeof(sim.udpSent.data);
+		memcpy(sim.udpSent.data, psent, sim.udpSent.len);
+		sim.udpSends++;
+
+		return ESPCONN_OK;
+	}
+
+	if((espconn != &_client) || !sim.tcpConnected || _closePending) {
+		return ESPCONN_ARG;
+	}
+
+	if(sim.tcpSendFail || (sim.tcpInflight == MAX_INFLIGHT)
+		|| (_inflightBytes + length > sim.tcpWindow)) {
+		return ESPCONN_MEM;
+	}
+
+	_inflight[(_inflightFront + sim.tcpInflight) % MAX_INFLIGHT].len = length;
+	_inflight[(_inflightFront + sim.tcpInflight) % MAX_INFLIGHT].ackTime = sim.time + sim.tcpAckDelay;
+	sim.tcpInflight++;
+	_inflightBytes += length;
+	sim.tcpSends++;
+
+	sim_streamAppend(&sim.tcpRx, psent, length);
+
+	return ESPCONN_OK;
+}
+
+sint8 espconn_sendto(struct espconn *espconn, uint8 *psent, uint16 length) {
+	return espconn_send(espconn, psent, length);
+}
+
+sint8 espconn_sent(struct espconn *espconn, uint8 *psent, uint16 length) {
+	return espconn_send(espconn, psent, length);
+}
+
+sint8 espconn_regist_time(struct espconn *espconn, uint32 interval, uint8 type_flag) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_connectcb(struct espconn *espconn, espconn_connect_callback connect_cb) {
+	espconn->proto.tcp->connect_callback = connect_cb;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_disconcb(struct espconn *espconn, espconn_connect_callback discon_cb) {
+	espconn->proto.tcp->disconnect_callback = discon_cb;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_reconcb(struct espconn *espconn, espconn_reconnect_callback recon_cb) {
+	espconn->proto.tcp->reconnect_callback = recon_cb;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_recvcb(struct espconn *espconn, espconn_recv_callback recv_cb) {
+	espconn->recv_callback = recv_cb;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_sentcb(struct espconn *espconn, espconn_sent_callback sent_cb) {
+	espconn->sent_callback = sent_cb;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_write_finish(struct espconn *espconn, espconn_connect_callback write_finish_fn) {
+	espconn->proto.tcp->write_finish_fn = write_finish_fn;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_set_opt(struct espconn *espconn, uint8 opt) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_clear_opt(struct espconn *espconn, uint8 opt) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_tcp_set_max_con(uint8 num) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_tcp_set_max_con_allow(struct espconn *espconn, uint8 num) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_recv_hold(struct espconn *pespconn) {
+	sim.tcpHeld = 1;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_recv_unhold(struct espconn *pespconn) {
+	sim.tcpHeld = 0;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_get_connection_info(struct espconn *pespconn, remot_info **pcon_info, uint8 typeflags) {
+	static remot_info tcpRemote;
+
+	if(pespconn->type == ESPCONN_UDP) {
+		*pcon_info = &_udpRemote;
+		return ESPCONN_OK;
+	}
+
+	tcpRemote.state = ESPCONN_CONNECT;
+	tcpRemote.remote_port = _clientTcp.remote_port;
+	memcpy(tcpRemote.remote_ip, _clientTcp.remote_ip, 4);
+	*pcon_info = &tcpRemote;
+
+	return ESPCONN_OK;
+}
+
+void espconn_mdns_init(struct mdns_info *info) {
+}
+
+void espconn_mdns_close(void) {
+}
+
+void espconn_mdns_server_register(void) {
+}
+
+void espconn_mdns_server_unregister(void) {
+}
+
+void sim_tcpConnect(const uint8 *ip) {
+	if((_server == NULL) || sim.tcpConnected) {
+		return;
+	}
+
+	memset(&_client, 0, sizeof(_client));
+	memset(&_clientTcp, 0, sizeof(_clientTcp));
+	_client.type = ESPCONN_TCP;
+	_client.state = ESPCONN_CONNECT;
+	_client.proto.tcp = &_clientTcp;
+	_clientTcp.local_port = _server->proto.tcp->local_port;
+	_clientTcp.remote_port = _clientPort++;
+	memcpy(_clientTcp.remote_ip, ip, 4);
+
+	sim.tcpConnected = 1;
+	sim.tcpHeld = 0;
+	sim.tcpInflight = 0;
+	_inflightBytes = 0;
+	_tcpDelivered = sim.tcpTx.len;
+	_closePending = 0;
+
+	_inConnect = 1;
+	_server->proto.tcp->connect_callback(&_client);
+	_inConnect = 0;
+
+	sim_runTasks();
+}
+
+void sim_tcpClose() {
+	if(!sim.tcpConnected) {
+		return;
+	}
+
+	sim.tcpConnected = 0;
+	sim.tcpInflight = 0;
+	_inflightBytes = 0;
+	_tcpDelivered = sim.tcpTx.len;
+
+	if(_clientTcp.disconnect_callback != NULL) {
+		_clientTcp.disconnect_callback(&_client);
+	}
+
+	sim_runTasks();
+}
+
+void __deliverTcp() {
+	while(sim.tcpConnected && !sim.tcpHeld && !_closePending && (_tcpDelivered < sim.tcpTx.len)) {
+		uint32 len = sim.tcpTx.len - _tcpDelivered;
+
+		if(len > SIM_TCP_MSS) {
+			len = SIM_TCP_MSS;
+		}
+
+		_tcpDelivered += len;
+		_client.recv_callback(&_client, (char*)sim.tcpTx.data + _tcpDelivered - len, len);
+	}
+}
+
+void sim_tcpWrite(const uint8 *data, uint32 len) {
+	sim_streamAppend(&sim.tcpTx, data, len);
+
+	__deliverTcp();
+	sim_runTasks();
+}
+
+uint8 sim_tcpAck() {
+	if(!sim.tcpConnected || (sim.tcpInflight == 0)) {
+		return 0;
+	}
+
+	_inflightBytes -= _inflight[_inflightFront].len;
+	_inflightFront = (_inflightFront + 1) % MAX_INFLIGHT;
+	sim.tcpInflight--;
+
+	_client.sent_callback(&_client);
+	sim_runTasks();
+
+	return 1;
+}
+
+void sim_udpReceive(uint16 localPort, const uint8 *ip, uint16 remotePort,
+		const uint8 *data, uint16 len) {
+	uint8 i;
+
+	_udpRemote.state = ESPCONN_NONE;
+	_udpRemote.remote_port = remotePort;
+	memcpy(_udpRemote.remote_ip, ip, 4);
+
+	for(i = 0; i < MAX_UDP; ++i) {
+		if((_udp[i] != NULL) && (_udp[i]->proto.udp->local_port == localPort)) {
+			_udp[i]->recv_callback(_udp[i], (char*)data, len);
+			break;
+		}
+	}
+
+	sim_runTasks();
+}
+
+const char* sim_ctrl(const uint8 *ip, const char *command) {
+	static char reply[sizeof(sim.udpSent.data) + 1];
+	uint32 sends = sim.udpSends;
+
+	sim_udpReceive(CTRL_PORT, ip, 40000, (const uint8*)command, strlen(command));
+
+	if((sim.udpSends == sends) || (sim.udpSent.localPort != CTRL_PORT)) {
+		return NULL;
+	}
+
+	memcpy(reply, sim.udpSent.data, sim.udpSent.len);
+	reply[sim.udpSent.len] = '\0';
+
+	return reply;
+}
+
+uint8 sim_field(const char *reply, const char *key, uint32 *value) {
+	size_t keyLen = strlen(key);
+	const char *line;
+
+	for(line = reply; (line != NULL) && (*line != '\0'); line = strchr(line, '\n')) {
+		if(*line == '\n') {
+			line++;
+		}
+
+		if((strncmp(line, key, keyLen) == 0) && (line[keyLen] == '=')) {
+			*value = strtoul(line + keyLen + 1, NULL, 10);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+//Checks
+
+void sim_check(int ok, const char *expr, const char *file, int line) {
+	_checks++;
+
+	if(!ok) {
+		_failures++;
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+	}
+}
+
+int sim_done(const char *name) {
+	printf("%s: %u checks, %u failed\n", name, _checks, _failures);
+
+	return (_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "c_types.h"
+#include "os_type.h"
+#include "espconn.h"
+#include "user_interface.h"
+
+//Native stand-in for the chip and SDK the firmware runs on
+//
+//The firmware sources are built unchanged against the headers in sdk/.
+//Register accesses land in a model of UART0: an RX line feeding a 128
+//byte FIFO at the configured baud rate, a TX FIFO draining at the same
+//rate, and the full, timeout, TX empty, overflow and frame error
+//interrupts derived from them. Timers expire in simulated time, task
+//queues have the length the firmware gave them (so posts can fail), and
+//espconn is replaced by a single TCP client and UDP datagrams that tests
+//drive directly.
+//
+//Time only moves in sim_run(), in SIM_TICK_US steps. Each step shifts
+//bytes on the UART lines, runs the UART interrupt while it has work,
+//fires due timers, acknowledges sends, then runs queued tasks.
+
+#define SIM_TICK_US		(10)
+
+#define SIM_FIFO_LEN	(128)
+
+#define SIM_FLASH_SIZE	(0x80000)
+
+//Largest segment lwIP hands to a receive callback
+#define SIM_TCP_MSS		(1460)
+
+//Bytes seen at one end of the bridge, with the time each one got there
+typedef struct {
+	uint8 *data;
+	uint32 *time;
+	uint32 len;
+	uint32 size;
+} SimStream;
+
+typedef struct {
+	uint16 localPort;
+	uint8 remoteIp[4];
+	uint16 remotePort;
+	uint16 len;
+	uint8 data[1500];
+} SimDatagram;
+
+struct Sim {
+	uint32 time;			//What system_get_time() returns, µs
+
+	uint32 freeHeap;
+	uint32 gpioIn;			//All high: switch off, device ID 0
+	uint8 stations;			//Associated with the SoftAP, see sim_stationJoins()
+	uint8 wifiMode;
+	uint32 restarts;
+
+	//UART0
+	uint32 robotBaud;		//Rate the robot sends at, 0: whatever the bridge uses
+	SimStream uartTx;		//Bytes that left the TX FIFO towards the robot
+	SimStream uartRx;		//Bytes that made it into the RX FIFO
+	uint32 uartRxLost;		//Arrived with the FIFO full
+	uint32 uartFrameErrors;	//Arrived at the wrong rate
+
+	//TCP client
+	uint8 tcpConnected;
+	uint8 tcpHeld;
+	uint8 tcpSendFail;		//Refuse every send with ESPCONN_MEM
+	uint32 tcpWindow;		//Unacknowledged bytes lwIP takes before refusing
+	uint32 tcpAckDelay;		//µs until a send is acknowledged, 0: sim_tcpAck() only
+	uint32 tcpInflight;		//Sends not acknowledged yet
+	uint32 tcpSends;
+	uint32 tcpDisconnects;	//Closed by the bridge
+	uint32 tcpBadDisconnects;	//espconn_disconnect() inside the connect callback
+	SimStream tcpRx;		//Everything the client received
+	SimStream tcpTx;		//Everything the client wrote, timed when written
+
+	//UDP, the last datagram the bridge sent
+	SimDatagram udpSent;
+	uint32 udpSends;
+
+	uint32 postFailures;	//system_os_post() found a queue full
+
+	uint32 flashErases;
+	uint32 flashWrites;
+};
+
+extern struct Sim sim;
+extern uint8 simFlash[SIM_FLASH_SIZE];
+
+//Power on: blank registers, erased flash, then user_init() and its tasks
+void sim_boot();
+
+void sim_run(uint32 us);
+void sim_runUntil(uint32 time);
+
+//Run queued tasks without moving time
+void sim_runTasks();
+
+//Timers armed right now, each one wakes the chip when it expires
+uint8 sim_timersArmed();
+
+//Bytes the robot sends, they arrive one byte time apart after whatever
+//is still on the line
+void sim_uartSend(const uint8 *data, uint32 len);
+
+//Line activity seen by the autobaud counters while autobaud is enabled
+void sim_uartPulses(uint16 edges, uint32 lowPulse, uint32 highPulse);
+
+void sim_tcpConnect(const uint8 *ip);
+void sim_tcpClose();
+
+//Client data, delivered in MSS sized pieces unless receive is held
+void sim_tcpWrite(const uint8 *data, uint32 len);
+
+//Acknowledge the oldest unacknowledged send, returns 0 if there is none
+uint8 sim_tcpAck();
+
+//A datagram from ip:remotePort to the bridge's localPort
+void sim_udpReceive(uint16 localPort, const uint8 *ip, uint16 remotePort,
+	const uint8 *data, uint16 len);
+
+//Sends one control command from 'ip' and returns the NUL terminated
+//reply, or NULL if the bridge didn't answer
+const char* sim_ctrl(const uint8 *ip, const char *command);
+
+//Reads "key=<decimal>" from a control reply, returns 0 if it isn't there
+uint8 sim_field(const char *reply, const char *key, uint32 *value);
+
+//The power switch on GPIO5, with the edge interrupt if it is enabled
+void sim_setSwitch(uint8 on);
+
+void sim_wifiEvent(System_Event_t *event);
+
+//A station associating with the SoftAP and getting 'ip' from DHCP, or
+//leaving it, with the events the SDK would raise
+void sim_stationJoins(const uint8 *mac, const uint8 *ip);
+void sim_stationLeaves(const uint8 *mac);
+
+//A probe request from 'mac', associated or not, received at 'rssi' dBm
+void sim_stationProbes(const uint8 *mac, sint8 rssi);
+void sim_scanDone(struct bss_info *bss);
+
+void sim_streamAppend(SimStream *stream, const uint8 *data, uint32 len);
+
+//Counts failed checks, sim_done() returns the exit status
+#define CHECK(cond)	sim_check((cond), #cond, __FILE__, __LINE__)
+
+void sim_check(int ok, const char *expr, const char *file, int line);
+int sim_done(const char *name);
@@ -0,0 +1,91 @@
+//Autobaud doesn't lock on a window of bytes without one bit pulses, and
+//gives up on a quiet line
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "driver/uart.h"
+#include "user_autobaud.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static uint32 field(const char *command, const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, command), key, &value));
+	return value;
+}
+
+static uint8 state(const char *name) {
+	char line[32];
+
+	snprintf(line, sizeof(line), "\nautobaud=%s\n", name);
+	return strstr(sim_ctrl(HOST, "discover"), line) != NULL;
+}
+
+//One measurement window: the shortest pulse is 'bits' bit times
+static void window(uint32 baud, uint8 bits) {
+	sim_uartPulses(AUTOBAUD_MIN_EDGES + 4, bits * (UART_CLK_FREQ / baud), 2 * (UART_CLK_FREQ / baud));
+	sim_run(AUTOBAUD_POLL_MS * 1000 * 2);
+}
+
+int main() {
+	const uint8 data[] = "hello robot\n";
+	uint8 garbage[64];
+	uint32 timers, errors;
+
+	memset(garbage, 0x55, sizeof(garbage));
+
+	sim_boot();
+	sim.robotBaud = 115200;
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	timers = sim_timersArmed();
+
+	CHECK(strncmp(sim_ctrl(HOST, "set autobaud 1"), "ok", 2) == 0);
+	CHECK(strncmp(sim_ctrl(HOST, "set baud 57600"), "ok", 2) == 0);
+	sim_ctrl(HOST, "apply");
+	CHECK(state("detecting"));
+
+	//What the robot sends meanwhile stays off the link, even while the
+	//client's data keeps TX busy
+	sim_uartSend(garbage, sizeof(garbage));
+	sim_tcpWrite(garbage, sizeof(garbage));
+	sim_run(100000);
+	CHECK(sim.uartTx.len == sizeof(garbage));
+	CHECK(sim.tcpRx.len == 0);
+	CHECK(state("detecting"));
+
+	//The first bytes only had two bit pulses, that's 57600
+	window(115200, 2);
+	CHECK(state("detecting"));
+	window(115200, 1);
+	CHECK(state("detecting"));
+	window(115200, 1);
+	CHECK(state("locked"));
+	CHECK(field("discover", "baud") == UART_CLK_FREQ / (UART_CLK_FREQ / 115200));
+	CHECK(sim_timersArmed() == timers);
+
+	errors = sim.uartFrameErrors;
+	sim_uartSend(data, sizeof(data) - 1);
+	sim_run(2000000);
+	CHECK(sim.uartFrameErrors == errors);
+
+	//Nothing on the line, 'baud' it is
+	timers = sim_timersArmed();
+	sim_ctrl(HOST, "apply");
+	CHECK(state("detecting"));
+	CHECK(sim_timersArmed() > timers);
+	sim_run(AUTOBAUD_TIMEOUT_MS * 1000 - 100000);
+	CHECK(state("detecting"));
+	timers = sim_timersArmed();
+	sim_run(200000);
+	CHECK(state("timeout"));
+	CHECK(field("discover", "baud") == UART_CLK_FREQ / (UART_CLK_FREQ / 57600));
+
+	//The poll timer is all that went away
+	CHECK(sim_timersArmed() == timers - 1);
+
+	return sim_done("test_autobaud");
+}
@@ -0,0 +1,101 @@
+//Capture log: blocks reach flash even when the task queue is full, and
+//nothing keeps waking the chip while no block is open
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "driver/uart.h"
+#include "user_capture.h"
+#include "user_config.h"
+
+//Does nothing in the background task, only takes up a queue slot
+#define SIG_FILLER	0xEE
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static uint32 field(const char *command, const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, command), key, &value));
+	return value;
+}
+
+//Block 'sequence' as the download would have it
+static const uint8* block(uint32 sequence) {
+	return simFlash + CAPTURE_SECTOR_FIRST * 4096 + sequence * CAPTURE_BLOCK_LEN;
+}
+
+//The UART data in the block, whichever batches the records came in
+static uint8 holds(uint32 sequence, const uint8 *data, uint16 len) {
+	const uint8 *b = block(sequence);
+	uint16 used = b[6] | (b[7] << 8);
+	uint16 at = CAPTURE_BLOCK_HEADER, got = 0;
+
+	if((b[0] != sequence) || (used > CAPTURE_BLOCK_LEN - CAPTURE_BLOCK_HEADER)) {
+		return 0;
+	}
+
+	while(at < CAPTURE_BLOCK_HEADER + used) {
+		uint16 count = b[at + 4] | (b[at + 5] << 8);
+
+		if((got + count > len) || (memcmp(b + at + CAPTURE_RECORD_HEADER, data + got, count) != 0)) {
+			return 0;
+		}
+		got += count;
+		at += CAPTURE_RECORD_HEADER + count;
+	}
+
+	return got == len;
+}
+
+int main() {
+	uint8 data[100], twice[200];
+	uint32 timers, failures, i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 3;
+	}
+	memcpy(twice, data, sizeof(data));
+	memcpy(twice + sizeof(data), data, sizeof(data));
+
+	//Whatever the UART path itself leaves armed
+	sim_boot();
+	sim_uartSend(data, sizeof(data));
+	sim_run(CAPTURE_FLUSH_MS * 1000 * 2);
+	timers = sim_timersArmed();
+
+	//Turning it on doesn't arm anything yet. The data the UART still
+	//holds from before goes into the log first.
+	CHECK(strncmp(sim_ctrl(HOST, "capture all"), "ok\ncapture=all\n", 15) == 0);
+	sim_run(1000000);
+	CHECK(sim_timersArmed() == timers);
+
+	//An open block has its flush timer and the clock, a written one none
+	sim_uartSend(data, sizeof(data));
+	sim_run(100000);
+	CHECK(sim_timersArmed() > timers);
+	sim_run(CAPTURE_FLUSH_MS * 1000 * 2);
+	CHECK(field("capture", "capture_blocks") == 1);
+	CHECK(holds(0, twice, sizeof(twice)));
+	CHECK(sim_timersArmed() == timers);
+
+	//The flush finds the task queue full, the block is written anyway
+	failures = field("stats tasks", "post_failures");
+	sim_uartSend(data, 50);
+	for(i = 0; i < CAPTURE_FLUSH_MS * 1000 * 2 / SIM_TICK_US; ++i) {
+		while(system_os_post(UART_ERR_TASK_PRIORITY, SIG_FILLER, 0)) {
+		}
+		sim_run(SIM_TICK_US);
+	}
+	CHECK(field("stats tasks", "post_failures") > failures);
+	CHECK(field("capture", "capture_blocks") == 1);
+
+	sim_run(100000);
+	CHECK(field("capture", "capture_blocks") == 2);
+	CHECK(holds(1, data, 50));
+	CHECK(field("capture", "capture_dropped") == 0);
+	CHECK(sim_timersArmed() == timers);
+
+	return sim_done("test_capture");
+}
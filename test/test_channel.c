@@ -0,0 +1,117 @@
+//Channel selection from scan tables, built natively without the SDK
+//stand-ins to keep channel_score.c free of SDK dependencies
+//
+//Each table is what wifi_station_scan() reports as channel and RSSI
+//per AP, in the situations the bridge meets: a quiet room, a lab where
+//the campus network sits on 1, 6 and 11, and a row of bots on the same
+//bench.
+
+#include <stdio.h>
+
+#include "channel_score.h"
+
+struct ScanEntry {
+	uint8 channel;
+	sint8 rssi;
+};
+
+static const uint8 CANDIDATES[] = {1, 6, 11};
+
+static const struct ScanEntry CAMPUS[] = {
+	{1, -48}, {1, -61}, {1, -70}, {1, -83},
+	{6, -52}, {6, -66}, {6, -74},
+	{11, -77}, {11, -85},
+	{3, -88}, {9, -90}
+};
+
+//Another bridge right next to this one on 6, the rest far away. 6 is
+//five channels from 1 and 11, so it doesn't spill into them at all.
+static const struct ScanEntry BENCH[] = {
+	{6, -35},
+	{1, -80}, {11, -82}
+};
+
+//Close to even: 11 is slightly better, not by the switch margin
+static const struct ScanEntry EVEN[] = {
+	{1, -70}, {6, -71}, {11, -73}
+};
+
+//A loud AP on 3 spills into both 1 and 6, but 1 is closer
+static const struct ScanEntry OFF_GRID[] = {
+	{3, -40}, {11, -75}
+};
+
+//Channels outside 1..14 have to be ignored, not written out of bounds
+static const struct ScanEntry GARBAGE[] = {
+	{0, -40}, {15, -40}, {255, -40}
+};
+
+static int checks, failures;
+
+#define CHECK(cond)	check((cond), #cond, __LINE__)
+
+static void check(int ok, const char *expr, int line) {
+	checks++;
+
+	if(!ok) {
+		failures++;
+		fprintf(stderr, "test_channel.c:%d: check failed: %s\n", line, expr);
+	}
+}
+
+static uint8 choose(const struct ScanEntry *table, uint8 count, uint8 current) {
+	ChannelScores scores;
+	uint8 i;
+
+	ChannelScore_reset(&scores);
+	for(i = 0; i < count; ++i) {
+		ChannelScore_add(&scores, table[i].channel, table[i].rssi);
+	}
+
+	return ChannelScore_best(&scores, CANDIDATES, sizeof(CANDIDATES), current);
+}
+
+#define CHOOSE(table, current)	choose(table, sizeof(table) / sizeof(table[0]), current)
+
+int main() {
+	ChannelScores scores;
+	uint8 i;
+
+	//Nothing heard: the first candidate, or stay where we are
+	CHECK(choose(NULL, 0, 0) == 1);
+	CHECK(choose(NULL, 0, 6) == 6);
+
+	CHECK(CHOOSE(CAMPUS, 0) == 11);
+	CHECK(CHOOSE(CAMPUS, 1) == 11);
+	CHECK(CHOOSE(CAMPUS, 11) == 11);
+
+	CHECK(CHOOSE(BENCH, 0) == 11);
+	CHECK(CHOOSE(BENCH, 6) == 11);
+
+	//Hysteresis keeps a bot on its channel for a marginal gain
+	CHECK(CHOOSE(EVEN, 0) == 11);
+	CHECK(CHOOSE(EVEN, 1) == 1);
+	CHECK(CHOOSE(EVEN, 6) == 6);
+
+	CHECK(CHOOSE(OFF_GRID, 0) == 6);
+	CHECK(CHOOSE(OFF_GRID, 11) == 11);
+
+	ChannelScore_reset(&scores);
+	for(i = 0; i < sizeof(GARBAGE) / sizeof(GARBAGE[0]); ++i) {
+		ChannelScore_add(&scores, GARBAGE[i].channel, GARBAGE[i].rssi);
+	}
+	for(i = 0; i <= CHANNEL_COUNT; ++i) {
+		CHECK(scores.score[i] == 0);
+	}
+
+	//The weakest signal still counts
+	ChannelScore_reset(&scores);
+	ChannelScore_add(&scores, 6, -128);
+	CHECK(scores.score[6] > 0);
+	CHECK(scores.score[2] > 0);
+	CHECK(scores.score[1] == 0);
+
+	printf("test_channel: %d checks, %d failed\n", checks, failures);
+
+	return (failures == 0) ? 0 : 1;
+}
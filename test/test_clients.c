@@ -0,0 +1,82 @@
+//Stations on the AP: the session follows its station, and each one's
+//RSSI comes from its probe requests
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+//Long enough for the debounce timer and the AP to come up
+#define SETTLE_US	2000000
+
+static const uint8 HOST[4] = {192, 168, 4, 2};
+static const uint8 OTHER[4] = {192, 168, 4, 3};
+static const uint8 HOST_MAC[6] = {0x02, 0, 0, 0, 0, 0x02};
+static const uint8 OTHER_MAC[6] = {0x02, 0, 0, 0, 0, 0x03};
+static const uint8 STRANGER_MAC[6] = {0x02, 0, 0, 0, 0, 0x04};
+
+static uint32 wifiField(const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, "stats wifi"), key, &value));
+	return value;
+}
+
+static uint8 listed(const char *line) {
+	const char *reply = sim_ctrl(HOST, "stations");
+
+	return (reply != NULL) && (strstr(reply, line) != NULL);
+}
+
+int main() {
+	uint32 disconnects;
+
+	sim_boot();
+
+	sim_setSwitch(1);
+	sim_run(SETTLE_US);
+	sim_scanDone(NULL);
+	sim_run(SETTLE_US);
+	CHECK((sim.wifiMode & SOFTAP_MODE) != 0);
+
+	sim_stationJoins(HOST_MAC, HOST);
+	sim_stationJoins(OTHER_MAC, OTHER);
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+
+	CHECK(listed("192.168.4.2 session\n"));
+	CHECK(listed("192.168.4.3 idle\n"));
+	CHECK(wifiField("sessions_dropped") == 0);
+
+	//RSSI as of the last probe request, and how old it is
+	sim_stationProbes(HOST_MAC, -48);
+	sim_stationProbes(STRANGER_MAC, -80);
+	sim_run(3000000);
+	sim_stationProbes(OTHER_MAC, -71);
+	CHECK(listed("192.168.4.2 session rssi=-48 rssi_age=3\n"));
+	CHECK(listed("192.168.4.3 idle rssi=-71 rssi_age=0\n"));
+	CHECK(!listed("rssi=-80"));
+
+	//Idle stations are left alone
+	sim_run(60000000);
+	CHECK(sim.stations == 2);
+	CHECK(sim.tcpConnected);
+
+	sim_stationLeaves(OTHER_MAC);
+	CHECK(sim.tcpConnected);
+	CHECK(wifiField("sessions_dropped") == 0);
+
+	//The session's station leaving closes the session right away
+	disconnects = sim.tcpDisconnects;
+	sim_stationLeaves(HOST_MAC);
+	sim_run(100000);
+	CHECK(sim.tcpDisconnects == disconnects + 1);
+	CHECK(!sim.tcpConnected);
+	CHECK(wifiField("sessions_dropped") == 1);
+
+	//A station that comes back starts without an RSSI
+	sim_stationJoins(OTHER_MAC, OTHER);
+	CHECK(listed("192.168.4.3 idle\n"));
+
+	return sim_done("test_clients");
+}
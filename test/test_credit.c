@@ -0,0 +1,130 @@
+//Credit mode: framed data and credits to the client, and switching the
+//framing only between sessions
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "user_frame.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+//What the client got in frames from 'from' on
+static struct {
+	uint8 data[4096];
+	uint32 len;
+	uint32 credits;			//Credit frames
+	uint32 limit;			//Last credit limit
+	uint8 bad;				//Something that isn't a data or credit frame
+} _rx;
+
+static void parse(uint32 from) {
+	const uint8 *p = sim.tcpRx.data + from;
+	const uint8 *end = sim.tcpRx.data + sim.tcpRx.len;
+
+	memset(&_rx, 0, sizeof(_rx));
+
+	while(p + FRAME_HEADER_LEN <= end) {
+		uint16 len = (p[2] << 8) | p[3];
+
+		if((p[1] != 0) || (p + FRAME_HEADER_LEN + len > end)) {
+			_rx.bad = 1;
+			return;
+		}
+
+		if((p[0] == FRAME_DATA) && (_rx.len + len <= sizeof(_rx.data))) {
+			memcpy(_rx.data + _rx.len, p + FRAME_HEADER_LEN, len);
+			_rx.len += len;
+		}
+		else if((p[0] == FRAME_CREDIT) && (len == FRAME_CREDIT_LEN)) {
+			_rx.credits++;
+			_rx.limit = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+		}
+		else {
+			_rx.bad = 1;
+			return;
+		}
+
+		p += FRAME_HEADER_LEN + len;
+	}
+
+	if(p != end) {
+		_rx.bad = 1;
+	}
+}
+
+static const char* command(const char *line) {
+	const char *reply = sim_ctrl(HOST, line);
+
+	return reply ? reply : "";
+}
+
+int main() {
+	uint8 data[3000];
+	uint32 start, limit, i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 17;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	//A raw session, switching to credit mode doesn't change it
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	CHECK(strncmp(command("set credit 1"), "ok", 2) == 0);
+	CHECK(strstr(command("apply"), "framing=next session\n") != NULL);
+
+	sim_uartSend(data, 100);
+	sim_run(100000);
+	CHECK(sim.tcpRx.len == 100);
+	CHECK(memcmp(sim.tcpRx.data, data, 100) == 0);
+
+	//UART data left over from the raw session has no room for a header
+	sim_tcpClose();
+	sim_run(100000);
+	sim_uartSend(data, 50);
+	sim_run(100000);
+
+	//The next one is framed, and starts with credits
+	start = sim.tcpRx.len;
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	CHECK(sim.tcpRx.len == start + FRAME_HEADER_LEN + FRAME_CREDIT_LEN);
+	parse(start);
+	CHECK(!_rx.bad && (_rx.credits == 1) && (_rx.len == 0));
+	limit = _rx.limit;
+	CHECK(limit > 0);
+
+	sim_uartSend(data, sizeof(data));
+	sim_run(500000);
+	parse(start);
+	CHECK(!_rx.bad);
+	CHECK((_rx.len == sizeof(data)) && (memcmp(_rx.data, data, sizeof(data)) == 0));
+
+	//Client data the UART has taken is granted again
+	sim_tcpWrite(data, 2000);
+	sim_run(500000);
+	CHECK(sim.uartTx.len == 2000);
+	parse(start);
+	CHECK(!_rx.bad && (_rx.credits > 1));
+	CHECK(_rx.limit >= limit + 2000);
+	CHECK(sim_field(command("stats"), "credit_frames", &i) && (i == _rx.credits));
+
+	//Without a client the change is immediate
+	sim_tcpClose();
+	sim_run(100000);
+	CHECK(strncmp(command("set credit 0"), "ok", 2) == 0);
+	CHECK(strcmp(command("apply"), "ok\n") == 0);
+
+	start = sim.tcpRx.len;
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	sim_uartSend(data, 100);
+	sim_run(100000);
+	CHECK(sim.tcpRx.len == start + 100);
+	CHECK(memcmp(sim.tcpRx.data + start, data, 100) == 0);
+
+	return sim_done("test_credit");
+}
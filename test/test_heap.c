@@ -0,0 +1,47 @@
+//Clients refused for low heap are closed outside the connect callback
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "user_heap.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static uint32 field(const char *command, const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, command), key, &value));
+	return value;
+}
+
+int main() {
+	uint32 disconnects;
+
+	sim_boot();
+	sim_run(100000);
+
+	//Refused, but espconn only hears about it after the callback
+	sim.freeHeap = HEAP_CRITICAL_WATER - 1024;
+	disconnects = sim.tcpDisconnects;
+	sim_tcpConnect(HOST);
+	CHECK(sim.tcpBadDisconnects == 0);
+	sim_run(100000);
+	CHECK(sim.tcpDisconnects == disconnects + 1);
+	CHECK(!sim.tcpConnected);
+	CHECK(field("heap", "heap_rejected") == 1);
+
+	//A refused client that leaves first doesn't take the next one with it
+	disconnects = sim.tcpDisconnects;
+	sim_tcpConnect(HOST);
+	sim_tcpClose();
+	sim.freeHeap = 40 * 1024;
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	CHECK(sim.tcpConnected);
+	CHECK(sim.tcpDisconnects == disconnects);
+	CHECK(sim.tcpBadDisconnects == 0);
+	CHECK(field("heap", "heap_rejected") == 2);
+
+	return sim_done("test_heap");
+}
@@ -0,0 +1,95 @@
+//Line mode: segments end on a delimiter, or on the deadline for a line
+//that never gets one
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "driver/uart_register.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+//flush_ms below
+#define DEADLINE_US	20000
+
+//Where the bridge sent the byte at 'index' of what the robot sent, 0 if
+//it hasn't
+static uint32 delay(uint32 index) {
+	if(index >= sim.tcpRx.len) {
+		return 0;
+	}
+
+	return sim.tcpRx.time[index] - sim.uartRx.time[index];
+}
+
+static uint32 pathField(const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, "stats path"), key, &value));
+	return value;
+}
+
+int main() {
+	static const char LINES[] = "hello\nworld\n";
+	static const char PARTIAL[] = "no end";
+	static const char SEMI[] = "a;";
+	uint32 start, sends, timeout;
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	CHECK(strncmp(sim_ctrl(HOST, "set flush 1"), "ok", 2) == 0);
+	CHECK(strncmp(sim_ctrl(HOST, "set flush_ms 20"), "ok", 2) == 0);
+	CHECK(strncmp(sim_ctrl(HOST, "apply"), "ok", 2) == 0);
+
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+
+	//Each line goes out as soon as its delimiter is in
+	sends = sim.tcpSends;
+	sim_uartSend((const uint8*)LINES, 6);
+	sim_run(10000);
+	sim_uartSend((const uint8*)LINES + 6, 6);
+	sim_run(100000);
+	CHECK(sim.tcpRx.len == strlen(LINES));
+	CHECK(memcmp(sim.tcpRx.data, LINES, strlen(LINES)) == 0);
+	CHECK(sim.tcpSends == sends + 2);
+	CHECK((delay(5) > 0) && (delay(5) < DEADLINE_US / 4));
+	CHECK((delay(11) > 0) && (delay(11) < DEADLINE_US / 4));
+	CHECK(pathField("line_flushes") == 2);
+	CHECK(pathField("deadline_flushes") == 0);
+
+	//The RX timeout doesn't cut a line short, the deadline does
+	start = sim.tcpRx.len;
+	sim_uartSend((const uint8*)PARTIAL, strlen(PARTIAL));
+	sim_run(100000);
+	CHECK(sim.tcpRx.len == start + strlen(PARTIAL));
+	CHECK(sim.tcpRx.time[start] == sim.tcpRx.time[sim.tcpRx.len - 1]);
+	CHECK(delay(sim.tcpRx.len - 1) + 1000 >= DEADLINE_US);
+	CHECK(delay(sim.tcpRx.len - 1) < DEADLINE_US + 10000);
+	CHECK(pathField("line_flushes") == 2);
+	CHECK(pathField("deadline_flushes") == 1);
+
+	//Other delimiters
+	CHECK(strncmp(sim_ctrl(HOST, "set delims 3b0a"), "ok", 2) == 0);
+	CHECK(strncmp(sim_ctrl(HOST, "apply"), "ok", 2) == 0);
+
+	start = sim.tcpRx.len;
+	sim_uartSend((const uint8*)SEMI, strlen(SEMI));
+	sim_run(100000);
+	CHECK(sim.tcpRx.len == start + strlen(SEMI));
+	CHECK((delay(start + 1) > 0) && (delay(start + 1) < DEADLINE_US / 4));
+	CHECK(pathField("line_flushes") == 3);
+	CHECK(pathField("deadline_flushes") == 1);
+
+	//Packet mode's short RX timeout doesn't outlive it
+	timeout = READ_PERI_REG(UART_CONF1(0)) & (UART_RX_TOUT_THRHD << UART_RX_TOUT_THRHD_S);
+	CHECK(strncmp(sim_ctrl(HOST, "set flush 2"), "ok", 2) == 0);
+	CHECK(strncmp(sim_ctrl(HOST, "apply"), "ok", 2) == 0);
+	CHECK((READ_PERI_REG(UART_CONF1(0)) & (UART_RX_TOUT_THRHD << UART_RX_TOUT_THRHD_S)) != timeout);
+	CHECK(strncmp(sim_ctrl(HOST, "set flush 1"), "ok", 2) == 0);
+	CHECK(strncmp(sim_ctrl(HOST, "apply"), "ok", 2) == 0);
+	CHECK((READ_PERI_REG(UART_CONF1(0)) & (UART_RX_TOUT_THRHD << UART_RX_TOUT_THRHD_S)) == timeout);
+
+	return sim_done("test_line");
+}
@@ -0,0 +1,160 @@
+//Mux mode: data, control and stats channels over the one connection,
+//without credits
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "user_frame.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+//What the client got on each channel from 'from' on
+static struct {
+	uint8 data[4096];
+	uint32 dataLen;
+	char control[512];
+	char stats[1024];		//The last stats report
+	uint32 statsCount;
+	uint8 bad;
+} _rx;
+
+static void parse(uint32 from) {
+	const uint8 *p = sim.tcpRx.data + from;
+	const uint8 *end = sim.tcpRx.data + sim.tcpRx.len;
+
+	memset(&_rx, 0, sizeof(_rx));
+
+	while(p + FRAME_HEADER_LEN <= end) {
+		uint16 len = (p[2] << 8) | p[3];
+		const uint8 *payload = p + FRAME_HEADER_LEN;
+
+		if((p[1] != 0) || (payload + len > end)) {
+			_rx.bad = 1;
+			return;
+		}
+
+		switch(p[0]) {
+			case FRAME_DATA:
+				if(_rx.dataLen + len <= sizeof(_rx.data)) {
+					memcpy(_rx.data + _rx.dataLen, payload, len);
+				}
+				_rx.dataLen += len;
+				break;
+
+			case FRAME_CONTROL:
+				if(strlen(_rx.control) + len < sizeof(_rx.control)) {
+					strncat(_rx.control, (const char*)payload, len);
+				}
+				break;
+
+			case FRAME_STATS:
+				if(len < sizeof(_rx.stats)) {
+					memcpy(_rx.stats, payload, len);
+					_rx.stats[len] = '\0';
+				}
+				_rx.statsCount++;
+				break;
+
+			case FRAME_LOG:
+				break;
+
+			default:
+				_rx.bad = 1;
+				return;
+		}
+
+		p = payload + len;
+	}
+
+	if(p != end) {
+		_rx.bad = 1;
+	}
+}
+
+static void sendFrame(uint8 channel, const void *payload, uint16 len) {
+	uint8 frame[FRAME_HEADER_LEN + 1500];
+
+	frame[0] = channel;
+	frame[1] = 0;
+	frame[2] = len >> 8;
+	frame[3] = len & 0xFF;
+	memcpy(frame + FRAME_HEADER_LEN, payload, len);
+
+	sim_tcpWrite(frame, FRAME_HEADER_LEN + len);
+}
+
+int main() {
+	uint8 data[1000];
+	const char *reply;
+	uint32 value, i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 5;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	CHECK(strncmp(sim_ctrl(HOST, "set mux 1"), "ok", 2) == 0);
+	CHECK(strcmp(sim_ctrl(HOST, "apply"), "ok\n") == 0);
+
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	CHECK(sim.tcpRx.len == 0);
+
+	//Data both ways, in data frames
+	sendFrame(FRAME_DATA, data, sizeof(data));
+	sim_uartSend(data, sizeof(data));
+	sim_run(500000);
+	CHECK((sim.uartTx.len == sizeof(data)) && (memcmp(sim.uartTx.data, data, sizeof(data)) == 0));
+	parse(0);
+	CHECK(!_rx.bad);
+	CHECK((_rx.dataLen == sizeof(data)) && (memcmp(_rx.data, data, sizeof(data)) == 0));
+
+	//Commands on the control channel
+	sendFrame(FRAME_CONTROL, "get mux", 7);
+	sim_run(100000);
+	parse(0);
+	CHECK(strcmp(_rx.control, "ok\nmux=1\n") == 0);
+
+	sendFrame(FRAME_CONTROL, "stats wifi", 10);
+	sim_run(100000);
+	parse(0);
+	CHECK(strstr(_rx.control, "ap_start_us=") != NULL);
+
+	//A poll on the control port doesn't take the TX line time away from
+	//the next pushed report
+	sim_run(1000000);
+	reply = sim_ctrl(HOST, "stats");
+	CHECK(sim_field(reply, "uart_tx_util_pct", &value) && (value > 0));
+	sendFrame(FRAME_STATS, "", 0);
+	sim_run(10000);
+	parse(0);
+	CHECK(_rx.statsCount == 1);
+	CHECK(sim_field(_rx.stats, "uart_tx_util_pct", &value) && (value > 0));
+	CHECK(sim_field(_rx.stats, "uart_tx", &value) && (value == sizeof(data)));
+
+	//Nor the other way around
+	sendFrame(FRAME_DATA, data, sizeof(data));
+	sim_run(1000000);
+	sendFrame(FRAME_STATS, "", 0);
+	sim_run(10000);
+	parse(0);
+	CHECK(sim_field(_rx.stats, "uart_tx_util_pct", &value) && (value > 0));
+	reply = sim_ctrl(HOST, "stats");
+	CHECK(sim_field(reply, "uart_tx_util_pct", &value) && (value > 0));
+
+	//Pushed every 200 ms until stopped
+	sendFrame(FRAME_STATS, "200", 3);
+	sim_run(1050000);
+	parse(0);
+	CHECK(_rx.statsCount == 2 + 5);
+	sendFrame(FRAME_STATS, "0", 1);
+	sim_run(1000000);
+	parse(0);
+	CHECK(_rx.statsCount == 2 + 5);
+	CHECK(!_rx.bad);
+
+	return sim_done("test_mux");
+}
@@ -0,0 +1,117 @@
+//Packet mode: each gap on the line ends one packet, sent over TCP or as
+//a datagram to the session's host once it subscribes
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "user_settings.h"
+
+//Well above the 30 bit times that end a packet
+#define GAP_US		10000
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+static const uint8 OTHER[4] = {192, 168, 1, 3};
+
+static uint32 pathField(const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, "stats path"), key, &value));
+	return value;
+}
+
+static void subscribe(const uint8 *ip) {
+	sim_udpReceive(TCP_PORT, ip, 40001, (const uint8*)"hi", 2);
+	sim_runTasks();
+}
+
+int main() {
+	uint8 data[600];
+	uint32 sends, udpSends, rxLen, i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 7;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	CHECK(strncmp(sim_ctrl(HOST, "set flush 2"), "ok", 2) == 0);
+	CHECK(strncmp(sim_ctrl(HOST, "apply"), "ok", 2) == 0);
+
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+
+	//One send per packet, however long
+	sends = sim.tcpSends;
+	sim_uartSend(data, 10);
+	sim_run(GAP_US);
+	sim_uartSend(data + 10, 20);
+	sim_run(GAP_US);
+	sim_uartSend(data + 30, 200);
+	sim_run(GAP_US * 5);
+	CHECK(sim.tcpRx.len == 230);
+	CHECK(memcmp(sim.tcpRx.data, data, 230) == 0);
+	CHECK(sim.tcpSends == sends + 3);
+	CHECK(pathField("uart_packets") == 3);
+
+	//Someone else can't take the packets away from the session
+	subscribe(OTHER);
+	udpSends = sim.udpSends;
+	sim_uartSend(data, 16);
+	sim_run(GAP_US);
+	CHECK(sim.udpSends == udpSends);
+	CHECK(sim.tcpRx.len == 246);
+
+	//The session's own host can
+	subscribe(HOST);
+	rxLen = sim.tcpRx.len;
+	sim_uartSend(data, 16);
+	sim_run(GAP_US);
+	CHECK(sim.udpSends == udpSends + 1);
+	CHECK(sim.udpSent.localPort == TCP_PORT);
+	CHECK(memcmp(sim.udpSent.remoteIp, HOST, 4) == 0);
+	CHECK((sim.udpSent.len == 16) && (memcmp(sim.udpSent.data, data, 16) == 0));
+
+	sim_uartSend(data + 16, 40);
+	sim_run(GAP_US);
+	CHECK(sim.udpSends == udpSends + 2);
+	CHECK((sim.udpSent.len == 40) && (memcmp(sim.udpSent.data, data + 16, 40) == 0));
+	CHECK(sim.tcpRx.len == rxLen);
+	CHECK(pathField("uart_packets") == 6);
+
+	//Longer than the line mode deadline, still one datagram
+	udpSends = sim.udpSends;
+	sim_uartSend(data, sizeof(data));
+	sim_run(GAP_US * 10);
+	CHECK(sim.udpSends == udpSends + 1);
+	CHECK((sim.udpSent.len == sizeof(data)) && (memcmp(sim.udpSent.data, data, sizeof(data)) == 0));
+	CHECK(pathField("uart_packets") == 7);
+
+	//The subscription ends with the session
+	sim_tcpClose();
+	sim_run(100000);
+	udpSends = sim.udpSends;
+	sim_uartSend(data, 16);
+	sim_run(GAP_US);
+	CHECK(sim.udpSends == udpSends);
+
+	//And a new session has to subscribe again
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	rxLen = sim.tcpRx.len;
+	sim_uartSend(data, 16);
+	sim_run(GAP_US);
+	CHECK(sim.udpSends == udpSends);
+	CHECK(sim.tcpRx.len > rxLen);
+
+	//And over TCP
+	sends = sim.tcpSends;
+	rxLen = sim.tcpRx.len;
+	sim_uartSend(data, sizeof(data));
+	sim_run(GAP_US * 10);
+	CHECK(sim.tcpSends == sends + 1);
+	CHECK(sim.tcpRx.len == rxLen + sizeof(data));
+
+	return sim_done("test_packet");
+}
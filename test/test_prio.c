@@ -0,0 +1,121 @@
+//Urgent messages overtake bulk data only at message boundaries
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define ESC		27
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+static const uint8 URGENT[] = {ESC, 4, 'S', 'T', 'O', 'P'};
+
+//Most of a refill has to go out before the rest arrives
+#define PART_US		5000
+
+static uint8 ok(const char *command) {
+	const char *reply = sim_ctrl(HOST, command);
+
+	return (reply != NULL) && (strncmp(reply, "ok", 2) == 0);
+}
+
+static uint32 statsField(const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, "stats"), key, &value));
+	return value;
+}
+
+//Offset of the urgent message in what the robot got, or -1
+static int urgentAt(uint32 from) {
+	uint32 i;
+
+	for(i = from; i + 4 <= sim.uartTx.len; ++i) {
+		if(memcmp(sim.uartTx.data + i, URGENT + 2, 4) == 0) {
+			return i - from;
+		}
+	}
+
+	return -1;
+}
+
+int main() {
+	uint8 bulk[400];
+	uint32 start, i;
+
+	for(i = 0; i < sizeof(bulk); ++i) {
+		bulk[i] = 'a' + i % 26;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	CHECK(ok("set prio_esc 27"));
+	CHECK(ok("apply"));
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+
+	//Nothing queued, so it goes straight out
+	sim_tcpWrite(URGENT, sizeof(URGENT));
+	sim_run(10000);
+	CHECK(sim.uartTx.len == 4);
+	CHECK(urgentAt(0) == 0);
+	CHECK(statsField("prio") == 1);
+
+	//Without lines the bridge can't see message ends, so it only
+	//overtakes once everything received before it is out
+	start = sim.uartTx.len;
+	sim_tcpWrite(bulk, 300);
+	sim_run(PART_US);
+	CHECK(sim.uartTx.len < start + 300);
+	sim_tcpWrite(URGENT, sizeof(URGENT));
+	sim_tcpWrite(bulk + 300, 100);
+	sim_run(100000);
+	CHECK(sim.uartTx.len == start + 404);
+	CHECK(urgentAt(start) == 400);
+	CHECK(memcmp(sim.uartTx.data + start, bulk, 400) == 0);
+
+	//In line mode it goes in after the line being written, ahead of the
+	//lines queued behind it
+	CHECK(ok("set flush 1"));
+	CHECK(ok("apply"));
+	bulk[199] = '\n';
+	bulk[299] = '\n';
+	bulk[399] = '\n';
+
+	start = sim.uartTx.len;
+	sim_tcpWrite(bulk, 150);
+	sim_run(PART_US);
+	CHECK(sim.uartTx.len < start + 150);
+	sim_tcpWrite(URGENT, sizeof(URGENT));
+	sim_tcpWrite(bulk + 150, 250);
+	sim_run(100000);
+	CHECK(sim.uartTx.len == start + 404);
+	CHECK(urgentAt(start) == 200);
+	CHECK(memcmp(sim.uartTx.data + start, bulk, 200) == 0);
+	CHECK(memcmp(sim.uartTx.data + start + 204, bulk + 200, 200) == 0);
+	CHECK(statsField("prio") == 3);
+
+	//Running out of tokens right at the end of the data isn't a reason to
+	//come back for more
+	CHECK(ok("set flush 0"));
+	CHECK(ok("set rate_down 1"));
+	CHECK(ok("set burst 1460"));
+	CHECK(ok("apply"));
+	sim_run(2000000);
+	for(i = 0; i + sizeof(bulk) <= 1460; i += sizeof(bulk)) {
+		sim_tcpWrite(bulk, sizeof(bulk));
+	}
+	sim_tcpWrite(bulk, 1460 - i);
+	sim_run(300000);
+	CHECK(statsField("rate_limited_down") == 0);
+
+	//But it is with data left
+	for(i = 0; i < 3; ++i) {
+		sim_tcpWrite(bulk, sizeof(bulk));
+	}
+	sim_run(300000);
+	CHECK(statsField("rate_limited_down") > 0);
+
+	return sim_done("test_prio");
+}
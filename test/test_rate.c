@@ -0,0 +1,95 @@
+//Rate limits in both directions: a burst right away, then the rate
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define RATE	4000
+#define BURST	1460
+#define LEN		6000
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static uint8 ok(const char *command) {
+	const char *reply = sim_ctrl(HOST, command);
+
+	return (reply != NULL) && (strncmp(reply, "ok", 2) == 0);
+}
+
+static uint32 statsField(const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, "stats"), key, &value));
+	return value;
+}
+
+//µs from the first to the last byte of 'stream' from 'from' on
+static uint32 duration(const SimStream *stream, uint32 from) {
+	return stream->time[stream->len - 1] - stream->time[from];
+}
+
+//What LEN bytes take at RATE after the first BURST, within 10%
+static uint8 limited(uint32 us) {
+	uint32 expected = (uint64)(LEN - BURST) * 1000000 / RATE;
+
+	return (us > expected - expected / 10) && (us < expected + expected / 10);
+}
+
+int main() {
+	uint8 data[LEN];
+	uint32 start, i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 11;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	CHECK(ok("set rate_up 4000"));
+	CHECK(ok("set rate_down 4000"));
+	CHECK(ok("set burst 1460"));
+	CHECK(ok("apply"));
+
+	sim_tcpConnect(HOST);
+	sim_run(1000000);
+
+	//UART->TCP
+	sim_uartSend(data, LEN);
+	sim_run(3000000);
+	CHECK(sim.tcpRx.len == LEN);
+	CHECK(memcmp(sim.tcpRx.data, data, LEN) == 0);
+	CHECK(sim.uartRxLost == 0);
+	CHECK(limited(duration(&sim.tcpRx, 0)));
+	CHECK(statsField("rate_limited_up") > 0);
+	CHECK(statsField("rate_delay_up_ms") > 0);
+
+	//TCP->UART
+	sim_tcpWrite(data, LEN);
+	sim_run(3000000);
+	CHECK(sim.uartTx.len == LEN);
+	CHECK(memcmp(sim.uartTx.data, data, LEN) == 0);
+	CHECK(limited(duration(&sim.uartTx, 0)));
+	CHECK(statsField("rate_limited_down") > 0);
+	CHECK(statsField("rate_delay_down_ms") > 0);
+
+	//0 takes the limits off again, the UART is the limit then
+	CHECK(ok("set rate_up 0"));
+	CHECK(ok("set rate_down 0"));
+	CHECK(ok("apply"));
+
+	start = sim.tcpRx.len;
+	sim_uartSend(data, LEN);
+	sim_run(1000000);
+	CHECK(sim.tcpRx.len == start + LEN);
+	CHECK(duration(&sim.tcpRx, start) < (uint64)LEN * 10 * 1000000 / 115200 + 10000);
+
+	start = sim.uartTx.len;
+	sim_tcpWrite(data, LEN);
+	sim_run(1000000);
+	CHECK(sim.uartTx.len == start + LEN);
+	CHECK(duration(&sim.uartTx, start) < (uint64)LEN * 10 * 1000000 / 115200 + 10000);
+
+	return sim_done("test_rate");
+}
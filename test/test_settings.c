@@ -0,0 +1,120 @@
+//Settings over the control port and their two flash copies
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "user_settings.h"
+
+#define SECTOR_SIZE	4096
+
+//Sequence number, after magic, version and length
+#define SEQUENCE_OFFSET	8
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static uint8 replyIs(const char *command, const char *expected) {
+	const char *reply = sim_ctrl(HOST, command);
+
+	return (reply != NULL) && (strcmp(reply, expected) == 0);
+}
+
+static uint32 sequence(uint16 sector) {
+	uint32 seq;
+
+	memcpy(&seq, simFlash + sector * SECTOR_SIZE + SEQUENCE_OFFSET, sizeof(seq));
+	return seq;
+}
+
+int main() {
+	uint32 erases;
+
+	sim_boot();
+
+	//Blank flash: defaults, and nothing written at boot
+	CHECK(settings.baud == BAUD);
+	CHECK(settings.tcpPort == TCP_PORT);
+	CHECK(strcmp(settings.psk, AP_PSK) == 0);
+	CHECK(sim.flashErases == 0);
+	CHECK(sim.flashWrites == 0);
+
+	CHECK(replyIs("get baud", "ok\nbaud=115200\n"));
+	CHECK(replyIs("get psk", "ok\npsk=********\n"));
+	CHECK(replyIs("get nonsense", "error unknown key\n"));
+
+	CHECK(replyIs("set baud 230400", "ok\n"));
+	CHECK(replyIs("set baud 12x", "error invalid\n"));
+	CHECK(replyIs("set baud 100", "error invalid\n"));
+	CHECK(replyIs("set psk short", "error invalid\n"));
+
+	//A rejected value leaves the old one
+	CHECK(settings.baud == 230400);
+	CHECK(strcmp(settings.psk, AP_PSK) == 0);
+
+	CHECK(replyIs("set ssid lab bot 3", "ok\n"));
+	CHECK(replyIs("set delims 0a3e", "ok\n"));
+	CHECK(replyIs("get delims", "ok\ndelims=0a3e\n"));
+	CHECK(settings.baud == 230400);
+	CHECK(strcmp(settings.ssid, "lab bot 3") == 0);
+
+	//Saves alternate between the sectors, the older copy is overwritten
+	erases = sim.flashErases;
+	CHECK(replyIs("save", "ok 1\n"));
+	CHECK(sim.flashErases == erases + 1);
+	CHECK(sequence(SETTINGS_SECTOR_A) == 1);
+
+	CHECK(replyIs("set port 2000", "ok\n"));
+	CHECK(replyIs("save", "ok 2\n"));
+	CHECK(sequence(SETTINGS_SECTOR_A) == 1);
+	CHECK(sequence(SETTINGS_SECTOR_B) == 2);
+
+	//What the next boot reads
+	settings_reset();
+	settings_init();
+	CHECK(settings.baud == 230400);
+	CHECK(settings.tcpPort == 2000);
+	CHECK(strcmp(settings.ssid, "lab bot 3") == 0);
+
+	//A save torn halfway leaves the previous copy
+	simFlash[SETTINGS_SECTOR_B * SECTOR_SIZE + 40] ^= 1;
+	settings_init();
+	CHECK(settings.baud == 230400);
+	CHECK(settings.tcpPort == TCP_PORT);
+
+	//And the next save goes over the broken copy, not the good one
+	CHECK(replyIs("set port 3000", "ok\n"));
+	CHECK(replyIs("save", "ok 2\n"));
+	CHECK(sequence(SETTINGS_SECTOR_A) == 1);
+	CHECK(sequence(SETTINGS_SECTOR_B) == 2);
+	settings_init();
+	CHECK(settings.tcpPort == 3000);
+
+	//Both broken: defaults
+	simFlash[SETTINGS_SECTOR_A * SECTOR_SIZE + 40] ^= 1;
+	simFlash[SETTINGS_SECTOR_B * SECTOR_SIZE + 40] ^= 1;
+	settings_init();
+	CHECK(settings.baud == BAUD);
+	CHECK(settings.tcpPort == TCP_PORT);
+
+	//'defaults' only touches RAM until saved
+	CHECK(replyIs("set baud 9600", "ok\n"));
+	CHECK(replyIs("defaults", "ok\n"));
+	CHECK(settings.baud == BAUD);
+
+	//Every key reads back
+	{
+		const char *reply = sim_ctrl(HOST, "get");
+		const char *key;
+		uint8 i;
+
+		CHECK((reply != NULL) && (strncmp(reply, "ok\n", 3) == 0));
+		for(i = 0; (key = settings_key(i)) != NULL; ++i) {
+			char line[40];
+
+			snprintf(line, sizeof(line), "\n%s=", key);
+			CHECK(strstr(reply, line) != NULL);
+		}
+	}
+
+	return sim_done("test_settings");
+}
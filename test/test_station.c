@@ -0,0 +1,94 @@
+//Station mode: joining, falling back to the AP, and who may change
+//settings while joined
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+//Long enough for the debounce timer and the AP to come up
+#define SETTLE_US	2000000
+
+//A little more than the join timeout
+#define JOIN_US		16000000
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+static const uint8 OTHER[4] = {192, 168, 1, 3};
+
+static uint8 replied(const uint8 *ip, const char *command, const char *expected) {
+	const char *reply = sim_ctrl(ip, command);
+
+	return (reply != NULL) && (strncmp(reply, expected, strlen(expected)) == 0);
+}
+
+static void gotIp() {
+	System_Event_t event;
+
+	memset(&event, 0, sizeof(event));
+	event.event = EVENT_STAMODE_GOT_IP;
+	event.event_info.got_ip.ip.addr = 0x0A01A8C0;
+
+	sim_wifiEvent(&event);
+}
+
+static uint32 wifiField(const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, "stats wifi"), key, &value));
+	return value;
+}
+
+int main() {
+	uint32 joinUs;
+
+	sim_boot();
+
+	//Not joined yet, so anyone may
+	CHECK(replied(OTHER, "set sta_ssid lab", "ok"));
+
+	sim_setSwitch(1);
+	sim_run(SETTLE_US);
+	CHECK(sim.wifiMode == STATION_MODE);
+	CHECK(wifiField("sta_join_us") == 0);
+
+	gotIp();
+	joinUs = wifiField("sta_join_us");
+	CHECK((joinUs > 0) && (joinUs <= SETTLE_US));
+	CHECK(wifiField("sta_fallbacks") == 0);
+
+	//Joined, and nobody holds the session
+	CHECK(replied(HOST, "set baud 230400", "error not allowed"));
+	CHECK(replied(OTHER, "save", "error not allowed"));
+	CHECK(replied(OTHER, "reboot", "error not allowed"));
+	CHECK(replied(OTHER, "apply", "error not allowed"));
+	CHECK(replied(OTHER, "test on", "error not allowed"));
+	CHECK(replied(OTHER, "get baud", "ok"));
+	CHECK(replied(OTHER, "stats", "ok"));
+	CHECK(replied(OTHER, "discover", "ok"));
+	CHECK(sim.restarts == 0);
+
+	//Only the session's own host may
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+	CHECK(replied(OTHER, "set baud 230400", "error not allowed"));
+	CHECK(replied(HOST, "set baud 230400", "ok"));
+	CHECK(replied(HOST, "get baud", "ok\nbaud=230400"));
+
+	sim_tcpClose();
+	sim_run(100000);
+	CHECK(replied(HOST, "set baud 115200", "error not allowed"));
+
+	//Without an IP in time the AP takes over, and anyone may again
+	sim_setSwitch(0);
+	sim_run(SETTLE_US);
+	sim_setSwitch(1);
+	sim_run(JOIN_US);
+	sim_scanDone(NULL);
+	sim_run(SETTLE_US);
+	CHECK((sim.wifiMode & SOFTAP_MODE) != 0);
+	CHECK(wifiField("sta_join_us") == 0);
+	CHECK(wifiField("sta_fallbacks") == 1);
+	CHECK(replied(OTHER, "set baud 115200", "ok"));
+
+	return sim_done("test_station");
+}
@@ -0,0 +1,63 @@
+//The 'stats' report and its sections
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+int main() {
+	uint8 data[2000];
+	const char *reply;
+	uint32 value, max, i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 13;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+
+	sim_uartSend(data, sizeof(data));
+	sim_tcpWrite(data, 500);
+	sim_run(500000);
+
+	CHECK(sim.tcpRx.len == sizeof(data));
+	CHECK(sim.uartTx.len == 500);
+
+	reply = sim_ctrl(HOST, "stats");
+	CHECK((reply != NULL) && (strncmp(reply, "ok\n", 3) == 0));
+	CHECK(sim_field(reply, "uart_rx", &value) && (value == sizeof(data)));
+	CHECK(sim_field(reply, "tcp_tx", &value) && (value == sizeof(data)));
+
+	//UART data is copied out of the FIFO and by lwIP, nowhere else
+	reply = sim_ctrl(HOST, "stats path");
+	CHECK((reply != NULL) && (strncmp(reply, "ok\n", 3) == 0));
+	CHECK(sim_field(reply, "bytes_copied", &value) && (value == 2 * sizeof(data)));
+
+	//Each direction went through its task
+	reply = sim_ctrl(HOST, "stats tasks");
+	CHECK((reply != NULL) && (strncmp(reply, "ok\n", 3) == 0));
+	CHECK(sim_field(reply, "rx_events", &value) && (value > 0));
+	CHECK(sim_field(reply, "tx_events", &value) && (value > 0));
+	CHECK(sim_field(reply, "bg_events", &value));
+	CHECK(sim_field(reply, "rx_max_us", &max) && sim_field(reply, "rx_avg_us", &value) && (value <= max));
+	CHECK(sim_field(reply, "post_failures", &value) && (value == sim.postFailures));
+
+	//Traffic switched to performance, and the running interval counts
+	reply = sim_ctrl(HOST, "stats governor");
+	CHECK((reply != NULL) && (strncmp(reply, "ok\n", 3) == 0));
+	CHECK(sim_field(reply, "governor_transitions", &value) && (value >= 1));
+	CHECK(sim_field(reply, "performance_ms", &value) && (value > 0));
+	CHECK(sim_field(reply, "powersave_ms", &max));
+	CHECK(value + max >= sim.time / 1000 - 1);
+
+	reply = sim_ctrl(HOST, "stats nonsense");
+	CHECK((reply != NULL) && (strncmp(reply, "error", 5) == 0));
+
+	return sim_done("test_stats");
+}
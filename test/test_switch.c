@@ -0,0 +1,114 @@
+//Switch edges, including one that arrives with the background queue full
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "osapi.h"
+#include "driver/uart.h"
+
+//Does nothing in the background task, only takes up a queue slot
+#define SIG_FILLER	0xEE
+
+//Long enough for the debounce timer and the AP to come up
+#define SETTLE_US	2000000
+
+//What a channel scan takes
+#define SCAN_US		1500000
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static uint8 apRunning() {
+	return (sim.wifiMode & SOFTAP_MODE) != 0;
+}
+
+static void stationJoins() {
+	System_Event_t event;
+
+	memset(&event, 0, sizeof(event));
+	event.event = EVENT_SOFTAPMODE_STACONNECTED;
+	event.event_info.sta_connected.mac[5] = 2;
+	event.event_info.sta_connected.aid = 1;
+
+	sim_wifiEvent(&event);
+}
+
+//Within a millisecond, the switch edge is picked up a tick later
+static uint8 near(uint32 us, uint32 expected) {
+	return (us + 1000 > expected) && (us < expected + 1000);
+}
+
+//Bring-up times from 'stats wifi'
+static void bringUp(uint32 *ap, uint32 *sta, uint32 *tcp) {
+	const char *reply = sim_ctrl(HOST, "stats wifi");
+
+	CHECK((reply != NULL) && (strncmp(reply, "ok\n", 3) == 0));
+	CHECK(sim_field(reply, "ap_start_us", ap));
+	CHECK(sim_field(reply, "sta_connect_us", sta));
+	CHECK(sim_field(reply, "tcp_connect_us", tcp));
+}
+
+int main() {
+	uint32 failures, ap, sta, tcp;
+	uint8 i;
+
+	sim_boot();
+	CHECK(!apRunning());
+
+	//The first switch-on scans for a channel before starting the AP
+	sim_setSwitch(1);
+	sim_run(SCAN_US);
+	sim_scanDone(NULL);
+	sim_run(SETTLE_US);
+	CHECK(apRunning());
+
+	//Each bring-up step is timed from the switch edge
+	stationJoins();
+	sim_run(100000);
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+
+	bringUp(&ap, &sta, &tcp);
+	CHECK(near(ap, SCAN_US));
+	CHECK(near(sta, SCAN_US + SETTLE_US));
+	CHECK(near(tcp, SCAN_US + SETTLE_US + 100000));
+
+	sim_tcpClose();
+	sim_setSwitch(0);
+	sim_run(SETTLE_US);
+	CHECK(!apRunning());
+
+	//And start over at the next switch-on, which reuses the channel
+	sim_setSwitch(1);
+	sim_run(SETTLE_US);
+	bringUp(&ap, &sta, &tcp);
+	CHECK((ap < 1000) && (sta == 0) && (tcp == 0));
+
+	sim_setSwitch(0);
+	sim_run(SETTLE_US);
+
+	//Nothing runs tasks in between, so the edge finds the queue full
+	failures = sim.postFailures;
+	for(i = 0; i < 8; ++i) {
+		system_os_post(UART_ERR_TASK_PRIORITY, SIG_FILLER, 0);
+	}
+	CHECK(sim.postFailures > failures);
+
+	failures = sim.postFailures;
+	sim_setSwitch(1);
+	CHECK(sim.postFailures == failures + 1);
+
+	sim_run(SETTLE_US);
+	CHECK(apRunning());
+
+	//And the interrupt is back on afterwards
+	sim_setSwitch(0);
+	sim_run(SETTLE_US);
+	CHECK(!apRunning());
+
+	sim_setSwitch(1);
+	sim_run(SETTLE_US);
+	CHECK(apRunning());
+
+	return sim_done("test_switch");
+}
@@ -0,0 +1,100 @@
+//Test modes: each one leaves a different leg of the path out
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+static uint8 setMode(const char *command) {
+	const char *reply = sim_ctrl(HOST, command);
+
+	return (reply != NULL) && (strncmp(reply, "ok\n", 3) == 0);
+}
+
+static uint32 testField(const char *key) {
+	uint32 value = 0xFFFFFFFF;
+
+	CHECK(sim_field(sim_ctrl(HOST, "test"), key, &value));
+	return value;
+}
+
+int main() {
+	uint8 data[3000];
+	const char *reply;
+	uint32 rxLen, txLen, i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 31;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	sim_tcpConnect(HOST);
+	sim_run(100000);
+
+	reply = sim_ctrl(HOST, "test");
+	CHECK((reply != NULL) && (strncmp(reply, "ok\ntest=off\n", 12) == 0));
+	CHECK(!setMode("test nonsense"));
+
+	//Echo: straight back, the robot sees nothing
+	CHECK(setMode("test echo"));
+	sim_tcpWrite(data, sizeof(data));
+	sim_run(200000);
+	CHECK(sim.tcpRx.len == sizeof(data));
+	CHECK(memcmp(sim.tcpRx.data, data, sizeof(data)) == 0);
+	CHECK(sim.uartTx.len == 0);
+	CHECK(testField("tcp_rx") == sizeof(data));
+	CHECK(testField("tcp_tx") == sizeof(data));
+	CHECK(testField("acks") > 0);
+
+	//Loopback: the full trip through both FIFOs, still not to the robot
+	CHECK(setMode("test loopback"));
+	rxLen = sim.tcpRx.len;
+	sim_tcpWrite(data, 1000);
+	sim_run(500000);
+	CHECK(sim.tcpRx.len == rxLen + 1000);
+	CHECK(memcmp(sim.tcpRx.data + rxLen, data, 1000) == 0);
+	CHECK(sim.uartTx.len == 0);
+	CHECK(testField("uart_rx") == 1000);
+
+	//And the robot is back afterwards
+	CHECK(setMode("test off"));
+	sim_tcpWrite(data, 100);
+	sim_run(100000);
+	CHECK(sim.uartTx.len == 100);
+
+	//Sink: counted and dropped
+	CHECK(setMode("test sink"));
+	rxLen = sim.tcpRx.len;
+	txLen = sim.uartTx.len;
+	sim_tcpWrite(data, sizeof(data));
+	sim_run(200000);
+	CHECK(sim.tcpRx.len == rxLen);
+	CHECK(sim.uartTx.len == txLen);
+	CHECK(testField("tcp_rx") == sizeof(data));
+
+	//Source: the pattern, for as long as the mode is on
+	CHECK(setMode("test source"));
+	rxLen = sim.tcpRx.len;
+	sim_run(500000);
+	CHECK(sim.tcpRx.len > rxLen + 10000);
+	for(i = rxLen; i < sim.tcpRx.len; ++i) {
+		if(sim.tcpRx.data[i] != 0x55) {
+			break;
+		}
+	}
+	CHECK(i == sim.tcpRx.len);
+	CHECK(testField("tcp_tx") >= sim.tcpRx.len - rxLen);
+	CHECK(testField("ack_max_us") >= 2000);
+
+	CHECK(setMode("test off"));
+	sim_run(100000);
+	rxLen = sim.tcpRx.len;
+	sim_run(500000);
+	CHECK(sim.tcpRx.len == rxLen);
+
+	return sim_done("test_testmode");
+}
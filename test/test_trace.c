@@ -0,0 +1,112 @@
+//Trace recording and the 'trace' command that drains it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "user_trace.h"
+
+static const uint8 HOST[4] = {192, 168, 1, 2};
+
+//Polls 'trace' until it is empty and adds up the lengths per type
+static uint32 drain(uint32 *lens, uint32 *counts, uint32 *dropped) {
+	uint32 events = 0, last = 0;
+	uint8 ordered = 1;
+	const char *reply;
+	uint16 polls;
+
+	memset(lens, 0, TRACE_TYPES * sizeof(uint32));
+	memset(counts, 0, TRACE_TYPES * sizeof(uint32));
+
+	for(polls = 0; (reply = sim_ctrl(HOST, "trace")) != NULL; ++polls) {
+		const char *line = reply;
+		uint32 left = 0xFFFF;
+
+		CHECK(strncmp(reply, "ok\n", 3) == 0);
+
+		for(line = strchr(reply, '\n') + 1; *line != '\0'; line = strchr(line, '\n') + 1) {
+			uint32 time, len;
+			char type[16];
+			uint8 t;
+
+			if(sscanf(line, "trace_dropped=%u", dropped) == 1) {
+				continue;
+			}
+			if(sscanf(line, "trace_left=%u", &left) == 1) {
+				continue;
+			}
+
+			CHECK(sscanf(line, "%u %15s %u", &time, type, &len) == 3);
+			ordered &= (time >= last);
+			last = time;
+
+			for(t = 1; t < TRACE_TYPES; ++t) {
+				if(strcmp(type, trace_typeName(t)) == 0) {
+					lens[t] += len;
+					counts[t]++;
+				}
+			}
+			events++;
+		}
+
+		CHECK(left != 0xFFFF);
+		if(left == 0) {
+			break;
+		}
+		CHECK(polls < 100);
+	}
+
+	CHECK(ordered);
+
+	return events;
+}
+
+int main() {
+	uint32 lens[TRACE_TYPES], counts[TRACE_TYPES], dropped = 0;
+	uint8 data[3000];
+	uint32 i;
+
+	for(i = 0; i < sizeof(data); ++i) {
+		data[i] = i * 7;
+	}
+
+	sim_boot();
+	sim.tcpAckDelay = 2000;
+
+	//Boot leaves nothing behind
+	CHECK(drain(lens, counts, &dropped) == 0);
+
+	sim_tcpConnect(HOST);
+	sim_uartSend(data, 1000);
+	sim_tcpWrite(data, 500);
+	sim_run(200000);
+
+	CHECK(sim.tcpRx.len == 1000);
+	CHECK(sim.uartTx.len == 500);
+
+	drain(lens, counts, &dropped);
+	CHECK(counts[TRACE_CONNECT] == 1);
+	CHECK(lens[TRACE_UART_RX] == 1000);
+	CHECK(lens[TRACE_TCP_SEND] == 1000);
+	CHECK(counts[TRACE_TCP_SENT] == counts[TRACE_TCP_SEND]);
+	CHECK(lens[TRACE_TCP_RECV] == 500);
+	CHECK(lens[TRACE_UART_TX] == 500);
+	CHECK(dropped == 0);
+
+	//Without polling the buffer fills up, the oldest events are kept
+	for(i = 0; i < TRACE_DEPTH; ++i) {
+		sim_tcpWrite(data, 4);
+		sim_run(1000);
+	}
+	drain(lens, counts, &dropped);
+	CHECK(dropped > 0);
+	CHECK(counts[TRACE_TCP_RECV] < TRACE_DEPTH);
+	CHECK(counts[TRACE_TCP_RECV] > TRACE_DEPTH / 4);
+
+	sim_tcpClose();
+	drain(lens, counts, &dropped);
+	CHECK(counts[TRACE_DISCONNECT] == 1);
+
+	return sim_done("test_trace");
+}
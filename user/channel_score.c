@@ -0,0 +1,62 @@
+#include "channel_score.h"
+
+//2.4 GHz channels are 5 MHz apart on 20 MHz wide signals, so an AP
+//interferes with up to four channels either side, decreasingly (x/8)
+static const uint8 OVERLAP[] = {8, 6, 4, 2, 1};
+#define OVERLAP_SPAN	(sizeof(OVERLAP) / sizeof(OVERLAP[0]))
+
+void ICACHE_FLASH_ATTR
+ChannelScore_reset(ChannelScores *scores) {
+	uint8 i;
+
+	for(i = 0; i <= CHANNEL_COUNT; ++i) {
+		scores->score[i] = 0;
+	}
+}
+
+void ICACHE_FLASH_ATTR
+ChannelScore_add(ChannelScores *scores, uint8 channel, sint8 rssi) {
+	if((channel < 1) || (channel > CHANNEL_COUNT)) {
+		return;
+	}
+
+	//Louder APs cost more airtime: -100 dBm counts 1, -40 dBm counts 61
+	sint16 weight = (sint16)rssi + 101;
+	if(weight < 1)
+		weight = 1;
+
+	uint8 d;
+	for(d = 0; d < OVERLAP_SPAN; ++d) {
+		uint32 cost = (uint32)weight * OVERLAP[d];
+
+		if(channel + d <= CHANNEL_COUNT) {
+			scores->score[channel + d] += cost;
+		}
+		if((d > 0) && (channel > d)) {
+			scores->score[channel - d] += cost;
+		}
+	}
+}
+
+uint8 ICACHE_FLASH_ATTR
+ChannelScore_best(const ChannelScores *scores, const uint8 *candidates,
+	uint8 count, uint8 current) {
+	uint8 best = current;
+	uint32 bestScore = 0xFFFFFFFF;
+	uint8 i;
+
+	for(i = 0; i < count; ++i) {
+		if(scores->score[candidates[i]] < bestScore) {
+			best = candidates[i];
+			bestScore = scores->score[best];
+		}
+	}
+
+	//Hysteresis, so neighbouring bots don't keep trading channels
+	if((current >= 1) && (current <= CHANNEL_COUNT)
+		&& (scores->score[current] <= bestScore + CHANNEL_SWITCH_MARGIN * OVERLAP[0])) {
+		return current;
+	}
+
+	return best;
+}
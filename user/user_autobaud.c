@@ -0,0 +1,120 @@
+#include "user_autobaud.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+#include "driver/uart.h"
+
+static const char *STATE_NAMES[] = { "off", "detecting", "locked", "timeout" };
+
+//What the robot could be running at
+static const uint32 STANDARD_RATES[] = {
+	1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600, 74880,
+	115200, 230400, 250000, 460800, 921600
+};
+
+#define STANDARD_RATE_COUNT	(sizeof(STANDARD_RATES)/sizeof(STANDARD_RATES[0]))
+
+static uint8 _state;
+
+static uint32 _fallback;
+static uint32 _fastest;		//Fastest rate matched so far
+static uint8 _windows;		//Windows that matched a rate
+static uint16 _polls;
+
+static os_timer_t _pollTimer;
+
+static uint32 __match(uint32 measured);
+static void __finish(uint32 baud, uint8 state);
+static void __pollTimerHandler(void *arg);
+
+void ICACHE_FLASH_ATTR autobaud_start(uint32 fallback) {
+	os_timer_disarm(&_pollTimer);
+	os_timer_setfn(&_pollTimer, (os_timer_func_t*)__pollTimerHandler, NULL);
+
+	_state = AUTOBAUD_DETECTING;
+	_fallback = fallback;
+	_fastest = 0;
+	_windows = 0;
+	_polls = 0;
+	uart_autobaudStart();
+
+	os_timer_arm(&_pollTimer, AUTOBAUD_POLL_MS, 1);
+}
+
+void ICACHE_FLASH_ATTR autobaud_stop() {
+	if(_state == AUTOBAUD_DETECTING) {
+		os_timer_disarm(&_pollTimer);
+		uart_autobaudStop(0);
+	}
+
+	_state = AUTOBAUD_OFF;
+}
+
+uint8 autobaud_getState() {
+	return _state;
+}
+
+const char* ICACHE_FLASH_ATTR autobaud_getStateName() {
+	return STATE_NAMES[_state];
+}
+
+//Nearest standard rate, 0 if none is close enough
+uint32 __match(uint32 measured) {
+	uint32 best = 0, bestDiff = 0xFFFFFFFF;
+	uint8 i;
+
+	for(i = 0; i < STANDARD_RATE_COUNT; ++i) {
+		uint32 rate = STANDARD_RATES[i];
+		uint32 diff = (measured > rate) ? (measured - rate) : (rate - measured);
+
+		if(diff < bestDiff) {
+			best = rate;
+			bestDiff = diff;
+		}
+	}
+
+	return (bestDiff <= best / AUTOBAUD_TOLERANCE) ? best : 0;
+}
+
+void __finish(uint32 baud, uint8 state) {
+	char msg[48];
+
+	os_timer_disarm(&_pollTimer);
+
+	uart_autobaudStop(baud);
+	_state = state;
+
+	os_sprintf(msg, "[Autobaud] %s%u\r\n", (state == AUTOBAUD_TIMEOUT) ? "timeout, " : "", baud);
+	uart_debugSend(msg);
+}
+
+void __pollTimerHandler(void *arg) {
+	uint32 pulse = uart_autobaudPulse(AUTOBAUD_MIN_EDGES);
+	uint32 baud;
+
+	if(++_polls >= AUTOBAUD_TIMEOUT_MS / AUTOBAUD_POLL_MS) {
+		__finish(_fallback, AUTOBAUD_TIMEOUT);
+		return;
+	}
+
+	if(pulse == 0) {
+		return;
+	}
+
+	//Every window is measured on its own
+	baud = __match(UART_CLK_FREQ / pulse);
+	uart_autobaudStart();
+
+	//A glitch or a line that never had a single bit pulse, look again
+	if(baud == 0) {
+		return;
+	}
+
+	if(baud > _fastest) {
+		_fastest = baud;
+	}
+
+	if(++_windows >= AUTOBAUD_WINDOWS) {
+		__finish(_fastest, AUTOBAUD_LOCKED);
+	}
+}
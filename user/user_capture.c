@@ -0,0 +1,389 @@
+#include "user_capture.h"
+
+#include "osapi.h"
+#include "spi_flash.h"
+#include "user_interface.h"
+#include <string.h>
+
+#include "user_config.h"
+#include "driver/SegmentPool.h"
+#include "user_frame.h"
+#include "user_stats.h"
+#include "user_tcp.h"
+
+#define FLASH_SECTOR_SIZE	(4096)
+
+#define BLOCKS_PER_SECTOR	(FLASH_SECTOR_SIZE / CAPTURE_BLOCK_LEN)
+#define CAPTURE_BLOCKS		(CAPTURE_SECTOR_COUNT * BLOCKS_PER_SECTOR)
+
+//Erased flash
+#define SEQUENCE_NONE	(0xFFFFFFFF)
+
+//Whole blocks per download frame
+#define DUMP_BLOCKS		((TCP_MAX_PACKET - FRAME_HEADER_LEN) / CAPTURE_BLOCK_LEN)
+
+//Download segments kept waiting for espconn, together with the ones in
+//flight this keeps the link busy
+#define DUMP_BACKLOG	(2)
+
+//The ms clock has to see every system_get_time() wrap while a block is
+//open. Between blocks nothing wakes the chip for it.
+#define CLOCK_INTERVAL	(60000)
+
+//A full task queue is tried again after this long (ms)
+#define POST_RETRY		(10)
+
+struct BlockHeader {
+	uint32 sequence;
+	uint16 boot;
+	uint16 used;
+};
+
+_Static_assert(sizeof(struct BlockHeader) == CAPTURE_BLOCK_HEADER,
+	"Block header layout is part of the download format");
+
+static const char *MODE_NAMES[] = { "off", "idle", "all" };
+
+static uint8 _mode;
+static uint8 _taskPriority;
+static uint8 _workPosted;
+
+//One block fills while the other may wait for flash. The sequence
+//number of a block also gives its place in the ring.
+static uint32 _blocks[2][CAPTURE_BLOCK_LEN / 4];
+static uint8 _fill;
+static uint16 _fillLen;		//Including the header
+static uint8 _full;			//The other block is waiting for flash
+
+static uint32 _sequence;	//Of the next block written
+static uint16 _boot;
+static uint8 _clearSector;	//Next sector to erase, CAPTURE_SECTOR_COUNT: no clear
+
+static uint32 _lastUs, _ms;
+
+static uint8 _dumping;
+static uint32 _dumpSequence, _dumpEnd;
+
+static os_timer_t _flushTimer, _clockTimer, _postTimer;
+
+static void __post();
+static uint8 __close();
+static uint32 __now();
+static uint32 __address(uint32 sequence);
+static void __flushTimerHandler(void *arg);
+static void __clockTimerHandler(void *arg);
+static void __postTimerHandler(void *arg);
+
+void ICACHE_FLASH_ATTR capture_init(uint8 mode, uint8 taskPriority) {
+	struct BlockHeader header;
+	uint32 newest = 0;
+	uint8 found = 0;
+	uint16 i;
+
+	_taskPriority = taskPriority;
+	_clearSector = CAPTURE_SECTOR_COUNT;
+	_fill = 0;
+	_fillLen = CAPTURE_BLOCK_HEADER;
+	_full = 0;
+
+	os_timer_disarm(&_flushTimer);
+	os_timer_setfn(&_flushTimer, (os_timer_func_t*)__flushTimerHandler, NULL);
+	os_timer_disarm(&_clockTimer);
+	os_timer_setfn(&_clockTimer, (os_timer_func_t*)__clockTimerHandler, NULL);
+	os_timer_disarm(&_postTimer);
+	os_timer_setfn(&_postTimer, (os_timer_func_t*)__postTimerHandler, NULL);
+
+	//Only the block headers are read, blocks in the wrong place are
+	//leftovers from something else
+	for(i = 0; i < CAPTURE_BLOCKS; ++i) {
+		spi_flash_read(__address(i), (uint32*)&header, sizeof(header));
+
+		if((header.sequence == SEQUENCE_NONE) || ((header.sequence % CAPTURE_BLOCKS) != i)) {
+			continue;
+		}
+
+		if(!found || (header.sequence > newest)) {
+			newest = header.sequence;
+			_boot = header.boot + 1;
+			found = 1;
+		}
+	}
+
+	_sequence = found ? (newest + 1) : 0;
+
+	//Continuing in the middle of a sector needs the rest of it erased,
+	//otherwise start over at the next one
+	if((_sequence % BLOCKS_PER_SECTOR) != 0) {
+		spi_flash_read(__address(_sequence), (uint32*)&header, sizeof(header));
+
+		if(header.sequence != SEQUENCE_NONE) {
+			_sequence += BLOCKS_PER_SECTOR - (_sequence % BLOCKS_PER_SECTOR);
+		}
+	}
+
+	capture_setMode(mode);
+}
+
+void ICACHE_FLASH_ATTR capture_setMode(uint8 mode) {
+	_mode = mode;
+
+	__now();
+}
+
+uint8 capture_active(uint8 connected) {
+	return (_mode == CAPTURE_ALL) || ((_mode == CAPTURE_IDLE) && !connected);
+}
+
+//Runs in the same task as everything that forwards UART data, the ISR
+//never sees these blocks
+void capture_write(const uint8 *data, uint16 len) {
+	uint32 now = __now();
+
+	while(len > 0) {
+		uint8 *record = (uint8*)_blocks[_fill] + _fillLen;
+		uint16 room = CAPTURE_BLOCK_LEN - _fillLen;
+		uint16 count;
+
+		if(room <= CAPTURE_RECORD_HEADER) {
+			if(!__close()) {
+				bridgeStats.captureDropped += len;
+				return;
+			}
+			continue;
+		}
+
+		if(_fillLen == CAPTURE_BLOCK_HEADER) {
+			os_timer_disarm(&_flushTimer);
+			os_timer_arm(&_flushTimer, CAPTURE_FLUSH_MS, 0);
+			os_timer_arm(&_clockTimer, CLOCK_INTERVAL, 1);
+		}
+
+		count = room - CAPTURE_RECORD_HEADER;
+		if(count > len)
+			count = len;
+
+		//Records aren't word aligned
+		record[0] = now;
+		record[1] = now >> 8;
+		record[2] = now >> 16;
+		record[3] = now >> 24;
+		record[4] = count;
+		record[5] = count >> 8;
+		memcpy(record + CAPTURE_RECORD_HEADER, data, count);
+
+		_fillLen += CAPTURE_RECORD_HEADER + count;
+		data += count;
+		len -= count;
+
+		bridgeStats.captureBytes += count;
+	}
+}
+
+void ICACHE_FLASH_ATTR capture_work() {
+	_workPosted = 0;
+
+	if(_clearSector < CAPTURE_SECTOR_COUNT) {
+		spi_flash_erase_sector(CAPTURE_SECTOR_FIRST + _clearSector);
+		_clearSector++;
+
+		__post();
+		return;
+	}
+
+	if(_full) {
+		uint32 *block = _blocks[_fill ^ 1];
+		struct BlockHeader *header = (struct BlockHeader*)block;
+		uint8 ok = 1;
+
+		header->sequence = _sequence;
+		header->boot = _boot;
+
+		//Entering a sector wipes the oldest blocks
+		if((_sequence % BLOCKS_PER_SECTOR) == 0) {
+			ok = (spi_flash_erase_sector(CAPTURE_SECTOR_FIRST
+				+ (_sequence % CAPTURE_BLOCKS) / BLOCKS_PER_SECTOR) == SPI_FLASH_RESULT_OK);
+		}
+
+		if(ok) {
+			ok = (spi_flash_write(__address(_sequence), block, CAPTURE_BLOCK_LEN) == SPI_FLASH_RESULT_OK);
+		}
+
+		if(ok) {
+			bridgeStats.captureBlocks++;
+		}
+		else {
+			bridgeStats.captureDropped += header->used;
+		}
+
+		//A failed block still moves on, the next sector may be fine
+		_sequence++;
+		_full = 0;
+	}
+}
+
+void ICACHE_FLASH_ATTR capture_clear() {
+	_clearSector = 0;
+	_dumping = 0;
+
+	__post();
+}
+
+uint8 ICACHE_FLASH_ATTR capture_startDump() {
+	if(!tcp_getMuxMode() || !tcp_isConnected()) {
+		return 0;
+	}
+
+	_dumpSequence = (_sequence > CAPTURE_BLOCKS) ? (_sequence - CAPTURE_BLOCKS) : 0;
+	_dumpEnd = _sequence;
+	_dumping = 1;
+
+	capture_pump();
+
+	return 1;
+}
+
+//Blocks are read straight into pool segments, several to a frame
+void capture_pump() {
+	while(_dumping && (tcp_getBacklog() < DUMP_BACKLOG)) {
+		Segment *segment;
+		uint8 seg, blocks = 0;
+
+		if(!tcp_isConnected()) {
+			_dumping = 0;
+			return;
+		}
+
+		//Borrowed from the UART direction, the next sent event retries
+		seg = SegmentPool_alloc(SEGMENT_UART_RX);
+		if(seg == SEGMENT_NONE) {
+			return;
+		}
+
+		segment = SegmentPool_get(seg);
+		segment->offset = segment->len = FRAME_HEADER_LEN;
+
+		while((blocks < DUMP_BLOCKS) && (_dumpSequence != _dumpEnd)) {
+			uint32 *block = (uint32*)(segment->data + segment->len);
+
+			spi_flash_read(__address(_dumpSequence), block, CAPTURE_BLOCK_LEN);
+
+			//Erased or already overwritten blocks are left out
+			if(((struct BlockHeader*)block)->sequence == _dumpSequence) {
+				segment->len += CAPTURE_BLOCK_LEN;
+				blocks++;
+			}
+
+			_dumpSequence++;
+		}
+
+		//An empty frame ends the download
+		if(blocks == 0) {
+			_dumping = 0;
+		}
+
+		tcp_sendChannelSegment(seg, FRAME_CAPTURE);
+	}
+}
+
+uint16 ICACHE_FLASH_ATTR capture_report(char *buffer, uint16 size) {
+	//Worst case is well below this
+	if(size < 160) {
+		return 0;
+	}
+
+	return os_sprintf(buffer,
+		"capture=%s\n"
+		"capture_seq=%u\n"
+		"capture_boot=%u\n"
+		"capture_bytes=%u\n"
+		"capture_dropped=%u\n"
+		"capture_blocks=%u\n",
+		MODE_NAMES[_mode], _sequence, _boot,
+		bridgeStats.captureBytes, bridgeStats.captureDropped,
+		bridgeStats.captureBlocks);
+}
+
+uint8 ICACHE_FLASH_ATTR capture_parse(const char *name) {
+	uint8 i;
+
+	for(i = 0; i < sizeof(MODE_NAMES)/sizeof(MODE_NAMES[0]); ++i) {
+		if(strcmp(name, MODE_NAMES[i]) == 0) {
+			return i;
+		}
+	}
+
+	return CAPTURE_UNKNOWN;
+}
+
+//A lost post would leave the waiting block in RAM for good, and with it
+//everything captured after it
+void __post() {
+	if(_workPosted) {
+		return;
+	}
+
+	if(system_os_post(_taskPriority, CAPTURE_SIG_WORK, system_get_time())) {
+		_workPosted = 1;
+	}
+	else {
+		bridgeStats.postFailures++;
+		os_timer_arm(&_postTimer, POST_RETRY, 0);
+	}
+}
+
+//Hands the filling block to flash, returns 0 while the other one is
+//still waiting
+uint8 __close() {
+	struct BlockHeader *header = (struct BlockHeader*)_blocks[_fill];
+
+	if(_full) {
+		return 0;
+	}
+
+	//Left erased, programming 0xFF doesn't touch the flash
+	header->used = _fillLen - CAPTURE_BLOCK_HEADER;
+	memset((uint8*)_blocks[_fill] + _fillLen, 0xFF, CAPTURE_BLOCK_LEN - _fillLen);
+
+	os_timer_disarm(&_flushTimer);
+	os_timer_disarm(&_clockTimer);
+
+	_full = 1;
+	_fill ^= 1;
+	_fillLen = CAPTURE_BLOCK_HEADER;
+
+	__post();
+
+	return 1;
+}
+
+//Milliseconds since boot, carrying the fraction so nothing is lost
+uint32 __now() {
+	uint32 us = system_get_time();
+	uint32 elapsed = us - _lastUs;
+
+	_ms += elapsed / 1000;
+	_lastUs = us - (elapsed % 1000);
+
+	return _ms;
+}
+
+uint32 __address(uint32 sequence) {
+	return (CAPTURE_SECTOR_FIRST * FLASH_SECTOR_SIZE)
+		+ ((sequence % CAPTURE_BLOCKS) * CAPTURE_BLOCK_LEN);
+}
+
+//A partly filled block goes to flash after a while. If the other block
+//is still waiting, try again later.
+void __flushTimerHandler(void *arg) {
+	if((_fillLen > CAPTURE_BLOCK_HEADER) && !__close()) {
+		os_timer_arm(&_flushTimer, CAPTURE_FLUSH_MS, 0);
+	}
+}
+
+void __clockTimerHandler(void *arg) {
+	__now();
+}
+
+void __postTimerHandler(void *arg) {
+	__post();
+}
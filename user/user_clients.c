@@ -0,0 +1,147 @@
+#include "user_clients.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+
+#define MAC_LEN		6
+
+//Longest report line,
+//"station=xx:xx:xx:xx:xx:xx 255.255.255.255 session rssi=-100 rssi_age=4294\n"
+#define REPORT_LINE_LEN	(76)
+
+struct Client {
+	uint8 mac[MAC_LEN];
+	uint8 used;
+	uint8 session;
+	sint8 rssi;			//CLIENT_RSSI_NONE until a probe request
+	uint32 rssiTime;	//When it was measured, microseconds
+};
+
+static struct Client _clients[AP_MAX_CONNECTIONS];
+
+static struct Client* __find(const uint8 *mac);
+
+void ICACHE_FLASH_ATTR clients_init() {
+	os_memset(_clients, 0, sizeof(_clients));
+}
+
+void ICACHE_FLASH_ATTR clients_associated(const uint8 *mac) {
+	struct Client *client = __find(mac);
+	uint8 i;
+
+	if(client != NULL) {
+		return;
+	}
+
+	for(i = 0; i < AP_MAX_CONNECTIONS; ++i) {
+		if(!_clients[i].used) {
+			client = &_clients[i];
+
+			os_memcpy(client->mac, mac, MAC_LEN);
+			client->used = 1;
+			client->session = 0;
+			client->rssi = CLIENT_RSSI_NONE;
+			return;
+		}
+	}
+}
+
+uint8 ICACHE_FLASH_ATTR clients_disassociated(const uint8 *mac) {
+	struct Client *client = __find(mac);
+	uint8 session = 0;
+
+	if(client != NULL) {
+		session = client->session;
+		client->used = 0;
+		client->session = 0;
+	}
+
+	return session;
+}
+
+//Scanning stations probe everyone, only associated ones are kept
+void ICACHE_FLASH_ATTR clients_probed(const uint8 *mac, sint8 rssi) {
+	struct Client *client = __find(mac);
+
+	if(client != NULL) {
+		client->rssi = rssi;
+		client->rssiTime = system_get_time();
+	}
+}
+
+void ICACHE_FLASH_ATTR clients_sessionStarted(uint32 addr) {
+	struct station_info *station;
+	uint8 i;
+
+	for(i = 0; i < AP_MAX_CONNECTIONS; ++i) {
+		_clients[i].session = 0;
+	}
+
+	for(station = wifi_softap_get_station_info(); station != NULL;
+			station = STAILQ_NEXT(station, next)) {
+		if(station->ip.addr == addr) {
+			struct Client *client = __find(station->bssid);
+
+			//Associated before we were tracking
+			if(client == NULL) {
+				clients_associated(station->bssid);
+				client = __find(station->bssid);
+			}
+
+			if(client != NULL) {
+				client->session = 1;
+			}
+			break;
+		}
+	}
+	wifi_softap_free_station_info();
+}
+
+void ICACHE_FLASH_ATTR clients_sessionEnded() {
+	uint8 i;
+
+	for(i = 0; i < AP_MAX_CONNECTIONS; ++i) {
+		_clients[i].session = 0;
+	}
+}
+
+uint16 ICACHE_FLASH_ATTR clients_report(char *buffer, uint16 size) {
+	struct station_info *station;
+	uint32 now = system_get_time();
+	uint16 len = 0;
+
+	for(station = wifi_softap_get_station_info(); station != NULL;
+			station = STAILQ_NEXT(station, next)) {
+		struct Client *client = __find(station->bssid);
+
+		if(size - len < REPORT_LINE_LEN) {
+			break;
+		}
+
+		len += os_sprintf(buffer + len, "station=" MACSTR " " IPSTR " %s",
+			MAC2STR(station->bssid), IP2STR(&station->ip),
+			((client != NULL) && client->session) ? "session" : "idle");
+
+		if((client != NULL) && (client->rssi != CLIENT_RSSI_NONE)) {
+			len += os_sprintf(buffer + len, " rssi=%d rssi_age=%u",
+				client->rssi, (now - client->rssiTime) / 1000000);
+		}
+
+		len += os_sprintf(buffer + len, "\n");
+	}
+	wifi_softap_free_station_info();
+
+	return len;
+}
+
+struct Client* ICACHE_FLASH_ATTR __find(const uint8 *mac) {
+	uint8 i;
+
+	for(i = 0; i < AP_MAX_CONNECTIONS; ++i) {
+		if(_clients[i].used && (os_memcmp(_clients[i].mac, mac, MAC_LEN) == 0)) {
+			return &_clients[i];
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,250 @@
+#include "user_ctrl.h"
+
+#include "ip_addr.h"
+#include "osapi.h"
+#include "espconn.h"
+#include "user_interface.h"
+#include <string.h>
+
+#include "user_settings.h"
+
+#define CTRL_LINE_LEN		(128)
+#define CTRL_REPLY_LEN		(512)
+
+//Give the reply time to leave before restarting
+#define CTRL_REBOOT_DELAY	(100)
+
+static struct espconn _ctrlConn;
+static esp_udp _ctrlProto;
+
+static os_timer_t _rebootTimer;
+
+static char _reply[CTRL_REPLY_LEN];
+static uint16 _replyLen;
+
+static struct {
+	const char *name;
+	CommandHandler handler;
+	uint8 flags;
+} _commands[CTRL_MAX_COMMANDS];
+static uint8 _commandCount;
+
+static AccessHandler _accessHandler;
+
+static void __recvHandler(void *arg, char *data, unsigned short len);
+static void __rebootTimerHandler(void *arg);
+static void __execute(char *line, uint8 allowed);
+static void __append(const char *str);
+static void __appendKey(const char *key);
+static char* __token(char **line);
+
+void ICACHE_FLASH_ATTR ctrl_start(uint16 port) {
+	os_timer_disarm(&_rebootTimer);
+	os_timer_setfn(&_rebootTimer, (os_timer_func_t*)__rebootTimerHandler, NULL);
+
+	_ctrlConn.type = ESPCONN_UDP;
+	_ctrlConn.state = ESPCONN_NONE;
+	_ctrlConn.proto.udp = &_ctrlProto;
+	_ctrlConn.proto.udp->local_port = port;
+
+	espconn_regist_recvcb(&_ctrlConn, &__recvHandler);
+	espconn_create(&_ctrlConn);
+}
+
+void ICACHE_FLASH_ATTR ctrl_setAccessHandler(AccessHandler handler) {
+	_accessHandler = handler;
+}
+
+uint8 ICACHE_FLASH_ATTR ctrl_addCommand(const char *name, CommandHandler handler, uint8 flags) {
+	if(_commandCount >= CTRL_MAX_COMMANDS) {
+		return 0;
+	}
+
+	_commands[_commandCount].name = name;
+	_commands[_commandCount].handler = handler;
+	_commands[_commandCount].flags = flags;
+	_commandCount++;
+
+	return 1;
+}
+
+void ICACHE_FLASH_ATTR __recvHandler(void *arg, char *data, unsigned short len) {
+	struct espconn *conn = (struct espconn*)arg;
+	remot_info *remote = NULL;
+	char line[CTRL_LINE_LEN];
+
+	if(len >= CTRL_LINE_LEN) {
+		len = CTRL_LINE_LEN - 1;
+	}
+
+	os_memcpy(line, data, len);
+	line[len] = '\0';
+
+	//Answer whoever asked
+	if(espconn_get_connection_info(conn, &remote, 0) == ESPCONN_OK) {
+		uint32 addr;
+
+		os_memcpy(&addr, remote->remote_ip, 4);
+
+		_replyLen = 0;
+		__execute(line, (_accessHandler == NULL) || _accessHandler(addr));
+
+		os_memcpy(conn->proto.udp->remote_ip, remote->remote_ip, 4);
+		conn->proto.udp->remote_port = remote->remote_port;
+
+		espconn_send(conn, (uint8*)_reply, _replyLen);
+	}
+}
+
+uint16 ICACHE_FLASH_ATTR ctrl_execute(char *line, const char **reply) {
+	_replyLen = 0;
+	__execute(line, 1);
+
+	*reply = _reply;
+	return _replyLen;
+}
+
+void ICACHE_FLASH_ATTR __execute(char *line, uint8 allowed) {
+	char *cmd = __token(&line);
+	char *key, *value;
+
+	if(!allowed && ((strcmp(cmd, "set") == 0) || (strcmp(cmd, "save") == 0)
+		|| (strcmp(cmd, "defaults") == 0) || (strcmp(cmd, "reboot") == 0))) {
+		__append("error not allowed\n");
+	}
+	else if(strcmp(cmd, "get") == 0) {
+		key = __token(&line);
+
+		if(*key == '\0') {
+			const char *name;
+			uint8 i;
+
+			for(i = 0; (name = settings_key(i)) != NULL; ++i) {
+				__appendKey(name);
+			}
+		}
+		else {
+			__appendKey(key);
+		}
+	}
+	else if(strcmp(cmd, "set") == 0) {
+		key = __token(&line);
+
+		//The value is the rest of the line, SSIDs may contain spaces
+		value = line;
+
+		__append(settings_set(key, value) ? "ok\n" : "error invalid\n");
+	}
+	else if(strcmp(cmd, "save") == 0) {
+		uint32 seq = settings_save();
+		char num[24];
+
+		if(seq != 0) {
+			os_sprintf(num, "ok %u\n", seq);
+			__append(num);
+		}
+		else {
+			__append("error flash\n");
+		}
+	}
+	else if(strcmp(cmd, "defaults") == 0) {
+		settings_reset();
+		__append("ok\n");
+	}
+	else if(strcmp(cmd, "reboot") == 0) {
+		os_timer_arm(&_rebootTimer, CTRL_REBOOT_DELAY, 0);
+		__append("ok\n");
+	}
+	else {
+		uint8 i;
+
+		for(i = 0; i < _commandCount; ++i) {
+			if(strcmp(cmd, _commands[i].name) == 0) {
+				uint16 len;
+
+				if(!allowed && (_commands[i].flags & CTRL_RESTRICTED)) {
+					__append("error not allowed\n");
+					return;
+				}
+
+				__append("ok\n");
+				len = _commands[i].handler(line, _reply + _replyLen, CTRL_REPLY_LEN - _replyLen);
+
+				if(len == CTRL_INVALID) {
+					_replyLen = 0;
+					__append("error invalid\n");
+				}
+				else {
+					_replyLen += len;
+				}
+
+				return;
+			}
+		}
+
+		__append("error unknown command\n");
+	}
+}
+
+void ICACHE_FLASH_ATTR __rebootTimerHandler(void *arg) {
+	system_restart();
+}
+
+void ICACHE_FLASH_ATTR __append(const char *str) {
+	uint16 len = strlen(str);
+
+	if(len > CTRL_REPLY_LEN - _replyLen) {
+		len = CTRL_REPLY_LEN - _replyLen;
+	}
+
+	os_memcpy(_reply + _replyLen, str, len);
+	_replyLen += len;
+}
+
+//"key=value\n", preceded by "ok" on the first one
+void ICACHE_FLASH_ATTR __appendKey(const char *key) {
+	char value[SETTINGS_PSK_LEN];
+
+	if(!settings_get(key, value, sizeof(value))) {
+		__append("error unknown key\n");
+		return;
+	}
+
+	if(_replyLen == 0) {
+		__append("ok\n");
+	}
+	__append(key);
+	__append("=");
+	__append(value);
+	__append("\n");
+}
+
+//Splits off the next space separated word and strips line endings
+char* ICACHE_FLASH_ATTR __token(char **line) {
+	char *start, *end;
+
+	for(end = *line; *end != '\0'; ++end) {
+		if((*end == '\r') || (*end == '\n')) {
+			*end = '\0';
+			break;
+		}
+	}
+
+	start = *line;
+	while(*start == ' ') {
+		start++;
+	}
+
+	end = start;
+	while((*end != ' ') && (*end != '\0')) {
+		end++;
+	}
+
+	*line = end;
+	if(*end == ' ') {
+		*end = '\0';
+		*line = end + 1;
+	}
+
+	return start;
+}
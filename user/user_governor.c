@@ -0,0 +1,86 @@
+#include "user_governor.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+#include "driver/uart.h"
+#include "user_tcp.h"
+#include "user_stats.h"
+
+static os_timer_t _idleTimer;
+static uint8 _mode;
+static uint8 _active;
+static uint32 _modeSince;
+
+static void __idleTimerHandler(void *arg);
+
+static void __setMode(uint8 mode) {
+	governor_updateStats();
+
+	_mode = mode;
+	bridgeStats.governorTransitions++;
+
+	if(mode == GOVERNOR_PERFORMANCE) {
+		system_update_cpu_freq(SYS_CPU_160MHZ);
+
+		//Disable power saving mode
+		//This seems to help reduce jitter in latency
+		wifi_set_sleep_type(NONE_SLEEP_T);
+
+		uart_setRxThresholds(GOVERNOR_PERF_RX_FULL, GOVERNOR_PERF_RX_TO);
+
+		os_timer_arm(&_idleTimer, GOVERNOR_IDLE_TIME, 0);
+	}
+	else {
+		uart_setRxThresholds(GOVERNOR_SAVE_RX_FULL, GOVERNOR_SAVE_RX_TO);
+
+		wifi_set_sleep_type(MODEM_SLEEP_T);
+
+		system_update_cpu_freq(SYS_CPU_80MHZ);
+	}
+}
+
+void ICACHE_FLASH_ATTR
+governor_init() {
+	os_timer_disarm(&_idleTimer);
+	os_timer_setfn(&_idleTimer, (os_timer_func_t*)__idleTimerHandler, NULL);
+
+	_active = 0;
+	_modeSince = system_get_time();
+	_mode = GOVERNOR_PERFORMANCE;
+
+	__setMode(GOVERNOR_POWERSAVE);
+}
+
+void governor_activity() {
+	_active = 1;
+
+	if(_mode != GOVERNOR_PERFORMANCE) {
+		__setMode(GOVERNOR_PERFORMANCE);
+	}
+}
+
+uint8 governor_getMode() {
+	return _mode;
+}
+
+//Time accumulates in milliseconds; a single interval longer than the
+//32-bit microsecond clock (~71 minutes) is undercounted
+void governor_updateStats() {
+	uint32 now = system_get_time();
+	uint32 elapsed = now - _modeSince;
+
+	bridgeStats.governorTime[_mode] += elapsed / 1000;
+	_modeSince = now - (elapsed % 1000);
+}
+
+//Only armed in performance mode, so an idle bridge has no wakeups
+void __idleTimerHandler(void *arg) {
+	if(_active || tcp_isConnected()) {
+		_active = 0;
+
+		os_timer_arm(&_idleTimer, GOVERNOR_IDLE_TIME, 0);
+	}
+	else {
+		__setMode(GOVERNOR_POWERSAVE);
+	}
+}
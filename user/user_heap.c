@@ -0,0 +1,108 @@
+#include "user_heap.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+#include "user_stats.h"
+
+static const char *LEVEL_NAMES[] = { "ok", "low", "critical" };
+
+static uint8 _level;
+static HeapLevelHandler _handler;
+
+static os_timer_t _recheckTimer;
+
+static void __recheckTimerHandler(void *arg);
+
+void ICACHE_FLASH_ATTR heap_init() {
+	os_timer_disarm(&_recheckTimer);
+	os_timer_setfn(&_recheckTimer, (os_timer_func_t*)__recheckTimerHandler, NULL);
+
+	_level = HEAP_OK;
+	_handler = NULL;
+	bridgeStats.heapMin = 0xFFFFFFFF;
+
+	heap_sample();
+}
+
+void ICACHE_FLASH_ATTR heap_setLevelHandler(HeapLevelHandler handler) {
+	_handler = handler;
+}
+
+uint8 heap_sample() {
+	uint32 free = system_get_free_heap_size();
+	uint8 level;
+
+	if(free < bridgeStats.heapMin) {
+		bridgeStats.heapMin = free;
+	}
+
+	if(free < HEAP_CRITICAL_WATER) {
+		level = HEAP_CRITICAL;
+	}
+	else if(free < HEAP_LOW_WATER) {
+		level = HEAP_LOW;
+	}
+	else {
+		level = HEAP_OK;
+	}
+
+	//Going down is immediate, coming back up needs some margin
+	if((level == HEAP_OK) && (_level != HEAP_OK)
+		&& (free < HEAP_LOW_WATER + HEAP_HYSTERESIS)) {
+		level = HEAP_LOW;
+	}
+	if((level == HEAP_LOW) && (_level == HEAP_CRITICAL)
+		&& (free < HEAP_CRITICAL_WATER + HEAP_HYSTERESIS)) {
+		level = HEAP_CRITICAL;
+	}
+
+	if(level != _level) {
+		if(level > _level) {
+			bridgeStats.heapAlarms++;
+		}
+
+		_level = level;
+
+		//An idle bridge has no wakeups, the timer only runs while low
+		os_timer_disarm(&_recheckTimer);
+		if(_level != HEAP_OK) {
+			os_timer_arm(&_recheckTimer, HEAP_RECHECK_MS, 1);
+		}
+
+		if(_handler != NULL) {
+			_handler(_level, free);
+		}
+	}
+
+	return _level;
+}
+
+uint8 heap_getLevel() {
+	return _level;
+}
+
+const char* ICACHE_FLASH_ATTR heap_levelName(uint8 level) {
+	return LEVEL_NAMES[level];
+}
+
+uint16 ICACHE_FLASH_ATTR heap_report(char *buffer, uint16 size) {
+	//Worst case is well below this
+	if(size < 128) {
+		return 0;
+	}
+
+	heap_sample();
+
+	return os_sprintf(buffer,
+		"heap=%s\n"
+		"heap_free=%u\n"
+		"heap_min=%u\n"
+		"heap_alarms=%u\n"
+		"heap_rejected=%u\n",
+		LEVEL_NAMES[_level], system_get_free_heap_size(), bridgeStats.heapMin,
+		bridgeStats.heapAlarms, bridgeStats.heapRejected);
+}
+
+void __recheckTimerHandler(void *arg) {
+	heap_sample();
+}
@@ -0,0 +1,170 @@
+#include "user_isrprofile.h"
+
+#ifdef ISR_PROFILE
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "driver/uart.h"
+#include "driver/uart_register.h"
+
+//Bits on the line per byte with 8N1
+#define BITS_PER_BYTE	(10)
+
+struct IsrStats {
+	uint32 count;
+	uint32 min;
+	uint32 max;
+	uint64 total;
+};
+
+static const char *CAUSE_NAMES[ISR_CAUSES] = {
+	"rx_full", "rx_tout", "tx_empty", "rx_ovf", "frm_err", "parity", "none"
+};
+
+static struct IsrStats _causes[ISR_CAUSES];
+static uint32 _histogram[ISR_HISTOGRAM_BUCKETS];
+
+//Bytes past the RX full threshold when a full interrupt got to run, and
+//the highest FIFO level seen at entry for any cause
+static struct IsrStats _late;
+static uint32 _fifoMax;
+
+//The ISR doesn't nest, one entry sample is enough
+static uint8 _entryLevel, _entryThreshold;
+
+static inline uint32 __ccount() {
+	uint32 count;
+
+	asm volatile("rsr %0, ccount" : "=r"(count));
+
+	return count;
+}
+
+static void __account(struct IsrStats *stats, uint32 value) {
+	if((stats->count == 0) || (value < stats->min)) {
+		stats->min = value;
+	}
+	if(value > stats->max) {
+		stats->max = value;
+	}
+
+	stats->count++;
+	stats->total += value;
+}
+
+static uint16 __printStats(char *buffer, const char *name, const struct IsrStats *stats) {
+	return os_sprintf(buffer, "%s=%u %u %u %u\n", name, stats->count, stats->min,
+		(uint32)(stats->total / stats->count), stats->max);
+}
+
+uint32 isrprofile_enter() {
+	uint32 start = __ccount();
+
+	_entryLevel = (READ_PERI_REG(UART_STATUS(UART0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT;
+	_entryThreshold = (READ_PERI_REG(UART_CONF1(UART0)) >> UART_RXFIFO_FULL_THRHD_S)
+		& UART_RXFIFO_FULL_THRHD;
+
+	return start;
+}
+
+//The bookkeeping after the cycle count is read is not part of the time
+void isrprofile_exit(uint32 start, uint8 cause) {
+	uint32 cycles = __ccount() - start;
+	uint32 limit = ISR_HISTOGRAM_BASE;
+	uint8 bucket = 0;
+
+	__account(&_causes[cause], cycles);
+
+	while((bucket < ISR_HISTOGRAM_BUCKETS - 1) && (cycles >= limit)) {
+		limit <<= 1;
+		bucket++;
+	}
+	_histogram[bucket]++;
+
+	if(cause == ISR_CAUSE_RX_FULL) {
+		__account(&_late, (_entryLevel > _entryThreshold) ? (_entryLevel - _entryThreshold) : 0);
+	}
+
+	if(_entryLevel > _fifoMax) {
+		_fifoMax = _entryLevel;
+	}
+}
+
+void ICACHE_FLASH_ATTR isrprofile_reset() {
+	ETS_UART_INTR_DISABLE();
+
+	os_memset(_causes, 0, sizeof(_causes));
+	os_memset(_histogram, 0, sizeof(_histogram));
+	os_memset(&_late, 0, sizeof(_late));
+	_fifoMax = 0;
+
+	ETS_UART_INTR_ENABLE();
+}
+
+uint16 ICACHE_FLASH_ATTR isrprofile_report(char *buffer, uint16 size) {
+	struct IsrStats causes[ISR_CAUSES], late;
+	uint32 fifoMax, baud;
+	uint16 len = 0;
+	uint8 i;
+
+	//Worst case with every cause present
+	if(size < 480) {
+		return 0;
+	}
+
+	//A consistent copy, the ISR keeps counting
+	ETS_UART_INTR_DISABLE();
+
+	os_memcpy(causes, _causes, sizeof(causes));
+	late = _late;
+	fifoMax = _fifoMax;
+
+	ETS_UART_INTR_ENABLE();
+
+	baud = uart_getBaudrate();
+
+	len += os_sprintf(buffer + len, "cpu_mhz=%u\n", system_get_cpu_freq());
+
+	for(i = 0; i < ISR_CAUSES; ++i) {
+		if(causes[i].count > 0) {
+			len += __printStats(buffer + len, CAUSE_NAMES[i], &causes[i]);
+		}
+	}
+
+	if(late.count > 0) {
+		len += __printStats(buffer + len, "rx_late_bytes", &late);
+		len += os_sprintf(buffer + len, "rx_late_us_max=%u\n",
+			(uint32)((uint64)late.max * BITS_PER_BYTE * 1000000 / baud));
+	}
+
+	len += os_sprintf(buffer + len, "fifo_max=%u\n", fifoMax);
+
+	return len;
+}
+
+uint16 ICACHE_FLASH_ATTR isrprofile_histogram(char *buffer, uint16 size) {
+	uint32 histogram[ISR_HISTOGRAM_BUCKETS];
+	uint16 len;
+	uint8 i;
+
+	if(size < 160) {
+		return 0;
+	}
+
+	ETS_UART_INTR_DISABLE();
+	os_memcpy(histogram, _histogram, sizeof(histogram));
+	ETS_UART_INTR_ENABLE();
+
+	len = os_sprintf(buffer, "hist_base=%u\nhist=", ISR_HISTOGRAM_BASE);
+
+	for(i = 0; i < ISR_HISTOGRAM_BUCKETS; ++i) {
+		len += os_sprintf(buffer + len, (i == 0) ? "%u" : " %u", histogram[i]);
+	}
+
+	len += os_sprintf(buffer + len, "\n");
+
+	return len;
+}
+
+#endif
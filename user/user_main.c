@@ -5,24 +5,42 @@
 #include "os_type.h"
 #include "user_config.h"
 #include "driver/uart.h"
+#include "driver/SegmentPool.h"
+#include "driver/TokenBucket.h"
 #include "user_interface.h"
 #include "espconn.h"
 #include "user_tcp.h"
+#include "user_trace.h"
+#include "user_stats.h"
+#include "user_governor.h"
+#include "channel_score.h"
+#include "user_settings.h"
+#include "user_ctrl.h"
+#include "user_clients.h"
+#include "user_udp.h"
+#include "user_testmode.h"
+#include "user_priority.h"
+#include "user_frame.h"
+#include "user_capture.h"
+#include "user_isrprofile.h"
+#include "user_heap.h"
+#include "user_autobaud.h"
 #include "driver/gpio16.h"
 #include <mem.h>
 
-#define NETWORK_UPDATE_RATE	5
 #define SWITCH_DEBOUNCE_TIME	500
+#define LED_ACTIVITY_TIME	55
 
-#define user_procTaskQueueLen    10
+#define USER_SIG_SWITCH		0x10
 
+//Error reports and switch events share the lowest priority
+#define BACKGROUND_TASK_PRIORITY	UART_ERR_TASK_PRIORITY
 
-#define BAUD	115200
+#define UART_RX_QUEUE_LEN	10
+#define UART_TX_QUEUE_LEN	4
+#define BACKGROUND_QUEUE_LEN	4
 
-#define TCP_PORT	288
-
-#define AP_MAX_CONNECTIONS	8
-#define AP_PSK	"cpre288psk"
+//Baud, TCP port and PSK defaults are in user_settings.h
 
 #define AP_GATEWAY	"192.168.1.1"
 #define AP_NETMASK	"255.255.255.0"
@@ -30,28 +48,94 @@
 #define DHCP_IP_START	"192.168.1.2"
 #define DHCP_IP_END		"192.168.1.15"
 
-#define UART_RX_BUFFER_SIZE		(1024)
-#define UART_TX_BUFFER_SIZE		(128)
+//Scan at switch-on and start the AP on the least congested channel
+#define WIFI_CHANNEL_AUTO	1
+//Re-evaluate the channel this often (ms) while no client is around, 0 = never
+#define WIFI_RESCAN_INTERVAL	0
+
+//Station mode falls back to the AP when it has no IP after this long (ms)
+#define STA_JOIN_TIMEOUT	15000
+
+//Advertised as cybot-N._cpre288._tcp.local in station mode
+#define MDNS_SERVICE	"cpre288"
+
+//Largest 'stats' report, and the fastest it may be pushed in mux mode
+#define STATS_REPORT_LEN	512
+#define STATS_MIN_INTERVAL	100
+
+//Where a caller's previous 'stats' report left off
+struct StatsWindow {
+	uint32 time;
+	uint32 txBytes;
+};
 
-static uint8 *_rxBuffer;
-static uint8 *_txBuffer;
+static uint8 _txBuffer[UART_TX_BUFFER_SIZE];
 
-os_event_t    user_procTaskQueue[user_procTaskQueueLen];
-static void uart_task(os_event_t *events);
+static os_event_t uartRxQueue[UART_RX_QUEUE_LEN];
+static os_event_t uartTxQueue[UART_TX_QUEUE_LEN];
+static os_event_t backgroundQueue[BACKGROUND_QUEUE_LEN];
+static void uart_rxTask(os_event_t *events);
+static void uart_txTask(os_event_t *events);
+static void background_task(os_event_t *events);
 static void tcp_recvHandler(uint16 len);
+static void tcp_sentHandler();
+static void uart_forward();
+static void uart_capture(uint8 seg);
+static uint8 uart_fillTx();
+static void uart_kickTx();
+static void led_activity();
+static void tcp_connectHandler(uint8 connected);
+static void framing_apply();
+static void tcp_frameHandler(uint8 channel, uint8 *data, uint16 len);
+static void log_handler(char *str);
+static void heap_levelHandler(uint8 level, uint32 free);
+static void stats_push();
+static uint16 stats_report(struct StatsWindow *window, char *buffer, uint16 size);
+static uint8 ctrl_accessHandler(uint32 addr);
+static uint16 ctrl_discoverHandler(char *args, char *buffer, uint16 size);
+static uint16 ctrl_stationsHandler(char *args, char *buffer, uint16 size);
+static uint16 ctrl_testHandler(char *args, char *buffer, uint16 size);
+static uint16 ctrl_statsHandler(char *args, char *buffer, uint16 size);
+static uint16 ctrl_applyHandler(char *args, char *buffer, uint16 size);
+static uint16 ctrl_captureHandler(char *args, char *buffer, uint16 size);
+static uint16 ctrl_heapHandler(char *args, char *buffer, uint16 size);
+#ifdef ISR_PROFILE
+static uint16 ctrl_isrHandler(char *args, char *buffer, uint16 size);
+#endif
+#ifdef TRACE
+static uint16 ctrl_traceHandler(char *args, char *buffer, uint16 size);
+#endif
 
 static void wifi_start();
 static void wifi_stop();
-
-static os_timer_t networkTimer, switchDebounceTimer;
-static int switchState, switchValid;
-static volatile uint8 _ledSet;
+static void wifi_startAp();
+static void sta_start();
+static void mdns_start(uint32 ip);
+static void ap_start(uint8 channel);
+static void ap_configInit();
+static uint8 wifi_scan();
+static void wifi_scanDone(void *arg, STATUS status);
+
+static os_timer_t switchDebounceTimer, ledTimer, flushTimer, txRateTimer, statsTimer;
+static int switchState;
+static uint8 _ledOn, _ledRetrigger, _flushArmed;
 
 static void wifi_handler(System_Event_t *event);
 
-static volatile int uartCount = 0;
 static volatile uint8 _uartTxFlag;
 
+//The last bulk byte written to the UART ended a message
+static uint8 _txBoundary;
+
+//TCP->UART rate limit, urgent messages don't count against it
+static TokenBucket _txBucket;
+static uint8 _txRateArmed;
+
+//Credit or mux mode was changed by 'apply' during a session
+static uint8 _framingPending;
+
+static struct StatsWindow _ctrlWindow, _pushWindow;
+
 static const int ADDR_PIN_NAMES[] = {
 	PERIPHS_IO_MUX_MTMS_U,		//GPIO14
 	PERIPHS_IO_MUX_MTDI_U,		//GPIO12
@@ -77,6 +161,22 @@ static const int SWITCH_PIN = 5;
 static uint8_t WIFI_CHANNELS[] = {1, 6, 11};
 static int WIFI_CHANNEL_COUNT = 3;
 
+static uint8 _apWanted, _apChannel, _channelChosen;
+static struct softap_config _apConfig;
+static struct dhcps_lease _dhcpLease;
+static struct ip_info _apIpInfo;
+
+//Bring-up timing, measured from the switch turning on
+static uint32 _switchOnTime;
+static uint8 _awaitAp, _awaitStation, _awaitClient;
+static os_timer_t rescanTimer;
+static ChannelScores channelScores;
+
+static uint8 _staJoining, _staUp;
+static os_timer_t staJoinTimer;
+static struct mdns_info _mdnsInfo;
+static char _mdnsHost[12];
+
 static void user_gpio_init() {
 	//ADDR_0 - ADDR_3
 	int i;
@@ -91,6 +191,7 @@ static void user_gpio_init() {
 
 	//Switch
 	PIN_FUNC_SELECT(SWITCH_PIN_NAME, SWITCH_PIN_FUNC);
+	GPIO_DIS_OUTPUT(SWITCH_PIN);
 }
 
 static uint8_t getDeviceID() {
@@ -122,11 +223,10 @@ static const char* getSSID() {
 	return id;
 }
 
-void network_task(void *arg) {
-	static uint8_t ledState = 0;
-
+static void switch_update() {
 	int switchValue = !GPIO_INPUT_GET(SWITCH_PIN);
-	if((switchValue != switchState) && switchValid) {
+
+	if(switchValue != switchState) {
 		switchState = switchValue;
 		if(switchState) {
 			wifi_start();
@@ -135,88 +235,136 @@ void network_task(void *arg) {
 			wifi_stop();
 		}
 
-		switchValid = 0;
-		_ledSet = 1;
+		led_activity();
+	}
+}
 
-		os_timer_arm(&switchDebounceTimer, SWITCH_DEBOUNCE_TIME, 0);
+//GPIO edge interrupt, runs from IRAM
+static void switch_intr_handler(void *arg) {
+	uint32 status = GPIO_REG_READ(GPIO_STATUS_ADDRESS);
+	GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, status);
+
+	if(status & (1 << SWITCH_PIN)) {
+		//Ignore bounces until the debounce timer has run
+		gpio_pin_intr_state_set(GPIO_ID_PIN(SWITCH_PIN), GPIO_PIN_INTR_DISABLE);
+
+		//The background queue is shared with error reports and capture
+		//work. If it is full the debounce timer picks the edge up instead,
+		//otherwise the switch would stay ignored for good.
+		if(!system_os_post(BACKGROUND_TASK_PRIORITY, USER_SIG_SWITCH, system_get_time())) {
+			bridgeStats.postFailures++;
+			os_timer_arm(&switchDebounceTimer, SWITCH_DEBOUNCE_TIME, 0);
+		}
 	}
+}
 
-	if(_ledSet) {
-    if(switchState) {
-  		ledState = 1;
-			
-      //Turn on activity LED
-		  GPIO_REG_WRITE(GPIO_OUT_W1TC_ADDRESS, 1 << LED_PIN);
-    }
-    
-    _ledSet = 0;
+void switch_debounce_task() {
+	//Pick up a change that happened while the interrupt was off
+	switch_update();
+
+	gpio_pin_intr_state_set(GPIO_ID_PIN(SWITCH_PIN), GPIO_PIN_INTR_ANYEDGE);
+}
+
+//Flash the activity LED; only runs timers while there is traffic
+void led_activity() {
+	governor_activity();
+
+	if(!switchState) {
+		return;
 	}
 
-	if(ledState) {
-		if(ledState++ > 10) {
-			ledState = 0;
-			GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, 1 << LED_PIN);
-		}
+	if(_ledOn) {
+		_ledRetrigger = 1;
+	}
+	else {
+		_ledOn = 1;
+		_ledRetrigger = 0;
+
+		//Turn on activity LED
+		GPIO_REG_WRITE(GPIO_OUT_W1TC_ADDRESS, 1 << LED_PIN);
+
+		os_timer_arm(&ledTimer, LED_ACTIVITY_TIME, 0);
 	}
 }
 
-void switch_debounce_task() {
-	switchValid = 1;
+void flush_timer_task() {
+	_flushArmed = 0;
+
+	if(uart_hasPartialSegment()) {
+		uart_flushSegment();
+		bridgeStats.deadlineFlushes++;
+	}
+
+	uart_forward();
 }
 
-//Task to process events
-//static void ICACHE_FLASH_ATTR
-static void uart_task(os_event_t *events)
-{
-    switch(events->sig) {
-		case UART_SIG_ERR_FRM: {
-			uart_debugSend("UART RX Frame error\r\n");
-		}
-		break;
+void tx_rate_task() {
+	_txRateArmed = 0;
 
-		case UART_SIG_ERR_PARITY: {
-			uart_debugSend("UART RX Parity error\r\n");
-		}
-		break;
+	uart_kickTx();
+}
+
+void led_timer_task() {
+	if(_ledRetrigger) {
+		_ledRetrigger = 0;
 
+		os_timer_arm(&ledTimer, LED_ACTIVITY_TIME, 0);
+	}
+	else {
+		_ledOn = 0;
+
+		GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, 1 << LED_PIN);
+	}
+}
+
+static void pipeline_record(volatile struct PipelineStats *stats, os_event_t *event) {
+	uint32 latency = system_get_time() - event->par;
+
+	stats->events++;
+	stats->latencyTotal += latency;
+	if(latency > stats->latencyMax) {
+		stats->latencyMax = latency;
+	}
+}
+
+//UART->TCP pipeline
+static void uart_rxTask(os_event_t *events)
+{
+	pipeline_record(&bridgeStats.rxPipeline, events);
+
+    switch(events->sig) {
 		case UART_SIG_RXOVF: {
 			uart_debugSend("UART RX overflow\r\n");
 		}
 		case UART_SIG_RECV: {
-			static int bytesRecv = 0;
-
       //Set the activity LED
-      _ledSet = 1;
-
-			//Echo data
-			int count = uart_get((char*)_rxBuffer, UART_RX_BUFFER_SIZE);
-
-			bytesRecv += count;
-			
-			if(count > 0) {
-				tcp_send((uint8*)_rxBuffer, count);
+      led_activity();
 
-				uartCount = 0;
-
-			}
+			uart_forward();
 		}
     break;
 
+    default:
+      break;
+    }
+}
+
+//TCP->UART pipeline
+static void uart_txTask(os_event_t *events)
+{
+	pipeline_record(&bridgeStats.txPipeline, events);
 
-		
+    switch(events->sig) {
 		case UART_SIG_TXTO: {
 			//Transmit FIFO near empty
+			uint8 toSend = uart_fillTx();
 
-			//Grab as much as we can send
-			uint8 sendSpace = uart_getTxFifoAvail();
-			uint8 toSend = tcp_receive(_txBuffer, sendSpace);
+			//Drained receive segments can be lent to the RX side
+			uart_rxResume();
 
 			if(toSend > 0) {
-				//Fill the FIFO
-				uart0_send_nowait(_txBuffer, toSend);
-
 				uart_set_txto();
-				_ledSet = 1;
+				led_activity();
 			}
 			else {
 				uart_clear_txto();
@@ -227,75 +375,303 @@ static void uart_task(os_event_t *events)
 		break;
 
     default:
-      //os_delay_us(10);
       break;
     }
+}
+
+//Error reports and switch events, lowest priority
+static void background_task(os_event_t *events)
+{
+	pipeline_record(&bridgeStats.bgPipeline, events);
+
+    switch(events->sig) {
+		case USER_SIG_SWITCH: {
+			switch_update();
+
+			os_timer_arm(&switchDebounceTimer, SWITCH_DEBOUNCE_TIME, 0);
+		}
+		break;
+
+		case UART_SIG_ERR_FRM: {
+			uart_debugSend("UART RX Frame error\r\n");
+		}
+		break;
+
+		case UART_SIG_ERR_PARITY: {
+			uart_debugSend("UART RX Parity error\r\n");
+		}
+		break;
+
+		case CAPTURE_SIG_WORK: {
+			//Flash erase and write stall everything but the ISRs, so
+			//they run here and one at a time
+			capture_work();
+		}
+		break;
 
-		//os_delay_us(100);
+    default:
+      break;
+    }
 }
 
 void wifi_start() {
+	_apWanted = 1;
+
+	_switchOnTime = system_get_time();
+	_awaitAp = _awaitStation = _awaitClient = 1;
+	bridgeStats.apStartUs = bridgeStats.staConnectUs = bridgeStats.tcpConnectUs = 0;
+	bridgeStats.staJoinUs = 0;
+
+	if(settings.staSsid[0] != '\0') {
+		sta_start();
+	}
+	else {
+		wifi_startAp();
+	}
+}
+
+void wifi_startAp() {
+#if WIFI_CHANNEL_AUTO
+	//The scan takes seconds, later toggles reuse its result
+	if(!_channelChosen && wifi_scan()) {
+		//AP is started from wifi_scanDone
+		return;
+	}
+#endif
+
+	ap_start(_apChannel);
+}
+
+uint8 wifi_scan() {
+	//Scanning needs the station interface, but it must not join anything
+	wifi_set_opmode_current(STATIONAP_MODE);
+	wifi_station_set_auto_connect(0);
+	wifi_station_disconnect();
+
+	return wifi_station_scan(NULL, &wifi_scanDone);
+}
+
+void wifi_scanDone(void *arg, STATUS status) {
+	//Switched off while scanning
+	if(!_apWanted) {
+		return;
+	}
+
+	if(status == OK) {
+		struct bss_info *bss;
+
+		ChannelScore_reset(&channelScores);
+
+		for(bss = (struct bss_info*)arg; bss != NULL; bss = STAILQ_NEXT(bss, next)) {
+			ChannelScore_add(&channelScores, bss->channel, bss->rssi);
+		}
+
+		_apChannel = ChannelScore_best(&channelScores, WIFI_CHANNELS,
+			WIFI_CHANNEL_COUNT, _apChannel);
+		_channelChosen = 1;
+	}
+
+	ap_start(_apChannel);
+
+#if WIFI_RESCAN_INTERVAL > 0
+	os_timer_arm(&rescanTimer, WIFI_RESCAN_INTERVAL, 0);
+#endif
+}
+
+void wifi_rescan_task() {
+	//Only hop while nobody would be dropped by it
+	if(_apWanted && !tcp_isConnected() && (wifi_softap_get_station_num() == 0)) {
+		if(wifi_scan()) {
+			return;
+		}
+	}
+
+	os_timer_arm(&rescanTimer, WIFI_RESCAN_INTERVAL, 0);
+}
+
+//Everything but the channel is fixed once the DIP switches and settings are read
+void ap_configInit() {
+	const char* ssid = (settings.ssid[0] != '\0') ? settings.ssid : getSSID();
+
+	os_memset(&_apConfig, 0, sizeof(_apConfig));
+	strcpy((char*)_apConfig.ssid, ssid);
+	strcpy((char*)_apConfig.password, settings.psk);
+	_apConfig.ssid_len = strlen(ssid);
+	_apConfig.channel = WIFI_CHANNELS[getDeviceID() % WIFI_CHANNEL_COUNT];
+	_apConfig.authmode = AUTH_WPA2_PSK;
+	_apConfig.ssid_hidden = 0;
+	_apConfig.max_connection = AP_MAX_CONNECTIONS;
+	_apConfig.beacon_interval = 100;
+
+	_dhcpLease.start_ip.addr = ipaddr_addr(DHCP_IP_START);
+	_dhcpLease.end_ip.addr = ipaddr_addr(DHCP_IP_END);
+
+	_apIpInfo.ip.addr = ipaddr_addr(AP_GATEWAY);
+	_apIpInfo.gw.addr = ipaddr_addr(AP_GATEWAY);
+	_apIpInfo.netmask.addr = ipaddr_addr(AP_NETMASK);
+
+	_apChannel = _apConfig.channel;
+	_channelChosen = 0;
+
+	//A configured channel is used as is, without scanning
+	if(settings.channel != 0) {
+		_apConfig.channel = _apChannel = settings.channel;
+		_channelChosen = 1;
+	}
+}
+
+static uint8 ap_configMatches(struct softap_config *config) {
+	return (config->channel == _apConfig.channel)
+		&& (config->authmode == _apConfig.authmode)
+		&& (config->max_connection == _apConfig.max_connection)
+		&& (config->ssid_len == _apConfig.ssid_len)
+		&& (os_memcmp(config->ssid, _apConfig.ssid, _apConfig.ssid_len) == 0)
+		&& (os_strcmp((char*)config->password, (char*)_apConfig.password) == 0);
+}
+
+//Only touches what the SDK doesn't already have, and never writes flash
+void ap_start(uint8 channel) {
+	struct softap_config current;
+	struct ip_info ipInfo;
+
 	//Set to SoftAP mode
-	wifi_set_opmode(SOFTAP_MODE);
-
-	//SoftAP configuration
-	struct softap_config apConfig = {
-		.channel = WIFI_CHANNELS[getDeviceID() % WIFI_CHANNEL_COUNT],
-		.authmode = AUTH_WPA2_PSK,
-		.ssid_hidden = 0,
-		.max_connection = AP_MAX_CONNECTIONS,
-		.beacon_interval = 100
-	};
+	wifi_set_opmode_current(SOFTAP_MODE);
 
-	const char* ssid = getSSID();
-	strcpy(apConfig.ssid, ssid);
-	strcpy(apConfig.password, AP_PSK);
-	apConfig.ssid_len = strlen(ssid);
+	_apConfig.channel = channel;
 
-	//Set configuration
-	wifi_softap_set_config(&apConfig);
+	wifi_softap_get_config(&current);
+	if(!ap_configMatches(&current)) {
+		wifi_softap_set_config_current(&_apConfig);
+	}
 
-	//Disable power saving mode
-	//This seems to help reduce jitter in latency
-	//wifi_set_sleep_type(NONE_SLEEP_T);
+	//Sleep type and CPU clock are managed by the governor
 
-	//DHCP configuration
-	struct dhcps_lease dhcpLease = {
-		.start_ip = ipaddr_addr(DHCP_IP_START),
-		.end_ip = ipaddr_addr(DHCP_IP_END)
-	};
+	wifi_get_ip_info(SOFTAP_IF, &ipInfo);
+	if(ipInfo.ip.addr != _apIpInfo.ip.addr) {
+		//Disable DHCP server while making changes
+		wifi_softap_dhcps_stop();
+		wifi_softap_set_dhcps_lease(&_dhcpLease);
 
-	//Disable DHCP server while making changes
-	wifi_softap_dhcps_stop();
-	wifi_softap_set_dhcps_lease(&dhcpLease);
+		wifi_set_ip_info(SOFTAP_IF, &_apIpInfo);
 
-	//Set IP info
-	struct ip_info ipInfo = {
-		.ip = ipaddr_addr(AP_GATEWAY),
-		.gw = ipaddr_addr(AP_GATEWAY),
-		.netmask = ipaddr_addr(AP_NETMASK)
-	};
-	wifi_set_ip_info(SOFTAP_IF, &ipInfo);
-	
-	//Restart DHCP server
-	wifi_softap_dhcps_start();
+		//Restart DHCP server
+		wifi_softap_dhcps_start();
+	}
 
-	//Set WiFi event handler
-	wifi_set_event_handler_cb(&wifi_handler);
+	if(_awaitAp) {
+		_awaitAp = 0;
+		bridgeStats.apStartUs = system_get_time() - _switchOnTime;
+	}
+}
+
+void sta_start() {
+	struct station_config config;
+
+	wifi_set_opmode_current(STATION_MODE);
+
+	os_memset(&config, 0, sizeof(config));
+	strcpy((char*)config.ssid, settings.staSsid);
+	strcpy((char*)config.password, settings.staPsk);
+	config.bssid_set = 0;
+	wifi_station_set_config_current(&config);
+
+	//The SDK keeps retrying on its own, the join timer bounds how long
+	wifi_station_set_reconnect_policy(true);
+	wifi_station_connect();
+
+	_staJoining = 1;
+	os_timer_arm(&staJoinTimer, STA_JOIN_TIMEOUT, 0);
+}
+
+void sta_join_timeout() {
+	if(!_apWanted || !_staJoining) {
+		return;
+	}
+
+	_staJoining = 0;
+	bridgeStats.staFallbacks++;
+
+	//Stay on the AP until the switch is toggled again
+	wifi_station_disconnect();
+	wifi_startAp();
+}
+
+void mdns_start(uint32 ip) {
+	os_sprintf(_mdnsHost, "cybot-%d", getDeviceID());
+
+	os_memset(&_mdnsInfo, 0, sizeof(_mdnsInfo));
+	_mdnsInfo.host_name = _mdnsHost;
+	_mdnsInfo.server_name = MDNS_SERVICE;
+	_mdnsInfo.server_port = settings.tcpPort;
+	_mdnsInfo.ipAddr = ip;
+	_mdnsInfo.txt_data[0] = "proto=raw";
+
+	espconn_mdns_init(&_mdnsInfo);
 }
 
 void wifi_stop() {
-	wifi_set_opmode(NULL_MODE);
+	_apWanted = 0;
+	os_timer_disarm(&rescanTimer);
+	os_timer_disarm(&staJoinTimer);
+
+	if(_staUp) {
+		espconn_mdns_close();
+	}
+	_staJoining = _staUp = 0;
+
+	//Stations go with the AP
+	clients_init();
+
+	//Radio off, configuration stays cached in the SDK
+	wifi_set_opmode_current(NULL_MODE);
 }
 
 void wifi_handler(System_Event_t *event) {
 	switch(event->event) {
 		case EVENT_SOFTAPMODE_STACONNECTED:
-			//TODO: Perhaps do something with this information
+			clients_associated(event->event_info.sta_connected.mac);
+
+			if(_awaitStation) {
+				_awaitStation = 0;
+				bridgeStats.staConnectUs = system_get_time() - _switchOnTime;
+			}
 		break;
 
 		case EVENT_SOFTAPMODE_STADISCONNECTED:
-			//TODO: Maybe do something here?
+			//Don't wait for the TCP keepalive to notice, the next client
+			//can only connect once the session is gone
+			if(clients_disassociated(event->event_info.sta_disconnected.mac)) {
+				tcp_disconnect();
+				bridgeStats.sessionsDropped++;
+			}
+		break;
+
+		case EVENT_SOFTAPMODE_PROBEREQRECVED:
+			clients_probed(event->event_info.ap_probereqrecved.mac,
+				event->event_info.ap_probereqrecved.rssi);
+		break;
+
+		case EVENT_STAMODE_GOT_IP:
+			if(_staJoining) {
+				os_timer_disarm(&staJoinTimer);
+				_staJoining = 0;
+				_staUp = 1;
+
+				bridgeStats.staJoinUs = system_get_time() - _switchOnTime;
+
+				mdns_start(event->event_info.got_ip.ip.addr);
+			}
+		break;
+
+		case EVENT_STAMODE_DISCONNECTED:
+			//Give the SDK's reconnect the same time as the first join
+			if(_staUp && _apWanted) {
+				espconn_mdns_close();
+				_staUp = 0;
+
+				_staJoining = 1;
+				os_timer_arm(&staJoinTimer, STA_JOIN_TIMEOUT, 0);
+			}
 		break;
 
 		default:
@@ -303,18 +679,628 @@ void wifi_handler(System_Event_t *event) {
 	}
 }
 
-void tcp_recvHandler(uint16 len) {
-	if(_uartTxFlag == 0) {
-		//Grab as much as we can currently send
-		uint8 sendSpace = uart_getTxFifoAvail();
-		uint8 toSend = tcp_receive(_txBuffer, sendSpace);
+//Hand filled UART segments to the TCP layer
+void uart_forward() {
+	uint8 seg;
+	uint8 packets = (uart_getFlushMode() == UART_FLUSH_PACKET) && udp_hasPeer();
+	uint8 connected = packets || tcp_isConnected();
+	uint8 capturing = capture_active(connected);
+
+	if(uart_getFlushMode() == UART_FLUSH_IDLE) {
+		//Nothing in flight, so don't make a partial segment wait for more data
+		if(tcp_isIdle() || (capturing && !connected)) {
+			uart_flushSegment();
+		}
+	}
+	else if((uart_getFlushMode() == UART_FLUSH_LINE) && !_flushArmed && uart_hasPartialSegment()) {
+		//A line without its delimiter goes out after the deadline
+		_flushArmed = 1;
+		os_timer_arm(&flushTimer, settings.flushDeadline, 0);
+	}
+
+	//Packets go out as datagrams when a host has asked for them
+	if(packets) {
+		while((seg = uart_getSegment()) != SEGMENT_NONE) {
+			if(capturing) {
+				uart_capture(seg);
+			}
+
+			udp_sendSegment(seg);
+		}
+
+		uart_rxResume();
+		return;
+	}
+
+	while((seg = uart_getSegment()) != SEGMENT_NONE) {
+		if(capturing) {
+			uart_capture(seg);
+
+			//Without a client the capture log is the only copy
+			if(!connected) {
+				SegmentPool_free(seg);
+				continue;
+			}
+		}
+
+		tcp_sendSegment(seg);
+	}
+
+	if(capturing && !connected) {
+		uart_rxResume();
+	}
+}
+
+void uart_capture(uint8 seg) {
+	Segment *segment = SegmentPool_get(seg);
+
+	capture_write(segment->data + segment->offset, segment->len - segment->offset);
+}
+
+//Fill the UART TX FIFO with as much as it takes, returns the number of
+//bytes written. Urgent messages go first, but only between two bulk
+//messages: in line mode a message ends with a delimiter. Otherwise the
+//bridge can't tell where messages end, received data is merged into
+//whole segments, so only a drained bulk queue is a boundary.
+uint8 uart_fillTx() {
+	uint8 sendSpace = uart_getTxFifoAvail();
+	uint8 len = 0, bulk, bulkSpace;
+	uint8 lineMode = (uart_getFlushMode() == UART_FLUSH_LINE);
+	uint32 tokens;
+
+	while(_txBoundary && priority_pending() && (sendSpace - len >= PRIORITY_MAX_LEN)) {
+		len += priority_take(_txBuffer + len);
+	}
+
+	bulkSpace = sendSpace - len;
+	tokens = TokenBucket_available(&_txBucket);
+	if(tokens < bulkSpace) {
+		bulkSpace = tokens;
+	}
+
+	//Bulk stops at the next boundary while an urgent message waits
+	if(lineMode && priority_pending()) {
+		bulk = tcp_receiveUntil(_txBuffer + len, bulkSpace,
+			settings.flushDelims, SETTINGS_DELIMS_LEN);
+	}
+	else {
+		bulk = tcp_receive(_txBuffer + len, bulkSpace);
+	}
+	TokenBucket_consume(&_txBucket, bulk);
+
+	//Out of tokens with data left, come back for a full refill once the
+	//TX pipeline has gone idle
+	if((bulk == bulkSpace) && (bulkSpace < sendSpace - len) && !_txRateArmed
+		&& (tcp_getReceived() > 0)) {
+		uint32 wait = TokenBucket_delay(&_txBucket, sendSpace - len);
+
+		_txRateArmed = 1;
+		os_timer_arm(&txRateTimer, wait ? wait : 1, 0);
+
+		bridgeStats.rateLimitedDown++;
+		bridgeStats.rateDelayDown += wait;
+	}
+
+	if(lineMode && (bulk > 0)) {
+		uint8 last = _txBuffer[len + bulk - 1];
+
+		//Delimiters are zero padded
+		_txBoundary = (last != 0) && (memchr(settings.flushDelims, last, SETTINGS_DELIMS_LEN) != NULL);
+	}
+	else if(!lineMode && (bulkSpace > 0)) {
+		_txBoundary = (tcp_getReceived() == 0);
+	}
+	len += bulk;
+
+	if(len > 0) {
+		uart0_send_nowait(_txBuffer, len);
+		bridgeStats.uartTxBytes += len;
+	}
+
+	return len;
+}
 
-		uart0_send_nowait(_txBuffer, toSend);
+//Start the TX pipeline if it isn't running
+void uart_kickTx() {
+	if(_uartTxFlag == 0) {
+		uart_fillTx();
 		uart_set_txto();
 
 		_uartTxFlag = 1;
-		_ledSet = 1;
+		led_activity();
+	}
+}
+
+void tcp_sentHandler() {
+	testmode_sent();
+	capture_pump();
+
+	//Segments went back to the pool, let the RX ISR continue
+	uart_rxResume();
+
+	uart_forward();
+}
+
+void tcp_connectHandler(uint8 connected) {
+	//A connected client keeps the bridge in performance mode
+	if(connected) {
+		governor_activity();
+		clients_sessionStarted(tcp_getRemoteAddr());
+		testmode_sent();
+
+		if(_awaitClient) {
+			_awaitClient = 0;
+			bridgeStats.tcpConnectUs = system_get_time() - _switchOnTime;
+		}
+	}
+	else {
+		clients_sessionEnded();
+
+		os_timer_disarm(&statsTimer);
+
+		if(_framingPending) {
+			framing_apply();
+		}
+	}
+}
+
+//The client has to know how the stream is framed from the start, so
+//credit and mux mode only change between sessions
+void framing_apply() {
+	uint8 seg, headroom = tcp_getHeadroom();
+
+	_framingPending = 0;
+
+	tcp_setCreditMode(settings.creditMode);
+	tcp_setMuxMode(settings.muxMode);
+
+	//UART data collected so far has no room for the new frame header,
+	//and there is no client to send it to
+	if(tcp_getHeadroom() != headroom) {
+		uart_flushSegment();
+		while((seg = uart_getSegment()) != SEGMENT_NONE) {
+			SegmentPool_free(seg);
+		}
+
+		uart_setRxHeadroom(tcp_getHeadroom());
+	}
+}
+
+//Control and stats requests on a multiplexed connection
+void tcp_frameHandler(uint8 channel, uint8 *data, uint16 len) {
+	char line[FRAME_MAX_MESSAGE + 1];
+
+	switch(channel) {
+		case FRAME_CONTROL: {
+			const char *reply;
+			uint16 replyLen;
+
+			os_memcpy(line, data, len);
+			line[len] = '\0';
+
+			replyLen = ctrl_execute(line, &reply);
+			tcp_sendFrame(FRAME_CONTROL, (const uint8*)reply, replyLen);
+		}
+		break;
+
+		case FRAME_STATS: {
+			uint32 interval = 0;
+			uint16 i;
+
+			//Empty asks for one report, a number sets the push interval
+			if(len == 0) {
+				stats_push();
+				break;
+			}
+
+			for(i = 0; (i < len) && (data[i] >= '0') && (data[i] <= '9'); ++i) {
+				interval = interval*10 + (data[i] - '0');
+			}
+
+			os_timer_disarm(&statsTimer);
+			if(interval > 0) {
+				os_timer_arm(&statsTimer,
+					(interval < STATS_MIN_INTERVAL) ? STATS_MIN_INTERVAL : interval, 1);
+			}
+		}
+		break;
+
+		case FRAME_CAPTURE: {
+			capture_startDump();
+		}
+		break;
+
+		default:
+			break;
+	}
+}
+
+void stats_push() {
+	static char report[STATS_REPORT_LEN];
+
+	tcp_sendFrame(FRAME_STATS, (uint8*)report,
+		stats_report(&_pushWindow, report, sizeof(report)));
+}
+
+//Debug messages go to the log channel of a multiplexed client. Sending
+//can log in turn, that message is dropped.
+void log_handler(char *str) {
+	static uint8 busy;
+
+	if(busy || !tcp_getMuxMode()) {
+		return;
+	}
+
+	busy = 1;
+	tcp_sendFrame(FRAME_LOG, (uint8*)str, os_strlen(str));
+	busy = 0;
+}
+
+//Low-water alarm, the TCP layer backs off until the heap recovers
+void heap_levelHandler(uint8 level, uint32 free) {
+	char msg[64];
+
+	tcp_setMemoryLevel(level);
+
+	os_sprintf(msg, "[Heap] %s, %u free\r\n", heap_levelName(level), free);
+	uart_debugSend(msg);
+}
+
+void tcp_recvHandler(uint16 len) {
+	//Echo and sink modes keep client data away from the UART
+	if(testmode_recv()) {
+		return;
+	}
+
+	uart_kickTx();
+}
+
+//On the AP only stations that joined it can reach the bridge. On someone
+//else's network anyone can, so there only the robot's own client may
+//change things
+uint8 ctrl_accessHandler(uint32 addr) {
+	if(!_staUp) {
+		return 1;
+	}
+
+	return tcp_isConnected() && (addr == tcp_getRemoteAddr());
+}
+
+//Everything is read from state that is kept anyway, nothing extra is
+//tracked on the data path for this
+uint16 ctrl_discoverHandler(char *args, char *buffer, uint16 size) {
+	static const char *GOVERNOR_NAMES[] = { "powersave", "performance" };
+
+	//Worst case is well below this
+	if(size < 256) {
+		return 0;
+	}
+
+	return os_sprintf(buffer,
+		"id=%d\n"
+		"port=%d\n"
+		"build=" __DATE__ " " __TIME__ "\n"
+		"wifi=%s\n"
+		"clients=%d\n"
+		"stations=%d\n"
+		"governor=%s\n"
+		"baud=%u\n"
+		"autobaud=%s\n"
+		"segments=%d/%d/%d\n"
+		"uart_rx=%u\n"
+		"tcp_rx=%u\n",
+		getDeviceID(),
+		settings.tcpPort,
+		_staUp ? "station" : (_apWanted ? "ap" : "off"),
+		tcp_isConnected(),
+		wifi_softap_get_station_num(),
+		GOVERNOR_NAMES[governor_getMode()],
+		uart_getBaudrate(),
+		autobaud_getStateName(),
+		SegmentPool_getUsed(SEGMENT_UART_RX), SegmentPool_getUsed(SEGMENT_TCP_RX),
+		SEGMENT_POOL_COUNT,
+		bridgeStats.uartRxBytes,
+		bridgeStats.tcpRxBytes);
+}
+
+//Station mode has no SoftAP stations, but the uplink signal is known
+uint16 ctrl_stationsHandler(char *args, char *buffer, uint16 size) {
+	uint16 len = clients_report(buffer, size);
+
+	if(_staUp && (size - len >= 16)) {
+		len += os_sprintf(buffer + len, "uplink_rssi=%d\n", wifi_station_get_rssi());
+	}
+
+	return len;
+}
+
+//"test <mode>" switches and reports, plain "test" only reports
+uint16 ctrl_testHandler(char *args, char *buffer, uint16 size) {
+	uint8 mode;
+
+	while(*args == ' ') {
+		args++;
+	}
+
+	if(*args != '\0') {
+		mode = testmode_parse(args);
+		if(mode == TEST_UNKNOWN) {
+			return CTRL_INVALID;
+		}
+
+		testmode_set(mode);
+	}
+
+	return testmode_report(buffer, size);
+}
+
+//Details of the UART->TCP path, see the 'stats' sections
+static uint16 stats_pathReport(char *buffer, uint16 size) {
+	if(size < 128) {
+		return 0;
+	}
+
+	return os_sprintf(buffer,
+		"bytes_copied=%u\n"
+		"line_flushes=%u\n"
+		"deadline_flushes=%u\n"
+		"uart_packets=%u\n",
+		bridgeStats.bytesCopied,
+		bridgeStats.lineFlushes,
+		bridgeStats.deadlineFlushes,
+		bridgeStats.uartPackets);
+}
+
+//Dispatch latency of the task pipelines, from ISR post to task start
+static uint16 stats_tasksReport(char *buffer, uint16 size) {
+	static const char *NAMES[] = { "rx", "tx", "bg" };
+	const volatile struct PipelineStats *pipelines[] = {
+		&bridgeStats.rxPipeline, &bridgeStats.txPipeline, &bridgeStats.bgPipeline
+	};
+	uint16 len = 0;
+	uint8 i;
+
+	if(size < 256) {
+		return 0;
+	}
+
+	for(i = 0; i < 3; ++i) {
+		uint32 events = pipelines[i]->events;
+
+		len += os_sprintf(buffer + len,
+			"%s_events=%u\n"
+			"%s_avg_us=%u\n"
+			"%s_max_us=%u\n",
+			NAMES[i], events,
+			NAMES[i], events ? pipelines[i]->latencyTotal / events : 0,
+			NAMES[i], pipelines[i]->latencyMax);
+	}
+
+	len += os_sprintf(buffer + len, "post_failures=%u\n", bridgeStats.postFailures);
+
+	return len;
+}
+
+//Time in each governor mode, the current interval included
+static uint16 stats_governorReport(char *buffer, uint16 size) {
+	if(size < 128) {
+		return 0;
+	}
+
+	governor_updateStats();
+
+	return os_sprintf(buffer,
+		"governor=%s\n"
+		"governor_transitions=%u\n"
+		"powersave_ms=%u\n"
+		"performance_ms=%u\n",
+		(governor_getMode() == GOVERNOR_PERFORMANCE) ? "performance" : "powersave",
+		bridgeStats.governorTransitions,
+		bridgeStats.governorTime[GOVERNOR_POWERSAVE],
+		bridgeStats.governorTime[GOVERNOR_PERFORMANCE]);
+}
+
+//Bring-up after the last switch-on, 0 for steps that haven't happened,
+//then what happened to stations since boot
+static uint16 stats_wifiReport(char *buffer, uint16 size) {
+	if(size < 192) {
+		return 0;
 	}
+
+	return os_sprintf(buffer,
+		"ap_start_us=%u\n"
+		"sta_connect_us=%u\n"
+		"tcp_connect_us=%u\n"
+		"sta_join_us=%u\n"
+		"sta_fallbacks=%u\n"
+		"sessions_dropped=%u\n",
+		bridgeStats.apStartUs,
+		bridgeStats.staConnectUs,
+		bridgeStats.tcpConnectUs,
+		bridgeStats.staJoinUs,
+		bridgeStats.staFallbacks,
+		bridgeStats.sessionsDropped);
+}
+
+//"stats" reports the data path counters, "stats <section>" the rest:
+//"path" for how UART data was turned into segments, "tasks" for how
+//quickly the task pipelines picked up their events, "governor" for the
+//time spent in each power mode, "wifi" for how long bring-up took
+uint16 ctrl_statsHandler(char *args, char *buffer, uint16 size) {
+	while(*args == ' ') {
+		args++;
+	}
+
+	if(strcmp(args, "path") == 0) {
+		return stats_pathReport(buffer, size);
+	}
+	else if(strcmp(args, "tasks") == 0) {
+		return stats_tasksReport(buffer, size);
+	}
+	else if(strcmp(args, "governor") == 0) {
+		return stats_governorReport(buffer, size);
+	}
+	else if(strcmp(args, "wifi") == 0) {
+		return stats_wifiReport(buffer, size);
+	}
+	else if(*args != '\0') {
+		return CTRL_INVALID;
+	}
+
+	return stats_report(&_ctrlWindow, buffer, size);
+}
+
+//The data path counters. Rates are over the time since the previous
+//report with the same 'window', so pushed reports and polling from the
+//control port don't shorten each other's window.
+uint16 stats_report(struct StatsWindow *window, char *buffer, uint16 size) {
+	uint32 prioCount = bridgeStats.priorityLane.events;
+	uint32 now = system_get_time();
+	uint32 txBytes = bridgeStats.uartTxBytes;
+	uint32 ms = (now - window->time) / 1000;
+	uint32 txUtil;
+
+	//Worst case is just below this
+	if(size < 500) {
+		return 0;
+	}
+
+	//Share of the UART TX line time used in the window, at 10 bits per byte
+	txUtil = ms ? (uint32)(((uint64)(txBytes - window->txBytes) * 10 * 1000 * 100)
+		/ ((uint64)uart_getBaudrate() * ms)) : 0;
+	window->time = now;
+	window->txBytes = txBytes;
+
+	return os_sprintf(buffer,
+		"uart_rx=%u\n"
+		"uart_tx=%u\n"
+		"uart_tx_util_pct=%u\n"
+		"tcp_tx=%u\n"
+		"tcp_rx=%u\n"
+		"tcp_rx_dropped=%u\n"
+		"segments_dropped=%u\n"
+		"rx_stalls=%u\n"
+		"post_failures=%u\n"
+		"prio=%u\n"
+		"prio_avg_us=%u\n"
+		"prio_max_us=%u\n"
+		"prio_dropped=%u\n"
+		"send_retries=%u\n"
+		"rate_limited_up=%u\n"
+		"rate_delay_up_ms=%u\n"
+		"rate_limited_down=%u\n"
+		"rate_delay_down_ms=%u\n"
+		"credit_frames=%u\n"
+		"mux_frames=%u\n"
+		"mux_dropped=%u\n",
+		bridgeStats.uartRxBytes,
+		txBytes,
+		txUtil,
+		bridgeStats.tcpTxBytes,
+		bridgeStats.tcpRxBytes,
+		bridgeStats.tcpRxDropped,
+		bridgeStats.segmentsDropped,
+		bridgeStats.rxStalls,
+		bridgeStats.postFailures,
+		prioCount,
+		prioCount ? bridgeStats.priorityLane.latencyTotal / prioCount : 0,
+		bridgeStats.priorityLane.latencyMax,
+		bridgeStats.priorityDropped,
+		bridgeStats.sendRetries,
+		bridgeStats.rateLimitedUp, bridgeStats.rateDelayUp,
+		bridgeStats.rateLimitedDown, bridgeStats.rateDelayDown,
+		bridgeStats.creditFrames,
+		bridgeStats.muxFrames,
+		bridgeStats.muxDropped);
+}
+
+//"capture <mode>" switches until the next boot, "capture clear" erases
+//the log, plain "capture" only reports
+uint16 ctrl_captureHandler(char *args, char *buffer, uint16 size) {
+	uint8 mode;
+
+	while(*args == ' ') {
+		args++;
+	}
+
+	if(strcmp(args, "clear") == 0) {
+		capture_clear();
+	}
+	else if(*args != '\0') {
+		mode = capture_parse(args);
+		if(mode == CAPTURE_UNKNOWN) {
+			return CTRL_INVALID;
+		}
+
+		capture_setMode(mode);
+	}
+
+	return capture_report(buffer, size);
+}
+
+uint16 ctrl_heapHandler(char *args, char *buffer, uint16 size) {
+	return heap_report(buffer, size);
+}
+
+#ifdef ISR_PROFILE
+//"isr" reports UART handler timing, "isr hist" the run time histogram,
+//"isr reset" starts over
+uint16 ctrl_isrHandler(char *args, char *buffer, uint16 size) {
+	while(*args == ' ') {
+		args++;
+	}
+
+	if(strcmp(args, "hist") == 0) {
+		return isrprofile_histogram(buffer, size);
+	}
+	else if(strcmp(args, "reset") == 0) {
+		isrprofile_reset();
+	}
+	else if(*args != '\0') {
+		return CTRL_INVALID;
+	}
+
+	return isrprofile_report(buffer, size);
+}
+#endif
+
+#ifdef TRACE
+//"trace" hands out the oldest recorded events, poll it until
+//'trace_left' is 0
+uint16 ctrl_traceHandler(char *args, char *buffer, uint16 size) {
+	return trace_report(buffer, size);
+}
+#endif
+
+//Puts the UART and rate settings into effect without a reboot. Bytes on
+//the line while the baud rate changes are garbled. With autobaud set the
+//rate is detected again. Credit and mux mode wait for the session to end.
+uint16 ctrl_applyHandler(char *args, char *buffer, uint16 size) {
+	if(settings.autobaud) {
+		autobaud_start(settings.baud);
+	}
+	else {
+		autobaud_stop();
+		UART_SetBaudrate(UART0, settings.baud);
+	}
+	uart_setPacketGap(settings.packetGap ? settings.packetGap : PACKET_GAP_BITS);
+	uart_setFlushPolicy(settings.flushMode, settings.flushDelims);
+	priority_setEscape(settings.priorityEscape);
+
+	tcp_setSendRate(settings.rateUp, settings.rateBurst);
+	TokenBucket_init(&_txBucket, settings.rateDown, settings.rateBurst);
+
+	if((settings.creditMode != tcp_getCreditMode()) || (settings.muxMode != tcp_getMuxMode())) {
+		if(!tcp_isConnected()) {
+			framing_apply();
+		}
+		else {
+			_framingPending = 1;
+			return (size >= 32) ? os_sprintf(buffer, "framing=next session\n") : 0;
+		}
+	}
+
+	return 0;
 }
 
 //Init function 
@@ -323,43 +1309,126 @@ user_init()
 {
     //Remove debug statements from UART0
     system_set_os_print(0);
+
+		//Everything below may depend on the stored settings
+		settings_init();
 		
 		// Initialize the GPIO subsystem.
     gpio_init();
 
 		//Initialize UART
-		uart_init(BAUD, BAUD);
+		uart_init(settings.baud, settings.baud);
+		SegmentPool_setFloor(SEGMENT_UART_RX, settings.floorUartRx);
+		SegmentPool_setFloor(SEGMENT_TCP_RX, settings.floorTcpRx);
+		uart_setPacketGap(settings.packetGap ? settings.packetGap : PACKET_GAP_BITS);
+		uart_setFlushPolicy(settings.flushMode, settings.flushDelims);
+		priority_setEscape(settings.priorityEscape);
+
+		//Whatever arrives before the rate is known is dropped
+		if(settings.autobaud) {
+			autobaud_start(settings.baud);
+		}
 
 		//Initialize user GPIO pins
 		user_gpio_init();
 
-		_rxBuffer = (uint8*)os_malloc(UART_RX_BUFFER_SIZE);
-		_txBuffer = (uint8*)os_malloc(UART_TX_BUFFER_SIZE);
+#ifdef TRACE
+		trace_init();
+#endif
 
 		_uartTxFlag = 0;
+		_txBoundary = 1;
+		_txRateArmed = 0;
+
+		ap_configInit();
+		clients_init();
+		heap_init();
+		capture_init(settings.captureMode, BACKGROUND_TASK_PRIORITY);
+
+		//Make sure the SDK doesn't bring up a stale AP from flash at boot,
+		//this only writes flash the first time
+		if(wifi_get_opmode_default() != NULL_MODE) {
+			wifi_set_opmode(NULL_MODE);
+		}
 
 		//Turn of AP
 		wifi_stop();
 
+		//Set WiFi event handler
+		wifi_set_event_handler_cb(&wifi_handler);
+
 		//Start TCP server
-		tcp_start(TCP_PORT);
+		tcp_setRecvHeadroom(settings.recvHeadroom);
+		tcp_start(settings.tcpPort);
+		tcp_setSendRate(settings.rateUp, settings.rateBurst);
+		tcp_setCreditMode(settings.creditMode);
+		tcp_setMuxMode(settings.muxMode);
+		uart_setRxHeadroom(tcp_getHeadroom());
+		TokenBucket_init(&_txBucket, settings.rateDown, settings.rateBurst);
 		tcp_setRecvHandler(&tcp_recvHandler);
-
-		_ledSet = 0;
+		tcp_setSentHandler(&tcp_sentHandler);
+		tcp_setConnectHandler(&tcp_connectHandler);
+		tcp_setFrameHandler(&tcp_frameHandler);
+		uart_setDebugHandler(&log_handler);
+		heap_setLevelHandler(&heap_levelHandler);
+
+		//Settings can be changed over UDP without a reflash
+		ctrl_start(CTRL_PORT);
+		ctrl_setAccessHandler(&ctrl_accessHandler);
+
+		//Packet mode datagrams share the TCP port number
+		udp_start(settings.tcpPort);
+		ctrl_addCommand("discover", &ctrl_discoverHandler, CTRL_OPEN);
+		ctrl_addCommand("stations", &ctrl_stationsHandler, CTRL_OPEN);
+		ctrl_addCommand("test", &ctrl_testHandler, CTRL_RESTRICTED);
+		ctrl_addCommand("stats", &ctrl_statsHandler, CTRL_OPEN);
+		ctrl_addCommand("apply", &ctrl_applyHandler, CTRL_RESTRICTED);
+		ctrl_addCommand("capture", &ctrl_captureHandler, CTRL_RESTRICTED);
+		ctrl_addCommand("heap", &ctrl_heapHandler, CTRL_OPEN);
+#ifdef ISR_PROFILE
+		ctrl_addCommand("isr", &ctrl_isrHandler, CTRL_OPEN);
+#endif
+#ifdef TRACE
+		ctrl_addCommand("trace", &ctrl_traceHandler, CTRL_RESTRICTED);
+#endif
+
+		governor_init();
+
+		_ledOn = 0;
+		_ledRetrigger = 0;
+		_flushArmed = 0;
 		switchState = 0;
-		switchValid = 1;
-
-    //Disarm timer
-    os_timer_disarm(&networkTimer);
 
-    //Setup timer
-    os_timer_setfn(&networkTimer, (os_timer_func_t *)network_task, NULL);
+    //Setup timers, both are one-shot and only armed on events
+    os_timer_disarm(&switchDebounceTimer);
+    os_timer_disarm(&ledTimer);
     os_timer_setfn(&switchDebounceTimer, (os_timer_func_t *)switch_debounce_task, NULL);
-
-    //Arm the timer
-    os_timer_arm(&networkTimer, NETWORK_UPDATE_RATE, 1);
-
-    //Start os task
-    system_os_task(uart_task, UART_TASK_PRIORITY,user_procTaskQueue,
-			user_procTaskQueueLen);
+    os_timer_setfn(&ledTimer, (os_timer_func_t *)led_timer_task, NULL);
+    os_timer_disarm(&flushTimer);
+    os_timer_setfn(&flushTimer, (os_timer_func_t *)flush_timer_task, NULL);
+    os_timer_disarm(&txRateTimer);
+    os_timer_setfn(&txRateTimer, (os_timer_func_t *)tx_rate_task, NULL);
+    os_timer_disarm(&statsTimer);
+    os_timer_setfn(&statsTimer, (os_timer_func_t *)stats_push, NULL);
+    os_timer_disarm(&rescanTimer);
+    os_timer_setfn(&rescanTimer, (os_timer_func_t *)wifi_rescan_task, NULL);
+    os_timer_disarm(&staJoinTimer);
+    os_timer_setfn(&staJoinTimer, (os_timer_func_t *)sta_join_timeout, NULL);
+
+    //Start os tasks
+    system_os_task(uart_rxTask, UART_RX_TASK_PRIORITY, uartRxQueue,
+			UART_RX_QUEUE_LEN);
+    system_os_task(uart_txTask, UART_TX_TASK_PRIORITY, uartTxQueue,
+			UART_TX_QUEUE_LEN);
+    system_os_task(background_task, BACKGROUND_TASK_PRIORITY, backgroundQueue,
+			BACKGROUND_QUEUE_LEN);
+
+    //Switch edges wake us up instead of a poll timer
+    ETS_GPIO_INTR_DISABLE();
+    ETS_GPIO_INTR_ATTACH(switch_intr_handler, NULL);
+    gpio_pin_intr_state_set(GPIO_ID_PIN(SWITCH_PIN), GPIO_PIN_INTR_ANYEDGE);
+    ETS_GPIO_INTR_ENABLE();
+
+    //Pick up the switch position at boot
+    system_os_post(BACKGROUND_TASK_PRIORITY, USER_SIG_SWITCH, system_get_time());
 }
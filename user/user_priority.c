@@ -0,0 +1,153 @@
+#include "user_priority.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+#include <string.h>
+
+#include "user_stats.h"
+
+//Parser states, kept across receive callbacks since TCP can split a
+//message anywhere
+#define STATE_BULK		0
+#define STATE_ESCAPE	1	//Escape seen, length or literal next
+#define STATE_MESSAGE	2
+
+struct PriorityMessage {
+	uint32 arrival;		//When the last byte was received
+	uint8 len;
+	uint8 data[PRIORITY_MAX_LEN];
+};
+
+static struct PriorityMessage _queue[PRIORITY_QUEUE_LEN];
+static uint8 _head, _count;
+
+static uint8 _escape;
+static uint8 _state;
+static uint8 _remaining;
+static struct PriorityMessage *_current;	//NULL while skipping a dropped message
+
+static void __begin(uint8 len);
+static void __end();
+
+void ICACHE_FLASH_ATTR priority_setEscape(uint8 escape) {
+	_escape = escape;
+
+	priority_reset();
+}
+
+void ICACHE_FLASH_ATTR priority_reset() {
+	_head = _count = 0;
+	_state = STATE_BULK;
+	_current = NULL;
+}
+
+uint16 priority_filter(uint8 *data, uint16 len) {
+	uint16 in = 0, out = 0;
+
+	if(_escape == 0) {
+		return len;
+	}
+
+	while(in < len) {
+		uint8 c = data[in];
+
+		switch(_state) {
+			case STATE_BULK: {
+				//Move whole runs of bulk data at once
+				uint8 *esc = memchr(data + in, _escape, len - in);
+				uint16 run = (esc != NULL) ? (esc - (data + in)) : (len - in);
+
+				if(out != in) {
+					memmove(data + out, data + in, run);
+				}
+				out += run;
+				in += run;
+
+				if(esc != NULL) {
+					_state = STATE_ESCAPE;
+					in++;
+				}
+			}
+			break;
+
+			case STATE_ESCAPE:
+				if(c == 0) {
+					data[out++] = _escape;
+					_state = STATE_BULK;
+				}
+				else {
+					__begin(c);
+				}
+				in++;
+			break;
+
+			case STATE_MESSAGE:
+				if(_current != NULL) {
+					_current->data[_current->len++] = c;
+				}
+				if(--_remaining == 0) {
+					__end();
+				}
+				in++;
+			break;
+		}
+	}
+
+	return out;
+}
+
+uint8 priority_pending() {
+	return _count;
+}
+
+uint8 priority_take(uint8 *buffer) {
+	struct PriorityMessage *msg;
+	uint32 delay;
+
+	if(_count == 0) {
+		return 0;
+	}
+
+	msg = &_queue[_head];
+	memcpy(buffer, msg->data, msg->len);
+
+	delay = system_get_time() - msg->arrival;
+	bridgeStats.priorityLane.events++;
+	bridgeStats.priorityLane.latencyTotal += delay;
+	if(delay > bridgeStats.priorityLane.latencyMax) {
+		bridgeStats.priorityLane.latencyMax = delay;
+	}
+
+	_head = (_head + 1) % PRIORITY_QUEUE_LEN;
+	_count--;
+
+	return msg->len;
+}
+
+//Oversized messages and those that find the queue full are still
+//parsed, so the stream stays in sync
+void __begin(uint8 len) {
+	if((len > PRIORITY_MAX_LEN) || (_count == PRIORITY_QUEUE_LEN)) {
+		_current = NULL;
+	}
+	else {
+		_current = &_queue[(_head + _count) % PRIORITY_QUEUE_LEN];
+		_current->len = 0;
+	}
+
+	_remaining = len;
+	_state = STATE_MESSAGE;
+}
+
+void __end() {
+	if(_current != NULL) {
+		_current->arrival = system_get_time();
+		_count++;
+	}
+	else {
+		bridgeStats.priorityDropped++;
+	}
+
+	_current = NULL;
+	_state = STATE_BULK;
+}
@@ -0,0 +1,414 @@
+#include "user_settings.h"
+
+#include "osapi.h"
+#include "spi_flash.h"
+#include "user_interface.h"
+#include <stddef.h>
+#include <string.h>
+
+#include "user_config.h"
+#include "driver/uart.h"
+#include "user_capture.h"
+
+#define FLASH_SECTOR_SIZE	(4096)
+
+#define SETTING_UINT	0
+#define SETTING_STRING	1
+#define SETTING_SECRET	2	//Write-only string
+#define SETTING_HEX		3	//Zero padded bytes, written as hex digits
+
+struct SettingsRecord {
+	uint32 magic;
+	uint16 version;
+	uint16 length;
+	uint32 sequence;
+	struct BridgeSettings settings;
+	uint32 crc;		//Over everything above
+};
+
+_Static_assert((sizeof(struct SettingsRecord) % 4) == 0,
+	"Flash is read and written in words");
+
+typedef struct {
+	const char *name;
+	uint8 type;
+	uint8 offset;
+	uint8 size;
+	uint32 min, max;
+} SettingField;
+
+#define FIELD(name, member, type, min, max) \
+	{ name, type, offsetof(struct BridgeSettings, member), \
+		sizeof(((struct BridgeSettings*)0)->member), min, max }
+
+static const SettingField FIELDS[] = {
+	FIELD("ssid", ssid, SETTING_STRING, 0, SETTINGS_SSID_LEN - 1),
+	FIELD("psk", psk, SETTING_SECRET, 8, SETTINGS_PSK_LEN - 1),
+	FIELD("sta_ssid", staSsid, SETTING_STRING, 0, SETTINGS_SSID_LEN - 1),
+	FIELD("sta_psk", staPsk, SETTING_SECRET, 0, SETTINGS_PSK_LEN - 1),
+	FIELD("baud", baud, SETTING_UINT, 300, 3686400),
+	FIELD("port", tcpPort, SETTING_UINT, 1, 0xFFFF),
+	FIELD("channel", channel, SETTING_UINT, 0, 13),
+	FIELD("floor_uart", floorUartRx, SETTING_UINT, 1, SEGMENT_POOL_COUNT - 2),
+	FIELD("floor_tcp", floorTcpRx, SETTING_UINT, 1, SEGMENT_POOL_COUNT - 2),
+	FIELD("headroom", recvHeadroom, SETTING_UINT, 0, SEGMENT_POOL_COUNT - 2),
+	FIELD("flush", flushMode, SETTING_UINT, UART_FLUSH_IDLE, UART_FLUSH_PACKET),
+	FIELD("flush_ms", flushDeadline, SETTING_UINT, 1, 1000),
+	FIELD("delims", flushDelims, SETTING_HEX, 1, SETTINGS_DELIMS_LEN),
+	FIELD("gap_bits", packetGap, SETTING_UINT, 0, 1270),
+	FIELD("prio_esc", priorityEscape, SETTING_UINT, 0, 0xFF),
+	FIELD("rate_up", rateUp, SETTING_UINT, 0, 1000000),
+	FIELD("rate_down", rateDown, SETTING_UINT, 0, 1000000),
+	FIELD("burst", rateBurst, SETTING_UINT, TCP_MAX_PACKET, 0xFFFF),
+	FIELD("credit", creditMode, SETTING_UINT, 0, 1),
+	FIELD("mux", muxMode, SETTING_UINT, 0, 1),
+	FIELD("capture", captureMode, SETTING_UINT, CAPTURE_OFF, CAPTURE_ALL),
+	FIELD("autobaud", autobaud, SETTING_UINT, 0, 1)
+};
+#define FIELD_COUNT	(sizeof(FIELDS)/sizeof(FIELDS[0]))
+
+struct BridgeSettings settings;
+
+//Sequence number and sector of the copy the RAM settings came from
+static uint32 _sequence;
+static uint16 _sector;
+
+static struct SettingsRecord _record;
+
+static uint32 __crc32(const uint8 *data, uint32 len);
+static uint8 __readRecord(uint16 sector);
+static uint8 __valid(const struct BridgeSettings *s);
+static const SettingField* __find(const char *key);
+static uint32 __getUint(const SettingField *field);
+static void __setUint(const SettingField *field, uint32 value);
+static uint8 __parseUint(const char *str, uint32 *value);
+static uint8 __parseHex(const char *str, uint8 *out, uint8 size);
+
+void ICACHE_FLASH_ATTR settings_reset() {
+	os_memset(&settings, 0, sizeof(settings));
+
+	strcpy(settings.psk, AP_PSK);
+	settings.baud = BAUD;
+	settings.tcpPort = TCP_PORT;
+	settings.channel = 0;
+	settings.floorUartRx = SEGMENT_FLOOR_UART_RX;
+	settings.floorTcpRx = SEGMENT_FLOOR_TCP_RX;
+	settings.recvHeadroom = TCP_RECV_HOLD_HEADROOM;
+	settings.flushMode = UART_FLUSH_IDLE;
+	settings.flushDeadline = FLUSH_DEADLINE;
+	strncpy((char*)settings.flushDelims, FLUSH_DELIMS, SETTINGS_DELIMS_LEN);
+	settings.rateBurst = RATE_BURST;
+}
+
+//Two small reads, nothing is written at boot
+void ICACHE_FLASH_ATTR settings_init() {
+	uint8 validA, validB;
+	uint32 seqA = 0;
+
+	settings_reset();
+	_sequence = 0;
+	_sector = SETTINGS_SECTOR_B;
+
+	validA = __readRecord(SETTINGS_SECTOR_A);
+	if(validA) {
+		seqA = _record.sequence;
+		settings = _record.settings;
+		_sequence = seqA;
+		_sector = SETTINGS_SECTOR_A;
+	}
+
+	validB = __readRecord(SETTINGS_SECTOR_B);
+	if(validB && (!validA || (int32)(_record.sequence - seqA) > 0)) {
+		settings = _record.settings;
+		_sequence = _record.sequence;
+		_sector = SETTINGS_SECTOR_B;
+	}
+}
+
+uint32 ICACHE_FLASH_ATTR settings_save() {
+	uint16 sector = (_sector == SETTINGS_SECTOR_A) ? SETTINGS_SECTOR_B
+		: SETTINGS_SECTOR_A;
+
+	if(!__valid(&settings)) {
+		return 0;
+	}
+
+	_record.magic = SETTINGS_MAGIC;
+	_record.version = SETTINGS_VERSION;
+	_record.length = sizeof(struct BridgeSettings);
+	_record.sequence = _sequence + 1;
+	_record.settings = settings;
+	_record.crc = __crc32((uint8*)&_record, offsetof(struct SettingsRecord, crc));
+
+	if(spi_flash_erase_sector(sector) != SPI_FLASH_RESULT_OK) {
+		return 0;
+	}
+	if(spi_flash_write(sector*FLASH_SECTOR_SIZE, (uint32*)&_record,
+			sizeof(_record)) != SPI_FLASH_RESULT_OK) {
+		return 0;
+	}
+
+	//Only switch over once the new copy reads back intact
+	if(!__readRecord(sector)) {
+		return 0;
+	}
+
+	_sequence++;
+	_sector = sector;
+
+	return _sequence;
+}
+
+uint8 ICACHE_FLASH_ATTR settings_set(const char *key, const char *value) {
+	const SettingField *field = __find(key);
+	struct BridgeSettings old = settings;
+	uint32 num;
+
+	if(field == NULL) {
+		return 0;
+	}
+
+	if(field->type == SETTING_UINT) {
+		if(!__parseUint(value, &num) || (num < field->min) || (num > field->max)) {
+			return 0;
+		}
+		__setUint(field, num);
+	}
+	else if(field->type == SETTING_HEX) {
+		uint8 bytes[SETTINGS_DELIMS_LEN];
+		uint8 count = __parseHex(value, bytes, sizeof(bytes));
+
+		if((count < field->min) || (count > field->size)) {
+			return 0;
+		}
+		os_memset((uint8*)&settings + field->offset, 0, field->size);
+		os_memcpy((uint8*)&settings + field->offset, bytes, count);
+	}
+	else {
+		uint32 len = strlen(value);
+
+		if((len < field->min) || (len > field->max)) {
+			return 0;
+		}
+		os_memset((uint8*)&settings + field->offset, 0, field->size);
+		os_memcpy((uint8*)&settings + field->offset, value, len);
+	}
+
+	//Fields that depend on each other are checked as a whole
+	if(!__valid(&settings)) {
+		settings = old;
+		return 0;
+	}
+
+	return 1;
+}
+
+uint8 ICACHE_FLASH_ATTR settings_get(const char *key, char *buffer, uint16 size) {
+	const SettingField *field = __find(key);
+	char num[2*SETTINGS_DELIMS_LEN + 1];
+	const char *str;
+	uint16 len;
+
+	if((field == NULL) || (size == 0)) {
+		return 0;
+	}
+
+	if(field->type == SETTING_UINT) {
+		os_sprintf(num, "%u", __getUint(field));
+		str = num;
+	}
+	else if(field->type == SETTING_SECRET) {
+		str = "********";
+	}
+	else if(field->type == SETTING_HEX) {
+		const uint8 *bytes = (const uint8*)&settings + field->offset;
+		uint8 i;
+
+		for(i = 0; (i < field->size) && (bytes[i] != 0); ++i) {
+			os_sprintf(num + 2*i, "%02x", bytes[i]);
+		}
+		num[2*i] = '\0';
+		str = num;
+	}
+	else {
+		str = (const char*)&settings + field->offset;
+	}
+
+	len = strlen(str);
+	if(len >= size) {
+		len = size - 1;
+	}
+	os_memcpy(buffer, str, len);
+	buffer[len] = '\0';
+
+	return 1;
+}
+
+const char* ICACHE_FLASH_ATTR settings_key(uint8 index) {
+	return (index < FIELD_COUNT) ? FIELDS[index].name : NULL;
+}
+
+uint8 ICACHE_FLASH_ATTR __readRecord(uint16 sector) {
+	if(spi_flash_read(sector*FLASH_SECTOR_SIZE, (uint32*)&_record,
+			sizeof(_record)) != SPI_FLASH_RESULT_OK) {
+		return 0;
+	}
+
+	//Older layouts fall back to the defaults
+	if((_record.magic != SETTINGS_MAGIC)
+		|| (_record.version != SETTINGS_VERSION)
+		|| (_record.length != sizeof(struct BridgeSettings))) {
+		return 0;
+	}
+
+	if(_record.crc != __crc32((uint8*)&_record, offsetof(struct SettingsRecord, crc))) {
+		return 0;
+	}
+
+	//A record written by a build with a different buffer profile may not fit
+	return __valid(&_record.settings);
+}
+
+uint8 ICACHE_FLASH_ATTR __valid(const struct BridgeSettings *s) {
+	if((s->ssid[SETTINGS_SSID_LEN - 1] != '\0')
+		|| (s->psk[SETTINGS_PSK_LEN - 1] != '\0')
+		|| (strlen(s->psk) < 8)) {
+		return 0;
+	}
+
+	//WPA passphrases are 8 characters or more, empty means open
+	if((s->staSsid[SETTINGS_SSID_LEN - 1] != '\0')
+		|| (s->staPsk[SETTINGS_PSK_LEN - 1] != '\0')
+		|| ((s->staPsk[0] != '\0') && (strlen(s->staPsk) < 8))) {
+		return 0;
+	}
+
+	if((s->baud < 300) || (s->tcpPort == 0) || (s->channel > 13)) {
+		return 0;
+	}
+
+	if((s->flushMode > UART_FLUSH_PACKET) || (s->flushDeadline == 0)
+		|| (s->flushDelims[0] == 0)) {
+		return 0;
+	}
+
+	//Same rules as the static checks in user_config.h
+	if((s->floorUartRx + s->floorTcpRx >= SEGMENT_POOL_COUNT)
+		|| (s->recvHeadroom >= s->floorTcpRx)) {
+		return 0;
+	}
+
+	return 1;
+}
+
+const SettingField* ICACHE_FLASH_ATTR __find(const char *key) {
+	uint8 i;
+
+	for(i = 0; i < FIELD_COUNT; ++i) {
+		if(strcmp(key, FIELDS[i].name) == 0) {
+			return &FIELDS[i];
+		}
+	}
+
+	return NULL;
+}
+
+uint32 ICACHE_FLASH_ATTR __getUint(const SettingField *field) {
+	const uint8 *p = (const uint8*)&settings + field->offset;
+
+	switch(field->size) {
+		case 1:
+			return *p;
+		case 2:
+			return *(const uint16*)p;
+		default:
+			return *(const uint32*)p;
+	}
+}
+
+void ICACHE_FLASH_ATTR __setUint(const SettingField *field, uint32 value) {
+	uint8 *p = (uint8*)&settings + field->offset;
+
+	switch(field->size) {
+		case 1:
+			*p = value;
+		break;
+		case 2:
+			*(uint16*)p = value;
+		break;
+		default:
+			*(uint32*)p = value;
+		break;
+	}
+}
+
+uint8 ICACHE_FLASH_ATTR __parseUint(const char *str, uint32 *value) {
+	uint32 result = 0;
+
+	if(*str == '\0') {
+		return 0;
+	}
+
+	for(; *str != '\0'; ++str) {
+		if((*str < '0') || (*str > '9') || (result > 429496728)) {
+			return 0;
+		}
+		result = result*10 + (*str - '0');
+	}
+
+	*value = result;
+
+	return 1;
+}
+
+//Returns the number of bytes, 0 on anything but pairs of hex digits
+uint8 ICACHE_FLASH_ATTR __parseHex(const char *str, uint8 *out, uint8 size) {
+	uint8 count = 0;
+	uint8 i, nibble;
+
+	while(*str != '\0') {
+		if(count >= size) {
+			return 0;
+		}
+
+		out[count] = 0;
+		for(i = 0; i < 2; ++i, ++str) {
+			if((*str >= '0') && (*str <= '9')) {
+				nibble = *str - '0';
+			}
+			else if((*str >= 'a') && (*str <= 'f')) {
+				nibble = *str - 'a' + 10;
+			}
+			else if((*str >= 'A') && (*str <= 'F')) {
+				nibble = *str - 'A' + 10;
+			}
+			else {
+				return 0;
+			}
+			out[count] = (out[count] << 4) | nibble;
+		}
+
+		//A zero byte would end the list early
+		if(out[count] == 0) {
+			return 0;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+//Bitwise CRC-32, the record is small and only checked at boot and on save
+uint32 ICACHE_FLASH_ATTR __crc32(const uint8 *data, uint32 len) {
+	uint32 crc = 0xFFFFFFFF;
+	uint8 bit;
+
+	while(len--) {
+		crc ^= *data++;
+		for(bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
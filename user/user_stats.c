@@ -0,0 +1,3 @@
+#include "user_stats.h"
+
+volatile struct BridgeStats bridgeStats;
@@ -7,38 +7,87 @@
 #include <mem.h>
 #include <string.h>
 
+#include "driver/SegmentPool.h"
+#include "driver/TokenBucket.h"
+#include "user_stats.h"
+#include "user_priority.h"
+#include "user_frame.h"
+#include "user_heap.h"
+
 //Debugging
 #include "driver/uart.h"
+#include "user_trace.h"
 
-#define TCP_MAX_PACKET	(1460)
-#define TCP_SEND_BUFFER_SIZE	(1024 * 20)
-#define TCP_RECV_BUFFER_SIZE	(10*TCP_MAX_PACKET)
-
-#define TCP_RECV_HOLD_LIMIT	(5*TCP_MAX_PACKET)
 #define TCP_TIMEOUT		(7200)
 
 #define MAX_SEND_COUNT	(2)
 
+//Send retry delay while heap is low, a failed send would only fail again
+#define SEND_RETRY_LOW_MS	(20)
+
+//Smallest credit increment worth a frame of its own
+#define CREDIT_STEP		(512)
+
+//Mux frames that may wait ahead of the data, so log messages can't take
+//over the pool. Credits don't count against it.
+#define MAX_CTRL_FRAMES	(4)
+
 struct Connection {
 	struct espconn *pConn;
 
-	uint8 *sendBuffer;
-	uint16 sendSize, sendLen;
+	SegmentQueue ctrlQueue;		//Credit and mux frames, sent before sendQueue
+	SegmentQueue sendQueue;		//Waiting for espconn_send
+	SegmentQueue sentQueue;		//Handed to espconn, waiting for the sent callback
 
-	uint8 *recvBuffer;
-	uint16 recvSize, recvLen;
+	SegmentQueue recvQueue;		//Client data waiting for the UART
+	uint16 recvLen;
 	uint8 recvHold;
 
+	uint32 recvTotal;		//Bytes received since connect, for credits
+	uint32 creditLimit;		//Last limit sent to the client
+	uint8 creditPending;	//A credit frame is owed but had no segment
+
+	//Mux mode receive state, frames from the client can be split anywhere
+	uint8 frameHeader[FRAME_HEADER_LEN];
+	uint8 frameHeaderLen;
+	uint16 frameLeft;		//Payload bytes of the current frame still to come
+	uint16 frameLen;		//Message bytes kept in frameBuf
+	uint8 frameBuf[FRAME_MAX_MESSAGE];
+
 	ReceiveHandler recvHandler;
+	SentHandler sentHandler;
+	ConnectHandler connectHandler;
+	FrameHandler frameHandler;
 
 	int sendCount;
 };
 
 static struct espconn _tcpServer;
+static esp_tcp _tcpServerProto;
+
 
 static struct Connection _tcpConn;
 
 static os_timer_t _sendTimer;
+static uint8 _sendWaiting;		//_sendTimer is armed for the rate limit
+static uint8 _sending;			//In __sendQueued
+
+static TokenBucket _sendBucket;
+
+static uint8 _recvHeadroom = TCP_RECV_HOLD_HEADROOM;
+
+static uint8 _memoryLevel;
+
+//A client refused for low heap is closed from a timer, espconn can't
+//take a disconnect inside its own connect callback
+static os_timer_t _refuseTimer;
+static struct espconn *_refused;
+
+//Credit and mux mode frame everything sent, segments leave room for the
+//header
+static uint8 _creditMode;
+static uint8 _muxMode;
+static uint8 _headroom;
 
 //Callbacks
 static void __connectHandler(void *arg);
@@ -49,20 +98,37 @@ static void __sentHandler(void *arg);
 static void __writeHandler(void *arg);
 
 static void __sendTimerHandler(void *arg);
+static void __refuseTimerHandler(void *arg);
+static void __refusedDisconnectHandler(void *arg);
 
 static uint16 __send(struct Connection *conn, uint8 *data, uint16 len);
+static void __sendQueued(struct Connection *conn);
+static void __releaseSegments(struct Connection *conn);
+static uint16 __queueRecv(struct Connection *conn, uint8 *data, uint16 len);
+static void __updateHold(struct Connection *conn);
+static void __updateCredit(struct Connection *conn);
+static void __frame(Segment *segment, uint8 channel);
+static void __receiveData(struct Connection *conn, uint8 *data, uint16 len);
+static void __demux(struct Connection *conn, uint8 *data, uint16 len);
+static void __endFrame(struct Connection *conn);
 
 
 void tcp_start(uint16 port) {
 	os_timer_disarm(&_sendTimer);
 	os_timer_setfn(&_sendTimer, (os_timer_func_t*)__sendTimerHandler, NULL);
+	_sendWaiting = 0;
+
+	os_timer_disarm(&_refuseTimer);
+	os_timer_setfn(&_refuseTimer, (os_timer_func_t*)__refuseTimerHandler, NULL);
+	_refused = NULL;
 
-	_tcpConn.sendBuffer = (uint8*)os_malloc(TCP_SEND_BUFFER_SIZE);
-	_tcpConn.sendSize = TCP_SEND_BUFFER_SIZE;
-	_tcpConn.sendLen = 0;
+	TokenBucket_init(&_sendBucket, 0, TCP_MAX_PACKET);
 
-	_tcpConn.recvBuffer = (uint8*)os_malloc(TCP_RECV_BUFFER_SIZE);
-	_tcpConn.recvSize = TCP_RECV_BUFFER_SIZE;
+	SegmentQueue_init(&_tcpConn.ctrlQueue);
+	SegmentQueue_init(&_tcpConn.sendQueue);
+	SegmentQueue_init(&_tcpConn.sentQueue);
+
+	SegmentQueue_init(&_tcpConn.recvQueue);
 	_tcpConn.recvLen = 0;
 	_tcpConn.recvHold = 0;
 
@@ -70,7 +136,7 @@ void tcp_start(uint16 port) {
 
 	_tcpServer.type = ESPCONN_TCP;
 	_tcpServer.state = ESPCONN_NONE;
-	_tcpServer.proto.tcp = (esp_tcp*)os_malloc(sizeof(esp_tcp));
+	_tcpServer.proto.tcp = &_tcpServerProto;
 	_tcpServer.proto.tcp->local_port = port;
 	
 	espconn_regist_connectcb(&_tcpServer, &__connectHandler);
@@ -88,63 +154,217 @@ void tcp_setRecvHandler(ReceiveHandler handler) {
 	_tcpConn.recvHandler = handler;
 }
 
-void tcp_send(uint8* buffer, uint16 len) {
-	if(len == 0) {
-		uart_debugSend("[tcp_send] Given buffer length 0\r\n");
-		
-		return;
+void tcp_setSentHandler(SentHandler handler) {
+	_tcpConn.sentHandler = handler;
+}
+
+void tcp_setConnectHandler(ConnectHandler handler) {
+	_tcpConn.connectHandler = handler;
+}
+
+void tcp_setFrameHandler(FrameHandler handler) {
+	_tcpConn.frameHandler = handler;
+}
+
+void tcp_setRecvHeadroom(uint8 headroom) {
+	_recvHeadroom = headroom;
+}
+
+void tcp_setCreditMode(uint8 enable) {
+	_creditMode = enable;
+	_headroom = (_creditMode || _muxMode) ? FRAME_HEADER_LEN : 0;
+}
+
+uint8 tcp_getCreditMode() {
+	return _creditMode;
+}
+
+uint8 tcp_getHeadroom() {
+	return _headroom;
+}
+
+void tcp_setMuxMode(uint8 enable) {
+	_muxMode = enable;
+	_headroom = (_creditMode || _muxMode) ? FRAME_HEADER_LEN : 0;
+}
+
+uint8 tcp_getMuxMode() {
+	return _muxMode;
+}
+
+uint8 tcp_sendFrame(uint8 channel, const uint8 *data, uint16 len) {
+	uint8 seg;
+
+	if(!_muxMode || (_tcpConn.pConn == NULL)) {
+		return 0;
+	}
+
+	//Borrowed from the UART direction like credit frames
+	seg = (_tcpConn.ctrlQueue.count < MAX_CTRL_FRAMES) ? SegmentPool_alloc(SEGMENT_UART_RX) : SEGMENT_NONE;
+	if(seg == SEGMENT_NONE) {
+		bridgeStats.muxDropped++;
+		return 0;
 	}
 
+	if(len > TCP_MAX_PACKET - FRAME_HEADER_LEN) {
+		len = TCP_MAX_PACKET - FRAME_HEADER_LEN;
+	}
+
+	Segment *segment = SegmentPool_get(seg);
+	segment->offset = FRAME_HEADER_LEN;
+	segment->len = FRAME_HEADER_LEN + len;
+	memcpy(segment->data + FRAME_HEADER_LEN, data, len);
+	__frame(segment, channel);
+
+	bridgeStats.muxFrames++;
+
+	SegmentQueue_push(&_tcpConn.ctrlQueue, seg);
+	__sendQueued(&_tcpConn);
+
+	return 1;
+}
+
+void tcp_setSendRate(uint32 rate, uint16 burst) {
+	TokenBucket_init(&_sendBucket, rate, burst);
+}
+
+void tcp_setMemoryLevel(uint8 level) {
+	_memoryLevel = level;
+
+	__updateHold(&_tcpConn);
+
 	if(_tcpConn.pConn != NULL) {
-		if((_tcpConn.sendCount < MAX_SEND_COUNT) && (_tcpConn.sendLen == 0)) {
-			uint16 sendAmt = __send(&_tcpConn, buffer, len);
+		__sendQueued(&_tcpConn);
+	}
+}
 
-			if(sendAmt < len) {
-				if((sendAmt + _tcpConn.sendLen) > _tcpConn.sendSize) {
-					uart_debugSend("[tcp_send] send buffer full!\r\n");
-				}
-				else {
-					memcpy(_tcpConn.sendBuffer, buffer + sendAmt, len - sendAmt);
-					_tcpConn.sendLen = len - sendAmt;
-				}
-			}
-		}
-		else {
-			if((_tcpConn.sendLen + len) > _tcpConn.sendSize) {
-				uart_debugSend("[tcp_send] send buffer full!\r\n");
-			}
-			else {
-				memcpy(_tcpConn.sendBuffer + _tcpConn.sendLen, buffer, len);
-				_tcpConn.sendLen += len;
-			}
+//Takes ownership of a filled pool segment and transmits it without copying
+void tcp_sendSegment(uint8 seg) {
+	tcp_sendChannelSegment(seg, FRAME_DATA);
+}
+
+void tcp_sendChannelSegment(uint8 seg, uint8 channel) {
+	if(_tcpConn.pConn == NULL) {
+		uart_debugSend("[Send] (Not connected)\r\n");
+
+		SegmentPool_free(seg);
+		bridgeStats.segmentsDropped++;
 
-			//char msg[128];
-			//os_sprintf(msg, "[tcp_send] Defferred (%d)\r\n", (int)_tcpConn.sendLen);
-			//__debug(msg);
+		return;
+	}
+
+	if(_headroom > 0) {
+		Segment *segment = SegmentPool_get(seg);
+
+		if(segment->offset < FRAME_HEADER_LEN) {
+			uart_debugSend("[Send] (No headroom)\r\n");
+
+			SegmentPool_free(seg);
+			bridgeStats.segmentsDropped++;
+
+			return;
 		}
+
+		__frame(segment, channel);
 	}
-	else {
-		uart_debugSend("[Send] (Not connected)\r\n");
+
+	SegmentQueue_push(&_tcpConn.sendQueue, seg);
+
+	__sendQueued(&_tcpConn);
+}
+
+uint8 tcp_getBacklog() {
+	return _tcpConn.sendQueue.count;
+}
+
+//True when a client is connected and nothing is queued or in flight
+uint8 tcp_isIdle() {
+	return (_tcpConn.pConn != NULL) && (_tcpConn.sendCount == 0)
+		&& (_tcpConn.sendQueue.count == 0) && (_tcpConn.ctrlQueue.count == 0);
+}
+
+uint8 tcp_isConnected() {
+	return _tcpConn.pConn != NULL;
+}
+
+uint16 tcp_getReceived() {
+	return _tcpConn.recvLen;
+}
+
+//Hands over a whole receive segment instead of copying out of it
+uint8 tcp_takeSegment() {
+	uint8 seg = SegmentQueue_pop(&_tcpConn.recvQueue);
+
+	if(seg != SEGMENT_NONE) {
+		Segment *segment = SegmentPool_get(seg);
+
+		_tcpConn.recvLen -= segment->len - segment->offset;
+		__updateHold(&_tcpConn);
+	}
+
+	return seg;
+}
+
+uint32 tcp_getRemoteAddr() {
+	uint32 addr = 0;
+
+	if(_tcpConn.pConn != NULL) {
+		os_memcpy(&addr, _tcpConn.pConn->proto.tcp->remote_ip, 4);
+	}
+
+	return addr;
+}
+
+void tcp_disconnect() {
+	if(_tcpConn.pConn != NULL) {
+		espconn_disconnect(_tcpConn.pConn);
 	}
 }
 
 uint16 tcp_receive(uint8 *buffer, uint16 size) {
-	uint16 recvAmt = _tcpConn.recvLen;
-	if(recvAmt > size)
-		recvAmt = size;
-	
-	memcpy(buffer, _tcpConn.recvBuffer, recvAmt);
+	return tcp_receiveUntil(buffer, size, NULL, 0);
+}
 
-	if(recvAmt != _tcpConn.recvLen) {
-		memmove(_tcpConn.recvBuffer, _tcpConn.recvBuffer + recvAmt, (_tcpConn.recvLen - recvAmt));
+uint16 tcp_receiveUntil(uint8 *buffer, uint16 size, const uint8 *delims, uint8 delimCount) {
+	uint16 recvAmt = 0;
+	uint8 seg, found = 0;
+
+	while(!found && (recvAmt < size) && ((seg = SegmentQueue_peek(&_tcpConn.recvQueue)) != SEGMENT_NONE)) {
+		Segment *segment = SegmentPool_get(seg);
+
+		uint16 count = segment->len - segment->offset;
+		if(count > (size - recvAmt))
+			count = size - recvAmt;
+
+		//Cut the copy short after a delimiter
+		if(delims != NULL) {
+			uint16 i;
+			uint8 d;
+
+			for(i = 0; !found && (i < count); ++i) {
+				for(d = 0; d < delimCount && delims[d] != 0; ++d) {
+					if(segment->data[segment->offset + i] == delims[d]) {
+						found = 1;
+						count = i + 1;
+						break;
+					}
+				}
+			}
+		}
+
+		memcpy(buffer + recvAmt, segment->data + segment->offset, count);
+		segment->offset += count;
+		recvAmt += count;
+
+		if(segment->offset == segment->len) {
+			SegmentQueue_pop(&_tcpConn.recvQueue);
+			SegmentPool_free(seg);
+		}
 	}
 
 	_tcpConn.recvLen -= recvAmt;
 
-	if( (_tcpConn.recvHold == 1) && (_tcpConn.recvLen < TCP_RECV_HOLD_LIMIT) ) {
-		espconn_recv_unhold(_tcpConn.pConn);
-		_tcpConn.recvHold = 0;
-	}
+	__updateHold(&_tcpConn);
 
 	return recvAmt;
 }
@@ -171,24 +391,35 @@ uint16 __send(struct Connection *conn, uint8 *data, uint16 len) {
 */	
 
 	if((retval != 0) && (conn->sendCount == 0)) {
-		os_timer_arm(&_sendTimer, 1, 0);
+		os_timer_disarm(&_sendTimer);
+		os_timer_arm(&_sendTimer, (_memoryLevel == HEAP_OK) ? 1 : SEND_RETRY_LOW_MS, 0);
 	}
 
 	if(retval == ESPCONN_ARG) {
 		char msg[128];
-		os_sprintf(msg, "[__send] ESPCONN_ARG: %d, %d\r\n", (int)data, (int)sendAmt);
+		os_sprintf(msg, "[__send] ESPCONN_ARG: %d\r\n", (int)sendAmt);
 		uart_debugSend(msg);
 
 		return 0;
 	}
 	else if(retval != 0) {
 		char msg[128];
+
+		bridgeStats.sendRetries++;
 		os_sprintf(msg, "[__send] (%d, %d)\r\n", (int)retval, (int)(conn->sendCount));
 		uart_debugSend(msg);
 
 		sendAmt = 0;
 	}
 	else {
+		TRACE_EVENT(TRACE_TCP_SEND, sendAmt);
+
+		//lwIP copies the segment into its own pbufs
+		bridgeStats.tcpTxBytes += sendAmt;
+		bridgeStats.bytesCopied += sendAmt;
+
+		TokenBucket_consume(&_sendBucket, sendAmt);
+
 		//char msg[128];
 		//os_sprintf(msg, "[__send] %d sent\r\n", (int)sendAmt);
 		//uart_debugSend(msg);
@@ -199,12 +430,221 @@ uint16 __send(struct Connection *conn, uint8 *data, uint16 len) {
 	return sendAmt;
 }
 
+void __sendQueued(struct Connection *conn) {
+	SegmentQueue *queue;
+	uint8 seg;
+
+	//A failed send logs, which queues a frame in mux mode. It goes out
+	//with the next round.
+	if(_sending) {
+		return;
+	}
+	_sending = 1;
+
+	//Every byte in flight holds lwIP heap
+	heap_sample();
+
+	while(conn->sendCount < ((_memoryLevel == HEAP_OK) ? MAX_SEND_COUNT : 1)) {
+		//Credit and mux frames go first and aren't held back by the rate
+		queue = &conn->ctrlQueue;
+		seg = SegmentQueue_peek(queue);
+
+		if(seg == SEGMENT_NONE) {
+			queue = &conn->sendQueue;
+			seg = _sendWaiting ? SEGMENT_NONE : SegmentQueue_peek(queue);
+		}
+
+		if(seg == SEGMENT_NONE) {
+			break;
+		}
+
+		Segment *segment = SegmentPool_get(seg);
+
+		//Segments stay queued until the rate limit lets them through
+		uint32 wait = (queue == &conn->sendQueue)
+			? TokenBucket_delay(&_sendBucket, segment->len - segment->offset) : 0;
+		if(wait > 0) {
+			_sendWaiting = 1;
+			os_timer_disarm(&_sendTimer);
+			os_timer_arm(&_sendTimer, wait, 0);
+
+			bridgeStats.rateLimitedUp++;
+			bridgeStats.rateDelayUp += wait;
+			break;
+		}
+
+		if(__send(conn, segment->data + segment->offset, segment->len - segment->offset) == 0) {
+			//__send arms the retry timer
+			break;
+		}
+
+		SegmentQueue_pop(queue);
+		SegmentQueue_push(&conn->sentQueue, seg);
+	}
+
+	_sending = 0;
+}
+
+uint16 __queueRecv(struct Connection *conn, uint8 *data, uint16 len) {
+	uint16 stored = 0;
+
+	while(stored < len) {
+		uint8 seg = SegmentQueue_peekTail(&conn->recvQueue);
+		Segment *segment = (seg != SEGMENT_NONE) ? SegmentPool_get(seg) : NULL;
+
+		if((segment == NULL) || (segment->len == TCP_MAX_PACKET)) {
+			seg = SegmentPool_alloc(SEGMENT_TCP_RX);
+			if(seg == SEGMENT_NONE) {
+				break;
+			}
+
+			SegmentQueue_push(&conn->recvQueue, seg);
+			segment = SegmentPool_get(seg);
+
+			//Echo mode sends these back as they are
+			segment->len = segment->offset = _headroom;
+		}
+
+		uint16 count = TCP_MAX_PACKET - segment->len;
+		if(count > (len - stored))
+			count = len - stored;
+
+		memcpy(segment->data + segment->len, data + stored, count);
+		segment->len += count;
+		stored += count;
+	}
+
+	conn->recvLen += stored;
+
+	return stored;
+}
+
+//The hold limit follows however many segments the receive direction
+//can currently take, so it moves as the pool is rebalanced
+void __updateHold(struct Connection *conn) {
+	if(conn->pConn == NULL) {
+		return;
+	}
+
+	//Credits keep the client from overrunning the pool instead
+	if(_creditMode) {
+		__updateCredit(conn);
+		return;
+	}
+
+	uint8 avail = SegmentPool_available(SEGMENT_TCP_RX);
+	uint8 critical = (_memoryLevel == HEAP_CRITICAL);
+
+	if((conn->recvHold == 0) && ((avail < _recvHeadroom) || critical)) {
+		espconn_recv_hold(conn->pConn);
+		conn->recvHold = 1;
+	}
+	else if((conn->recvHold == 1) && (avail > _recvHeadroom) && !critical) {
+		espconn_recv_unhold(conn->pConn);
+		conn->recvHold = 0;
+	}
+}
+
+//Grants only what is guaranteed to stay free: the room left in the
+//last receive segment and the segments under the receive floor, which
+//the UART direction can't take away. The limit moves up a segment at a
+//time as the UART drains the queue.
+void __updateCredit(struct Connection *conn) {
+	uint32 room = SegmentPool_guaranteed(SEGMENT_TCP_RX) * (TCP_MAX_PACKET - _headroom);
+	uint8 tail = SegmentQueue_peekTail(&conn->recvQueue);
+	uint32 limit;
+	uint8 seg;
+
+	if(tail != SEGMENT_NONE) {
+		room += TCP_MAX_PACKET - SegmentPool_get(tail)->len;
+	}
+
+	limit = conn->recvTotal + room;
+	if((int32)(limit - conn->creditLimit) < (conn->creditPending ? 0 : CREDIT_STEP)) {
+		return;
+	}
+
+	//Whatever the client sends sits in lwIP pbufs first
+	if(_memoryLevel == HEAP_CRITICAL) {
+		return;
+	}
+
+	//Borrowed from the other direction, whose floor makes sure a credit
+	//frame can always go out eventually
+	seg = SegmentPool_alloc(SEGMENT_UART_RX);
+	if(seg == SEGMENT_NONE) {
+		conn->creditPending = 1;
+		return;
+	}
+
+	Segment *segment = SegmentPool_get(seg);
+	segment->offset = FRAME_HEADER_LEN;
+	segment->len = FRAME_HEADER_LEN + FRAME_CREDIT_LEN;
+	segment->data[4] = limit >> 24;
+	segment->data[5] = limit >> 16;
+	segment->data[6] = limit >> 8;
+	segment->data[7] = limit;
+	__frame(segment, FRAME_CREDIT);
+
+	conn->creditLimit = limit;
+	conn->creditPending = 0;
+	bridgeStats.creditFrames++;
+
+	//Credits overtake queued data
+	SegmentQueue_push(&conn->ctrlQueue, seg);
+	__sendQueued(conn);
+}
+
+//Prepends the header in the segment's headroom
+void __frame(Segment *segment, uint8 channel) {
+	uint16 len = segment->len - segment->offset;
+
+	segment->offset -= FRAME_HEADER_LEN;
+	segment->data[segment->offset] = channel;
+	segment->data[segment->offset + 1] = 0;
+	segment->data[segment->offset + 2] = len >> 8;
+	segment->data[segment->offset + 3] = len;
+}
+
+void __releaseSegments(struct Connection *conn) {
+	SegmentQueue_freeAll(&conn->ctrlQueue);
+	SegmentQueue_freeAll(&conn->sendQueue);
+	SegmentQueue_freeAll(&conn->sentQueue);
+	conn->sendCount = 0;
+
+	if(conn->sentHandler != NULL) {
+		conn->sentHandler();
+	}
+}
+
 void __connectHandler(void *arg) {
 	struct espconn *conn = (struct espconn*)arg;
 
+	//A new client would only push lwIP over the edge
+	if(heap_sample() == HEAP_CRITICAL) {
+		bridgeStats.heapRejected++;
+
+		_refused = conn;
+		espconn_regist_disconcb(conn, &__refusedDisconnectHandler);
+		os_timer_disarm(&_refuseTimer);
+		os_timer_arm(&_refuseTimer, 1, 0);
+
+		uart_debugSend("[Connect] refused, heap critical\r\n");
+		return;
+	}
+
 	_tcpConn.pConn = conn;
 	conn->reverse = &_tcpConn;
-	_tcpConn.sendLen = 0;
+	_tcpConn.recvHold = 0;
+	_tcpConn.recvTotal = 0;
+	_tcpConn.creditLimit = 0;
+	_tcpConn.creditPending = 1;
+	_tcpConn.frameHeaderLen = 0;
+
+	//A new client starts outside any urgent message
+	priority_reset();
+
+	TRACE_EVENT(TRACE_CONNECT, 0);
 
 	//Register handlers
 	espconn_regist_disconcb(conn, &__disconnectHandler);
@@ -219,8 +659,14 @@ void __connectHandler(void *arg) {
 	espconn_set_opt(conn, ESPCONN_NODELAY | ESPCONN_COPY);
 
 	//Clear tcpConn structure
-	//RingBuffer_clear(&(_tcpConn.sendBuffer));
 	_tcpConn.sendCount = 0;
+
+	//The client waits for its first credits in credit mode
+	__updateHold(&_tcpConn);
+
+	if(_tcpConn.connectHandler != NULL) {
+		_tcpConn.connectHandler(1);
+	}
 }
 
 void __disconnectHandler(void *arg) {
@@ -228,6 +674,14 @@ void __disconnectHandler(void *arg) {
 
 	conn->pConn = NULL;
 
+	TRACE_EVENT(TRACE_DISCONNECT, 0);
+
+	__releaseSegments(conn);
+
+	if(conn->connectHandler != NULL) {
+		conn->connectHandler(0);
+	}
+
 	uart_debugSend("[Disconnect]\r\n");
 }
 
@@ -238,64 +692,137 @@ void __reconnectHandler(void *arg, sint8 err) {
 	uart_debugSend(msg);
 }
 
+void __refuseTimerHandler(void *arg) {
+	if(_refused != NULL) {
+		espconn_disconnect(_refused);
+	}
+}
+
+//The refused client may also go away by itself before the timer
+void __refusedDisconnectHandler(void *arg) {
+	if(arg == _refused) {
+		_refused = NULL;
+	}
+}
+
 void __recvHandler(void *arg, char *data, unsigned short len) {
 	struct Connection *conn = (struct Connection*)(((struct espconn*)arg)->reverse);
-	
-	memcpy(conn->recvBuffer + conn->recvLen, data, len);
-	conn->recvLen += len;
 
-	if( (conn->recvLen > TCP_RECV_HOLD_LIMIT) && (conn->recvHold == 0) ) {
-		espconn_recv_hold(conn->pConn);
-		conn->recvHold = 1;
+	TRACE_EVENT(TRACE_TCP_RECV, len);
+
+	heap_sample();
+
+	if(_muxMode) {
+		__demux(conn, (uint8*)data, len);
+	}
+	else {
+		conn->recvTotal += len;
+		__receiveData(conn, (uint8*)data, len);
 	}
 
+	__updateHold(conn);
+
 	if(conn->recvHandler != NULL) {
 		conn->recvHandler(len);
 	}
 }
 
+//Urgent messages skip the receive queue
+void __receiveData(struct Connection *conn, uint8 *data, uint16 len) {
+	uint16 bulk = priority_filter(data, len);
+	uint16 stored = __queueRecv(conn, data, bulk);
+
+	bridgeStats.tcpRxBytes += stored;
+	if(stored < bulk) {
+		bridgeStats.tcpRxDropped += bulk - stored;
+
+		uart_debugSend("[__recvHandler] receive segments exhausted!\r\n");
+	}
+}
+
+//Data payload is received as in raw mode and is all that credits count.
+//Messages on the other channels are collected and handed over once
+//complete, anything past FRAME_MAX_MESSAGE is dropped.
+void __demux(struct Connection *conn, uint8 *data, uint16 len) {
+	while(len > 0) {
+		uint16 count;
+
+		if(conn->frameHeaderLen < FRAME_HEADER_LEN) {
+			conn->frameHeader[conn->frameHeaderLen++] = *data++;
+			len--;
+
+			if(conn->frameHeaderLen == FRAME_HEADER_LEN) {
+				conn->frameLeft = (conn->frameHeader[2] << 8) | conn->frameHeader[3];
+				conn->frameLen = 0;
+
+				if(conn->frameLeft == 0) {
+					__endFrame(conn);
+				}
+			}
+			continue;
+		}
+
+		count = (len < conn->frameLeft) ? len : conn->frameLeft;
+
+		if(conn->frameHeader[0] == FRAME_DATA) {
+			conn->recvTotal += count;
+			__receiveData(conn, data, count);
+		}
+		else if(conn->frameLen < FRAME_MAX_MESSAGE) {
+			uint16 keep = FRAME_MAX_MESSAGE - conn->frameLen;
+			if(keep > count)
+				keep = count;
+
+			memcpy(conn->frameBuf + conn->frameLen, data, keep);
+			conn->frameLen += keep;
+		}
+
+		data += count;
+		len -= count;
+		conn->frameLeft -= count;
+
+		if(conn->frameLeft == 0) {
+			__endFrame(conn);
+		}
+	}
+}
+
+void __endFrame(struct Connection *conn) {
+	conn->frameHeaderLen = 0;
+
+	if((conn->frameHeader[0] != FRAME_DATA) && (conn->frameHandler != NULL)) {
+		conn->frameHandler(conn->frameHeader[0], conn->frameBuf, conn->frameLen);
+	}
+}
+
 void __sentHandler(void *arg) {
 	struct Connection *conn = (struct Connection*)(((struct espconn*)arg)->reverse);
 	
 	conn->sendCount--;
 
-/*
-	char msg[128];
-	os_sprintf(msg, "[__sentHandler] %d\r\n", (int)conn->sendCount);
-	uart_debugSend(msg);
-*/
-
-	if((conn->sendCount < MAX_SEND_COUNT) && (conn->sendLen > 0)) {
-		uint16 sendAmt = __send(conn, conn->sendBuffer, conn->sendLen);
-		
-		if(sendAmt != 0) {
-			if(sendAmt != conn->sendLen) {
-				memmove(conn->sendBuffer, conn->sendBuffer + sendAmt,
-					conn->sendLen - sendAmt);
-			}
-			conn->sendLen -= sendAmt;
-		}
+	TRACE_EVENT(TRACE_TCP_SENT, 0);
 
-		//char msg[128];
-		//os_sprintf(msg, "[sentHandler] Sent %d (%d)\r\n", (int)sendAmt, (int)conn->sendLen);
-		//__debug(msg);
+	//Segments complete in order, return the oldest one to the pool
+	uint8 seg = SegmentQueue_pop(&conn->sentQueue);
+	if(seg != SEGMENT_NONE) {
+		SegmentPool_free(seg);
 	}
+
+	//The freed segment may lift the receive hold
+	__updateHold(conn);
+
+	if(conn->sentHandler != NULL) {
+		conn->sentHandler();
+	}
+
+	__sendQueued(conn);
 }
 
 void __writeHandler(void *arg) {
-	struct Connection *conn = (struct Connection*)(((struct espconn*)arg)->reverse);
 }
 
 void __sendTimerHandler(void *arg) {
-	if((_tcpConn.sendCount < MAX_SEND_COUNT) && (_tcpConn.sendLen > 0)) {
-		uint16 sendAmt = __send(&_tcpConn, _tcpConn.sendBuffer, _tcpConn.sendLen);
+	_sendWaiting = 0;
 
-		if(sendAmt != 0) {
-			if(sendAmt != _tcpConn.sendLen) {
-				memmove(_tcpConn.sendBuffer, _tcpConn.sendBuffer + sendAmt,
-					_tcpConn.sendLen - sendAmt);
-			}
-			_tcpConn.sendLen -= sendAmt;
-		}
-	}
+	__sendQueued(&_tcpConn);
 }
@@ -0,0 +1,156 @@
+#include "user_testmode.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+#include <string.h>
+
+#include "driver/SegmentPool.h"
+#include "driver/uart.h"
+#include "user_tcp.h"
+#include "user_stats.h"
+
+//Source mode payload, alternating bits are easy to spot on a scope
+#define SOURCE_PATTERN	(0x55)
+
+static const char *MODE_NAMES[] = { "off", "echo", "loopback", "source", "sink" };
+
+static uint8 _mode = TEST_OFF;
+
+//Counter values when the mode was entered
+static uint32 _startTime;
+static uint32 _startTcpRx, _startTcpTx, _startUartRx;
+
+//Send to ACK timing, one send is timed at a time
+static uint32 _sendTime;
+static uint32 _ackCount, _ackTotal, _ackMax;
+
+static void __send(uint8 seg);
+
+void ICACHE_FLASH_ATTR testmode_set(uint8 mode) {
+	_mode = mode;
+
+	_startTime = system_get_time();
+	_startTcpRx = bridgeStats.tcpRxBytes;
+	_startTcpTx = bridgeStats.tcpTxBytes;
+	_startUartRx = bridgeStats.uartRxBytes;
+
+	_sendTime = 0;
+	_ackCount = _ackTotal = _ackMax = 0;
+
+	uart_setLoopback(mode == TEST_LOOPBACK);
+
+	//Nothing else will start a connected link
+	testmode_sent();
+}
+
+uint8 ICACHE_FLASH_ATTR testmode_get() {
+	return _mode;
+}
+
+uint8 testmode_recv() {
+	uint8 seg;
+
+	if(_mode == TEST_ECHO) {
+		while((seg = tcp_takeSegment()) != SEGMENT_NONE) {
+			__send(seg);
+		}
+
+		return 1;
+	}
+	else if(_mode == TEST_SINK) {
+		while((seg = tcp_takeSegment()) != SEGMENT_NONE) {
+			SegmentPool_free(seg);
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+void testmode_sent() {
+	uint8 seg;
+
+	if(_sendTime != 0) {
+		uint32 elapsed = system_get_time() - _sendTime;
+
+		_ackCount++;
+		_ackTotal += elapsed;
+		if(elapsed > _ackMax) {
+			_ackMax = elapsed;
+		}
+
+		_sendTime = 0;
+	}
+
+	if((_mode != TEST_SOURCE) || !tcp_isConnected()) {
+		return;
+	}
+
+	//The UART isn't used in source mode, so its share of the pool is
+	//what keeps the link full
+	while((seg = SegmentPool_alloc(SEGMENT_UART_RX)) != SEGMENT_NONE) {
+		Segment *s = SegmentPool_get(seg);
+
+		s->offset = tcp_getHeadroom();
+		s->len = TCP_MAX_PACKET;
+		os_memset(s->data + s->offset, SOURCE_PATTERN, s->len - s->offset);
+
+		__send(seg);
+	}
+}
+
+uint16 ICACHE_FLASH_ATTR testmode_report(char *buffer, uint16 size) {
+	uint32 ms = (system_get_time() - _startTime) / 1000;
+	uint32 tcpRx = bridgeStats.tcpRxBytes - _startTcpRx;
+	uint32 tcpTx = bridgeStats.tcpTxBytes - _startTcpTx;
+
+	//Worst case is well below this
+	if(size < 256) {
+		return 0;
+	}
+
+	if(ms == 0) {
+		ms = 1;
+	}
+
+	//Bytes per millisecond is kB/s
+	return os_sprintf(buffer,
+		"test=%s\n"
+		"ms=%u\n"
+		"tcp_rx=%u\n"
+		"tcp_rx_kBps=%u\n"
+		"tcp_tx=%u\n"
+		"tcp_tx_kBps=%u\n"
+		"uart_rx=%u\n"
+		"acks=%u\n"
+		"ack_avg_us=%u\n"
+		"ack_max_us=%u\n",
+		MODE_NAMES[_mode], ms,
+		tcpRx, tcpRx / ms,
+		tcpTx, tcpTx / ms,
+		bridgeStats.uartRxBytes - _startUartRx,
+		_ackCount, _ackCount ? _ackTotal / _ackCount : 0, _ackMax);
+}
+
+uint8 ICACHE_FLASH_ATTR testmode_parse(const char *name) {
+	uint8 i;
+
+	for(i = 0; i < sizeof(MODE_NAMES)/sizeof(MODE_NAMES[0]); ++i) {
+		if(strcmp(name, MODE_NAMES[i]) == 0) {
+			return i;
+		}
+	}
+
+	return TEST_UNKNOWN;
+}
+
+//lwIP calls back once the data is ACKed, which times the WiFi leg plus
+//anything already queued ahead of it
+void __send(uint8 seg) {
+	if(_sendTime == 0) {
+		_sendTime = system_get_time();
+	}
+
+	tcp_sendSegment(seg);
+}
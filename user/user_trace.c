@@ -0,0 +1,93 @@
+#include "user_trace.h"
+
+#ifdef TRACE
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "user_interface.h"
+
+//Longest "<time> <type> <len>" line, and the counters after the last one
+#define TRACE_LINE_LEN	(32)
+#define TRACE_TAIL_LEN	(48)
+
+static const char *TYPE_NAMES[TRACE_TYPES] = {
+	"none", "uart_rx", "uart_tx", "tcp_recv", "tcp_send", "tcp_sent", "connect", "disconnect"
+};
+
+static struct TraceEvent _events[TRACE_DEPTH];
+static volatile uint16 _front, _back;
+static volatile uint32 _dropped;
+
+void ICACHE_FLASH_ATTR
+trace_init() {
+	_front = _back = 0;
+	_dropped = 0;
+}
+
+//Called from the UART ISR as well as from tasks, so it must stay in IRAM
+void trace_record(uint8 type, uint16 len) {
+	ETS_UART_INTR_DISABLE();
+
+	uint16 next = (_back + 1) & (TRACE_DEPTH - 1);
+
+	if(next == _front) {
+		//Full, keep the oldest events so a capture has a clean start
+		_dropped++;
+	}
+	else {
+		_events[_back].time = system_get_time();
+		_events[_back].type = type;
+		_events[_back].reserved = 0;
+		_events[_back].len = len;
+
+		_back = next;
+	}
+
+	ETS_UART_INTR_ENABLE();
+}
+
+uint16 ICACHE_FLASH_ATTR
+trace_read(struct TraceEvent *out, uint16 count) {
+	uint16 read = 0;
+
+	ETS_UART_INTR_DISABLE();
+
+	while((read < count) && (_front != _back)) {
+		out[read++] = _events[_front];
+		_front = (_front + 1) & (TRACE_DEPTH - 1);
+	}
+
+	ETS_UART_INTR_ENABLE();
+
+	return read;
+}
+
+uint32 ICACHE_FLASH_ATTR
+trace_getDropped() {
+	return _dropped;
+}
+
+const char* ICACHE_FLASH_ATTR
+trace_typeName(uint8 type) {
+	return (type < TRACE_TYPES) ? TYPE_NAMES[type] : TYPE_NAMES[0];
+}
+
+uint16 ICACHE_FLASH_ATTR
+trace_report(char *buffer, uint16 size) {
+	struct TraceEvent event;
+	uint16 len = 0;
+
+	while((size - len >= TRACE_LINE_LEN + TRACE_TAIL_LEN) && (trace_read(&event, 1) == 1)) {
+		len += os_sprintf(buffer + len, "%u %s %u\n", event.time,
+			trace_typeName(event.type), event.len);
+	}
+
+	if(size - len < TRACE_TAIL_LEN) {
+		return 0;
+	}
+
+	return len + os_sprintf(buffer + len, "trace_dropped=%u\ntrace_left=%u\n", _dropped,
+		(uint16)((_back - _front) & (TRACE_DEPTH - 1)));
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "user_udp.h"
+
+#include "ip_addr.h"
+#include "osapi.h"
+#include "espconn.h"
+#include "user_interface.h"
+
+#include "driver/SegmentPool.h"
+#include "user_stats.h"
+#include "user_tcp.h"
+
+static struct espconn _udpConn;
+static esp_udp _udpProto;
+
+static uint8 _peer;
+static uint32 _peerAddr;
+static uint32 _peerHeard;
+
+static void __recvHandler(void *arg, char *data, unsigned short len);
+
+void ICACHE_FLASH_ATTR udp_start(uint16 port) {
+	_peer = 0;
+
+	_udpConn.type = ESPCONN_UDP;
+	_udpConn.state = ESPCONN_NONE;
+	_udpConn.proto.udp = &_udpProto;
+	_udpConn.proto.udp->local_port = port;
+
+	espconn_regist_recvcb(&_udpConn, &__recvHandler);
+	espconn_create(&_udpConn);
+}
+
+uint8 udp_hasPeer() {
+	if(_peer && ((system_get_time() - _peerHeard) > UDP_PEER_TIMEOUT*1000)) {
+		_peer = 0;
+	}
+
+	//Or the session it came with is gone
+	if(_peer && (!tcp_isConnected() || (tcp_getRemoteAddr() != _peerAddr))) {
+		_peer = 0;
+	}
+
+	return _peer;
+}
+
+//espconn copies UDP payloads into a pbuf before returning
+void udp_sendSegment(uint8 seg) {
+	Segment *s = SegmentPool_get(seg);
+
+	if(espconn_send(&_udpConn, s->data + s->offset, s->len - s->offset) == 0) {
+		bridgeStats.tcpTxBytes += s->len - s->offset;
+	}
+	else {
+		bridgeStats.segmentsDropped++;
+	}
+
+	SegmentPool_free(seg);
+}
+
+void ICACHE_FLASH_ATTR __recvHandler(void *arg, char *data, unsigned short len) {
+	struct espconn *conn = (struct espconn*)arg;
+	remot_info *remote = NULL;
+
+	if(espconn_get_connection_info(conn, &remote, 0) == ESPCONN_OK) {
+		uint32 addr;
+
+		//Only the session's own host, anyone else could take the robot's
+		//data away from it
+		os_memcpy(&addr, remote->remote_ip, 4);
+		if(!tcp_isConnected() || (addr != tcp_getRemoteAddr())) {
+			return;
+		}
+
+		os_memcpy(conn->proto.udp->remote_ip, remote->remote_ip, 4);
+		conn->proto.udp->remote_port = remote->remote_port;
+
+		_peer = 1;
+		_peerAddr = addr;
+		_peerHeard = system_get_time();
+	}
+}